@@ -0,0 +1,110 @@
+/*!
+  \file        bench_mac2device.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A benchmark of bluetooth_mac2device(), called by every sample at startup:
+compares the former "hciconfig" parsing with the HCI ioctl lookup,
+without and with the cache.
+Needs a Bluetooth adapter, but no robot.
+ */
+#include "src/bluetooth_mac2device.h"
+#include "src/exec_system_get_output.h"
+#include "src/find_and_replace.h"
+#include "src/string_split.h"
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+
+inline double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1E9 + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! the lookup previously done in bluetooth_mac2device()
+inline std::string legacy_mac2device(const std::string & mac_address) {
+  std::string result = exec_system_get_output("hciconfig");
+  StringUtils::find_and_replace(result, "\n", " ");
+  StringUtils::find_and_replace(result, "\t", " ");
+  while (StringUtils::find_and_replace(result, "  ", " ")) {}
+  std::vector<std::string> words;
+  StringUtils::StringSplit(result, " ", &words);
+  std::vector<std::string>::const_iterator it =
+      std::find(words.begin(), words.end(), mac_address);
+  if (it == words.end())
+    return "";
+  while (it >= words.begin()) {
+    if (it->size() > 3 && it->substr(0, 3) == "hci")
+      return it->substr(0, 4);
+    --it;
+  }
+  return "";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+  // use the first adapter if no MAC is given
+  const std::vector<bluetooth_mac2device_cache::Adapter> & adapters =
+      bluetooth_mac2device_cache::adapters();
+  std::string mac;
+  if (argc >= 2)
+    mac = argv[1];
+  else if (!adapters.empty()) {
+    char str[18];
+    ba2str(&adapters.front().bdaddr, str);
+    mac = str;
+  }
+  else {
+    printf("No Bluetooth adapter up, and no MAC given!\n");
+    return -1;
+  }
+  unsigned int niters = (argc >= 3 ? atoi(argv[2]) : 20);
+
+  std::string legacy_dev, uncached_dev, cached_dev;
+  double start = now_ns();
+  for (unsigned int i = 0; i < niters; ++i)
+    legacy_dev = legacy_mac2device(mac);
+  double legacy_ns = (now_ns() - start) / niters;
+
+  start = now_ns();
+  for (unsigned int i = 0; i < niters; ++i) {
+    bluetooth_mac2device_cache::adapters(true); // force a new scan
+    uncached_dev = bluetooth_mac2device(mac);
+  }
+  double uncached_ns = (now_ns() - start) / niters;
+
+  start = now_ns();
+  for (unsigned int i = 0; i < niters; ++i)
+    cached_dev = bluetooth_mac2device(mac);
+  double cached_ns = (now_ns() - start) / niters;
+
+  if (legacy_dev != cached_dev || uncached_dev != cached_dev)
+    printf("Lookups disagree: '%s', '%s', '%s'!\n",
+           legacy_dev.c_str(), uncached_dev.c_str(), cached_dev.c_str());
+  printf("'%s' -> '%s', %u lookups\n", mac.c_str(), cached_dev.c_str(), niters);
+  printf("legacy (popen hciconfig, parsing): %12.0f ns/lookup\n", legacy_ns);
+  printf("HCI ioctls, no cache:              %12.0f ns/lookup\n", uncached_ns);
+  printf("HCI ioctls, cached:                %12.0f ns/lookup\n", cached_ns);
+  printf("startup time saved: %.2f ms\n", (legacy_ns - cached_ns) / 1E6);
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*!
+  \file        bench_notifications.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A microbenchmark for the decoding of the notifications sent by the robot:
+compares the former ostringstream / substr / vector decoding
+with the in-place MipNotification::decode().
+No robot is needed.
+ */
+#include "src/mipnotification.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//! the notifications a robot streams the most: radar, gesture, status, odometer, chest LED
+static const char* PAYLOADS[] = {
+  "0C02", "0C01", "0A0B", "795002", "850000A1B2", "83FF00800000"
+};
+static const unsigned int NPAYLOADS = sizeof(PAYLOADS) / sizeof(PAYLOADS[0]);
+
+inline double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1E9 + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! the decoding previously done in Mip::events_handler()
+inline unsigned int legacy_hex2int(const std::string & char_pair){
+  std::stringstream convertStream;
+  convertStream << std::hex << char_pair;
+  unsigned int buffer;
+  convertStream >> std::hex >> buffer;
+  return buffer;
+}
+
+inline int legacy_decode(const uint8_t *pdu, uint16_t len) {
+  std::ostringstream hex_ans_stream;
+  for (uint16_t i = 3; i < len; i++)
+    hex_ans_stream << (char) pdu[i];
+  std::string hex_ans = hex_ans_stream.str();
+  MipCommand cmd = legacy_hex2int(hex_ans.substr(0, 2));
+  unsigned int npairs = (hex_ans.size()-2) / 2;
+  std::vector<int> values(npairs);
+  for (unsigned int i = 0; i < npairs; ++i)
+    values[i] = legacy_hex2int(hex_ans.substr(2+i*2, 2));
+  int sum = cmd;
+  for (unsigned int i = 0; i < npairs; ++i)
+    sum += values[i];
+  return sum;
+}
+
+inline int new_decode(const uint8_t *pdu, uint16_t len) {
+  MipNotification notif;
+  if (!notif.decode(pdu + 3, len - 3))
+    return 0;
+  int sum = notif.cmd;
+  for (unsigned int i = 0; i < notif.nvalues; ++i)
+    sum += notif[i];
+  return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+  unsigned int niters = (argc >= 2 ? atoi(argv[1]) : 1000000);
+  // build the PDUs as they come out of the socket: ATT notify opcode, handle, payload
+  uint8_t pdus[NPAYLOADS][32];
+  uint16_t lens[NPAYLOADS];
+  for (unsigned int p = 0; p < NPAYLOADS; ++p) {
+    pdus[p][0] = 0x1B; // ATT_OP_HANDLE_NOTIFY
+    pdus[p][1] = 0x0e;
+    pdus[p][2] = 0x00;
+    lens[p] = 3 + strlen(PAYLOADS[p]);
+    memcpy(pdus[p] + 3, PAYLOADS[p], lens[p] - 3);
+  }
+  // check both decoders agree
+  for (unsigned int p = 0; p < NPAYLOADS; ++p) {
+    if (legacy_decode(pdus[p], lens[p]) != new_decode(pdus[p], lens[p])) {
+      printf("Decoders disagree on '%s'!\n", PAYLOADS[p]);
+      return -1;
+    }
+  }
+
+  volatile int sink = 0;
+  double start = now_ns();
+  for (unsigned int i = 0; i < niters; ++i)
+    sink += legacy_decode(pdus[i % NPAYLOADS], lens[i % NPAYLOADS]);
+  double legacy_ns = (now_ns() - start) / niters;
+
+  start = now_ns();
+  for (unsigned int i = 0; i < niters; ++i)
+    sink += new_decode(pdus[i % NPAYLOADS], lens[i % NPAYLOADS]);
+  double new_ns = (now_ns() - start) / niters;
+
+  printf("%u notifications\n", niters);
+  printf("legacy (ostringstream, substr, vector): %8.1f ns/notification\n", legacy_ns);
+  printf("MipNotification::decode():              %8.1f ns/notification\n", new_ns);
+  printf("speedup: x%.1f\n", legacy_ns / new_ns);
+  return 0;
+}
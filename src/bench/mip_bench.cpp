@@ -0,0 +1,371 @@
+/*!
+  \file        mip_bench.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+The microbenchmarks of the hot paths of libmip, with no robot nor Bluetooth:
+the notifications go through the decoding and Mip::events_handler(),
+the commands through Mip::send_order() and GAttrib, up to a MipSimulator.
+
+Each benchmark runs REPEATS times, the results are printed on stdout
+as one JSON object per line, to be compared across versions:
+{"benchmark":"events_handler","iterations":1000000,"repeats":5,
+ "ns_per_op_min":51.2,"ns_per_op_median":52.0,"ops_per_s":19230769,"allocs_per_op":0.00}
+The batch conversions are first checked against the scalar ones,
+over a grid of speeds and all the ticks:
+{"validation":"speed2ticks_batch","samples":9606401,"mismatches":0}
+the program fails if they disagree.
+The allocations are counted by wrapping malloc() - glibc only -
+in the benchmark thread, which covers operator new and g_malloc().
+The prints of the library are silenced meanwhile.
+
+Synopsis: mip_bench [ITERATIONS] [REPEATS] [NAME_FILTER]
+ */
+#include "src/mipsimulator.h"
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//! the allocations of the current thread, counted by the malloc() wrappers
+static __thread unsigned long bench_nallocs = 0;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* malloc(size_t size) { ++bench_nallocs; return __libc_malloc(size); }
+void* calloc(size_t n, size_t size) { ++bench_nallocs; return __libc_calloc(n, size); }
+void* realloc(void* ptr, size_t size) { ++bench_nallocs; return __libc_realloc(ptr, size); }
+} // end extern "C"
+
+inline double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1E9 + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! access to the protected handlers of Mip
+class BenchMip : public Mip {
+public:
+  static void events(const uint8_t *pdu, uint16_t len, Mip* mip) { events_handler(pdu, len, mip); }
+  inline void store(const MipNotification & notif) { store_results(notif); }
+};
+
+//! the notifications a robot streams the most: radar, gesture, status, odometer, chest LED
+static const char* PAYLOADS[] = {
+  "0C02", "0C01", "0A0B", "795002", "850000A1B2", "83FF00800000"
+};
+static const unsigned int NPAYLOADS = sizeof(PAYLOADS) / sizeof(PAYLOADS[0]);
+
+struct Pdus {
+  uint8_t data[NPAYLOADS][ATT_DEFAULT_LE_MTU];
+  uint16_t lens[NPAYLOADS];
+  Pdus() { // as they come out of the socket: ATT notify opcode, handle, payload
+    for (unsigned int p = 0; p < NPAYLOADS; ++p) {
+      data[p][0] = ATT_OP_HANDLE_NOTIFY;
+      att_put_u16(0x000e, data[p] + 1);
+      lens[p] = 3 + strlen(PAYLOADS[p]);
+      memcpy(data[p] + 3, PAYLOADS[p], lens[p] - 3);
+    }
+  }
+};
+
+//! the inputs of the batch conversions, sweeps of all the cases, as in the scalar benchmarks
+struct SpeedSamples {
+  static const unsigned int SIZE = 1800; // lcm(200, 360)
+  double v_ms[SIZE], w_rads[SIZE];
+  int v_ticks[SIZE], w_ticks[SIZE];
+  //! the outputs
+  double v_ms_out[SIZE], w_rads_out[SIZE];
+  int v_ticks_out[SIZE], w_ticks_out[SIZE];
+  SpeedSamples() {
+    for (unsigned int i = 0; i < SIZE; ++i) {
+      v_ms[i] = -1 + (i % 200) * .01;
+      w_rads[i] = -18 + (i % 360) * .1;
+      v_ticks[i] = (int) (i % 129) - 64;
+      w_ticks[i] = (int) (i % 127) - 64;
+    }
+  }
+};
+
+//! \return the number of samples for which the batch and scalar conversions disagree
+inline unsigned long validate_batch_conversions(FILE* results) {
+  // speeds: a fine grid, beyond the bounds
+  const int NV = 2401, NW = 4001; // v in [-1.2, 1.2], w in [-20, 20]
+  std::vector<double> v_ms(NW), w_rads(NW);
+  std::vector<int> v_ticks(NW), w_ticks(NW);
+  unsigned long nmismatches = 0;
+  for (int iv = 0; iv < NV; ++iv) {
+    for (int iw = 0; iw < NW; ++iw) {
+      v_ms[iw] = -1.2 + iv * .001;
+      w_rads[iw] = -20 + iw * .01;
+    }
+    Mip::speed2ticks(&v_ms[0], &w_rads[0], NW, &v_ticks[0], &w_ticks[0]);
+    for (int iw = 0; iw < NW; ++iw) {
+      int v_ticks1, w_ticks1;
+      Mip::speed2ticks(v_ms[iw], w_rads[iw], v_ticks1, w_ticks1);
+      nmismatches += (v_ticks1 != v_ticks[iw] || w_ticks1 != w_ticks[iw]);
+    }
+  }
+  fprintf(results, "{\"validation\":\"speed2ticks_batch\",\"samples\":%i,\"mismatches\":%lu}\n",
+          NV * NW, nmismatches);
+  // ticks: all the pairs, and some out of the tables
+  unsigned long nmismatches_ticks = 0;
+  const int NTICKS = 201; // in [-100, 100]
+  std::vector<int> v_ticks2(NTICKS), w_ticks2(NTICKS);
+  std::vector<double> v_ms2(NTICKS), w_rads2(NTICKS);
+  for (int v = 0; v < NTICKS; ++v) {
+    for (int w = 0; w < NTICKS; ++w) {
+      v_ticks2[w] = v - 100;
+      w_ticks2[w] = w - 100;
+    }
+    Mip::ticks2speeds(&v_ticks2[0], &w_ticks2[0], NTICKS, &v_ms2[0], &w_rads2[0]);
+    for (int w = 0; w < NTICKS; ++w) {
+      double v_ms1, w_rads1;
+      Mip::ticks2speeds(v_ticks2[w], w_ticks2[w], v_ms1, w_rads1);
+      nmismatches_ticks += (v_ms1 != v_ms2[w] || w_rads1 != w_rads2[w]);
+    }
+  }
+  fprintf(results, "{\"validation\":\"ticks2speeds_batch\",\"samples\":%i,\"mismatches\":%lu}\n",
+          NTICKS * NTICKS, nmismatches_ticks);
+  fflush(results);
+  return nmismatches + nmismatches_ticks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! a benchmark: runs niters operations
+struct Benchmark {
+  const char* name;
+  //! the iterations are divided by this, for the slow operations
+  unsigned int iters_divider;
+  std::function<void(unsigned int niters)> run;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! a GAttrib on a socketpair, whose queue is flushed between the timed batches
+class AttribQueue {
+public:
+  static const unsigned int BATCH = 64;
+
+  AttribQueue() {
+    socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, _fds);
+    fcntl(_fds[1], F_SETFL, fcntl(_fds[1], F_GETFL) | O_NONBLOCK);
+    _context = g_main_context_new();
+    g_main_context_push_thread_default(_context); // GAttrib uses the thread default context
+    _channel = g_io_channel_unix_new(_fds[0]);
+    g_io_channel_set_close_on_unref(_channel, TRUE);
+    _attrib = g_attrib_new_with_mtu(_channel, ATT_DEFAULT_LE_MTU);
+    g_main_context_pop_thread_default(_context);
+  }
+  ~AttribQueue() {
+    g_attrib_unref(_attrib);
+    g_io_channel_unref(_channel);
+    close(_fds[1]);
+    g_main_context_unref(_context);
+  }
+
+  //! \return the time spent in g_attrib_send(), in ns
+  inline double send_batch(const uint8_t *pdu, uint16_t len) {
+    double start = now_ns();
+    for (unsigned int i = 0; i < BATCH; ++i)
+      g_attrib_send(_attrib, 0, pdu, len, NULL, NULL, NULL);
+    double time = now_ns() - start;
+    // write the queue to the socket and read it on the other side, not timed
+    uint8_t buf[ATT_DEFAULT_LE_MTU];
+    for (unsigned int nreceived = 0; nreceived < BATCH; ) {
+      g_main_context_iteration(_context, FALSE);
+      while (recv(_fds[1], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ++nreceived;
+    }
+    return time;
+  }
+
+private:
+  int _fds[2];
+  GMainContext *_context;
+  GIOChannel *_channel;
+  GAttrib *_attrib;
+}; // end class AttribQueue
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+  unsigned int niters = (argc >= 2 ? atoi(argv[1]) : 1000000),
+      nrepeats = (argc >= 3 ? atoi(argv[2]) : 5);
+  std::string filter = (argc >= 4 ? argv[3] : "");
+  // the results on the real stdout, the prints of the library in /dev/null
+  fflush(stdout);
+  FILE* results = fdopen(dup(STDOUT_FILENO), "w");
+  if (!results || !freopen("/dev/null", "w", stdout))
+    return -1;
+
+  if (validate_batch_conversions(results)) {
+    fprintf(stderr, "The batch conversions differ from the scalar ones!\n");
+    return -1;
+  }
+
+  Pdus pdus;
+  SpeedSamples speeds;
+  BenchMip mip;
+  volatile double sink = 0;
+
+  // the commands go to a simulated robot, answering nothing to the chest LED
+  GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
+  MipSimulator simulator;
+  BenchMip connected_mip;
+  if (!simulator.connect(connected_mip, main_loop)) {
+    fprintf(stderr, "Could not connect to the simulator!\n");
+    return -1;
+  }
+  AttribQueue queue;
+  double attrib_send_ns = 0, log_ns = 0;
+
+  std::vector<Benchmark> benchmarks;
+  benchmarks.push_back(Benchmark{"notification_decode", 1, [&](unsigned int n) {
+    MipNotification notif;
+    for (unsigned int i = 0; i < n; ++i) {
+      unsigned int p = i % NPAYLOADS;
+      notif.decode(pdus.data[p] + 3, pdus.lens[p] - 3);
+      sink = sink + notif.nvalues;
+    }
+  }});
+  benchmarks.push_back(Benchmark{"store_results", 1, [&](unsigned int n) {
+    MipNotification notifs[NPAYLOADS];
+    for (unsigned int p = 0; p < NPAYLOADS; ++p)
+      notifs[p].decode(pdus.data[p] + 3, pdus.lens[p] - 3);
+    for (unsigned int i = 0; i < n; ++i)
+      mip.store(notifs[i % NPAYLOADS]);
+  }});
+  benchmarks.push_back(Benchmark{"events_handler", 1, [&](unsigned int n) {
+    for (unsigned int i = 0; i < n; ++i)
+      BenchMip::events(pdus.data[i % NPAYLOADS], pdus.lens[i % NPAYLOADS], &mip);
+  }});
+  benchmarks.push_back(Benchmark{"enc_write_cmd", 1, [&](unsigned int n) {
+    uint8_t value[4] = {CMD_SET_CHEST_LED, 0, 0, 0}, buf[ATT_DEFAULT_LE_MTU];
+    for (unsigned int i = 0; i < n; ++i) {
+      value[1] = i;
+      sink = sink + enc_write_cmd(0x13, value, sizeof(value), buf, sizeof(buf));
+    }
+  }});
+  benchmarks.push_back(Benchmark{"g_attrib_send", 1, [&](unsigned int n) {
+    uint8_t value[4] = {CMD_SET_CHEST_LED, 1, 2, 3}, pdu[ATT_DEFAULT_LE_MTU];
+    uint16_t len = enc_write_cmd(0x13, value, sizeof(value), pdu, sizeof(pdu));
+    // only the queueing is timed, \see AttribQueue::send_batch()
+    attrib_send_ns = 0;
+    for (unsigned int i = 0; i < n; i += AttribQueue::BATCH)
+      attrib_send_ns += queue.send_batch(pdu, len);
+  }});
+  benchmarks.push_back(Benchmark{"send_command", 10, [&](unsigned int n) {
+    for (unsigned int i = 0; i < n; ++i)
+      connected_mip.set_chest_LED(i & 0xFF, 0, 0);
+  }});
+  benchmarks.push_back(Benchmark{"histogram_record", 1, [&](unsigned int n) {
+    MipHistogram histo;
+    for (unsigned int i = 0; i < n; ++i)
+      histo.record((i * 2654435761u) >> 12); // spread over the buckets
+    sink = sink + histo.max();
+  }});
+  benchmarks.push_back(Benchmark{"log_message", 1, [&](unsigned int n) {
+    // only the enqueueing is timed, the queue is drained between the batches
+    const unsigned int batch = MipLog::QUEUE_SIZE / 2;
+    log_ns = 0;
+    for (unsigned int i = 0; i < n; i += batch) {
+      double start = now_ns();
+      for (unsigned int j = 0; j < batch; ++j)
+        MIP_LOG_WARN("speed2ticks(%g, %g) -> (%i, %i)\n", .1 * j, -.2, j, 3);
+      log_ns += now_ns() - start;
+      MipLog::instance().flush();
+    }
+  }});
+  benchmarks.push_back(Benchmark{"speed2ticks", 1, [&](unsigned int n) {
+    int v_ticks, w_ticks;
+    for (unsigned int i = 0; i < n; ++i) {
+      Mip::speed2ticks(-1 + (i % 200) * .01, -18 + (i % 360) * .1, v_ticks, w_ticks);
+      sink = sink + v_ticks + w_ticks;
+    }
+  }});
+  benchmarks.push_back(Benchmark{"speed2ticks_batch", 1, [&](unsigned int n) {
+    for (unsigned int i = 0; i < n; i += SpeedSamples::SIZE) {
+      unsigned int batch = std::min(n - i, (unsigned int) SpeedSamples::SIZE);
+      Mip::speed2ticks(speeds.v_ms, speeds.w_rads, batch,
+                       speeds.v_ticks_out, speeds.w_ticks_out);
+      sink = sink + speeds.v_ticks_out[0] + speeds.w_ticks_out[batch - 1];
+    }
+  }});
+  benchmarks.push_back(Benchmark{"ticks2speeds", 1, [&](unsigned int n) {
+    double v_ms, w_rads;
+    for (unsigned int i = 0; i < n; ++i) {
+      Mip::ticks2speeds((int) (i % 129) - 64, (int) (i % 127) - 64, v_ms, w_rads);
+      sink = sink + v_ms + w_rads;
+    }
+  }});
+  benchmarks.push_back(Benchmark{"ticks2speeds_batch", 1, [&](unsigned int n) {
+    for (unsigned int i = 0; i < n; i += SpeedSamples::SIZE) {
+      unsigned int batch = std::min(n - i, (unsigned int) SpeedSamples::SIZE);
+      Mip::ticks2speeds(speeds.v_ticks, speeds.w_ticks, batch,
+                        speeds.v_ms_out, speeds.w_rads_out);
+      sink = sink + speeds.v_ms_out[0] + speeds.w_rads_out[batch - 1];
+    }
+  }});
+  benchmarks.push_back(Benchmark{"get_pose", 1, [&](unsigned int n) {
+    // extrapolated along an arc, as while driving: new commands before they expire
+    MipPoseEstimator estimator;
+    for (unsigned int i = 0; i < n; ++i) {
+      if (i % 10000 == 0)
+        estimator.set_command(.3, 1, g_get_monotonic_time());
+      sink = sink + estimator.get_pose().x;
+    }
+  }});
+
+  for (unsigned int b = 0; b < benchmarks.size(); ++b) {
+    const Benchmark & bench = benchmarks[b];
+    if (!filter.empty() && std::string(bench.name).find(filter) == std::string::npos)
+      continue;
+    unsigned int n = std::max(niters / bench.iters_divider, 1u);
+    bench.run(n / 10 + 1); // warm up the caches
+    std::vector<double> ns_per_op;
+    unsigned long nallocs = 0;
+    for (unsigned int r = 0; r < nrepeats; ++r) {
+      unsigned long allocs_before = bench_nallocs;
+      double start = now_ns();
+      bench.run(n);
+      double time = now_ns() - start;
+      nallocs += bench_nallocs - allocs_before;
+      if (std::string(bench.name) == "g_attrib_send") // without the flushes
+        time = attrib_send_ns;
+      else if (std::string(bench.name) == "log_message")
+        time = log_ns;
+      ns_per_op.push_back(time / n);
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    fprintf(results, "{\"benchmark\":\"%s\",\"iterations\":%u,\"repeats\":%u,"
+            "\"ns_per_op_min\":%.1f,\"ns_per_op_median\":%.1f,\"ops_per_s\":%.0f,"
+            "\"allocs_per_op\":%.2f}\n",
+            bench.name, n, nrepeats, ns_per_op.front(), ns_per_op[ns_per_op.size() / 2],
+            1E9 / ns_per_op[ns_per_op.size() / 2], (double) nallocs / nrepeats / n);
+    fflush(results);
+  } // end for (b)
+  return 0;
+}
@@ -21,14 +21,116 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ________________________________________________________________________________
 Convert a bluetooth device MAC address, for instance "00:11:22:33:44:55",
  *  into a device name, for instance "hci0".
+
+The adapters are listed with the HCI ioctls of libgatt (hci_for_each_dev(),
+hci_devinfo()), no need to run "hciconfig".
+The list is cached in the process, and refreshed when the kernel
+reports that an adapter was added, removed, brought up or down.
 */
 #ifndef BLUETOOTH_MAC2DEVICE_H
 #define BLUETOOTH_MAC2DEVICE_H
 
-#include "find_and_replace.h"
-#include "exec_system_get_output.h"
-#include "string_split.h"
-#include <algorithm>
+extern "C" {
+#include "libgatt/src/bluetooth.h"
+#include "libgatt/src/hci.h"
+#include "libgatt/src/hci_lib.h"
+}
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+
+namespace bluetooth_mac2device_cache {
+
+//! an adapter: its name, for instance "hci0", and its address
+struct Adapter {
+  int dev_id;
+  std::string name;
+  bdaddr_t bdaddr;
+};
+
+struct Cache {
+  std::vector<Adapter> adapters;
+  bool valid;
+  //! a raw HCI socket receiving the stack-internal device events, -1 if none
+  int events_fd;
+  Cache() : valid(false), events_fd(-1) {}
+  ~Cache() {
+    if (events_fd >= 0)
+      close(events_fd);
+  }
+};
+
+inline Cache & cache() {
+  static Cache c;
+  return c;
+}
+
+//! open a socket receiving the "device added/removed/up/down" events of the kernel
+inline int open_device_events_socket() {
+  int fd = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, BTPROTO_HCI);
+  if (fd < 0)
+    return -1;
+  struct hci_filter filter;
+  hci_filter_clear(&filter);
+  hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
+  hci_filter_set_event(EVT_STACK_INTERNAL, &filter);
+  struct sockaddr_hci addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.hci_family = AF_BLUETOOTH;
+  addr.hci_dev = HCI_DEV_NONE;
+  addr.hci_channel = HCI_CHANNEL_RAW;
+  if (setsockopt(fd, SOL_HCI, HCI_FILTER, &filter, sizeof(filter)) < 0
+      || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+//! \return true if an adapter was added, removed, brought up or down since the last call
+inline bool device_events_pending(int fd) {
+  bool pending = false;
+  unsigned char buf[HCI_MAX_EVENT_SIZE];
+  // the socket is non-blocking: drain all the queued events
+  while (read(fd, buf, sizeof(buf)) > 0)
+    pending = true;
+  return pending;
+}
+
+//! the hci_for_each_dev() callback, storing each adapter
+inline int add_adapter(int /*dd*/, int dev_id, long arg) {
+  struct hci_dev_info di;
+  if (hci_devinfo(dev_id, &di) < 0)
+    return 0;
+  Adapter adapter;
+  adapter.dev_id = dev_id;
+  adapter.name = di.name;
+  bacpy(&adapter.bdaddr, &di.bdaddr);
+  ((std::vector<Adapter> *) arg)->push_back(adapter);
+  return 0; // continue with the next adapter
+}
+
+//! \return the cached list of the adapters, refreshed if needed
+inline const std::vector<Adapter> & adapters(bool force_refresh = false) {
+  Cache & c = cache();
+  if (force_refresh)
+    c.valid = false;
+  if (c.events_fd < 0) // without events, we can not trust the cache
+    c.events_fd = open_device_events_socket();
+  if (c.events_fd < 0 || device_events_pending(c.events_fd))
+    c.valid = false;
+  if (!c.valid) {
+    c.adapters.clear();
+    hci_for_each_dev(HCI_UP, add_adapter, (long) &c.adapters);
+    c.valid = (c.events_fd >= 0);
+  }
+  return c.adapters;
+}
+
+} // end namespace bluetooth_mac2device_cache
 
 /*! Convert a bluetooth device MAC address, for instance "00:11:22:33:44:55",
  *  into a device name, for instance "hci0".
@@ -36,31 +138,31 @@ Convert a bluetooth device MAC address, for instance "00:11:22:33:44:55",
  * \param mac_address
  *    the MAC address of the device we want to use.
  * \return the device name of the device with the given MAC,
- *    or "" if the device does not exist.
+ *    or "" if the device does not exist or is down.
  */
-std::string bluetooth_mac2device(const std::string & mac_address) {
+inline std::string bluetooth_mac2device(const std::string & mac_address) {
   printf("bluetooth_mac2device('%s')\n", mac_address.c_str());
-  std::string result = exec_system_get_output("hciconfig");
-  StringUtils::find_and_replace(result, "\n", " ");
-  StringUtils::find_and_replace(result, "\t", " ");
-  while (StringUtils::find_and_replace(result, "  ", " ")) {}
-  //printf("result:'%s\n'\n", result.c_str());
-  std::vector<std::string> words;
-  StringUtils::StringSplit(result, " ", &words);
-  std::vector<std::string>::const_iterator it =
-      std::find(words.begin(), words.end(), mac_address)  ;
-  if (it == words.end()) {
-    printf("bluetooth_mac2device: no device with address'%s'\n", mac_address.c_str());
+  bdaddr_t bdaddr;
+  if (str2ba(mac_address.c_str(), &bdaddr) < 0) {
+    printf("bluetooth_mac2device: invalid address '%s'\n", mac_address.c_str());
     return "";
   }
-  while (it >= words.begin()) {
-    if (it->size() > 3 && it->substr(0, 3) == "hci")
-      return it->substr(0, 4);
-    --it;
+  // the device events may not be delivered to unprivileged users:
+  // check the cached adapter with a single ioctl, refresh the cache if it changed
+  for (unsigned int ntry = 0; ntry < 2; ++ntry) {
+    const std::vector<bluetooth_mac2device_cache::Adapter> & adapters =
+        bluetooth_mac2device_cache::adapters(ntry > 0);
+    for (unsigned int i = 0; i < adapters.size(); ++i) {
+      if (bacmp(&adapters[i].bdaddr, &bdaddr))
+        continue;
+      bdaddr_t current;
+      if (hci_devba(adapters[i].dev_id, &current) == 0 && !bacmp(&current, &bdaddr))
+        return adapters[i].name;
+      break;
+    }
   }
-  printf("bluetooth_mac2device: device with address'%s' has no 'hci' name!\n", mac_address.c_str());
+  printf("bluetooth_mac2device: no device with address'%s'\n", mac_address.c_str());
   return "";
 } // end bluetooth_mac2device()
 
 #endif // BLUETOOTH_MAC2DEVICE_H
-
@@ -39,19 +39,47 @@ extern "C" {
 }
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h> // fabs
+#include <sys/eventfd.h>
 // C++
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 #include <vector>
-#include <iomanip>      // std::setfill, std::setw
 
 #include "mipcommands.h"
+#include "miphistogram.h"
+#include "miplog.h"
+#include "mipnotification.h"
+#include "mipposeestimator.h"
+#include "miprecorder.h"
+#include "mipworker.h"
+#include "mpsc_ring.h"
+#include "rfkill_unblock_all.h"
 
-//#define DEBUG_PRINT(...)   {}
-#define DEBUG_PRINT(...)   printf(__VA_ARGS__)
 #define RAD2DEG 57.2957795130823208768
 #define DEG2RAD 0.01745329251994329577
 
+//! the exception of the futures of Mip::request_*_async() when the robot does not answer in time
+class MipTimeoutError : public std::runtime_error {
+public:
+  MipTimeoutError(MipCommand cmd)
+    : std::runtime_error(std::string("gattmip: no answer to command '")
+                         + cmd2str(cmd) + "' before the deadline"),
+      _cmd(cmd) {}
+  inline MipCommand get_command() const { return _cmd; }
+private:
+  MipCommand _cmd;
+}; // end class MipTimeoutError
+
 class Mip {
 public:
   //! a minimalistic data structure for chest led info
@@ -90,18 +118,52 @@ public:
 
   //! ctor
   Mip() {
-    // free possibly busy bluetooth devices
-    if (system("rfkill unblock all"))
+    // free possibly busy bluetooth devices, once per process
+    if (!rfkill_unblock_all_once())
       printf("Could not free possibly busy bluetooth devices! Keep fingers crossed\n");
     _is_connected = false;
+    _connect_state = NOT_CONNECTED;
+    _connect_channel = NULL;
+    _connect_timeout = NULL;
+    _connect_start_us = _connect_time_us = 0;
+    _was_connected = false;
+    _restore_on_reconnect = true;
+    _recorder = NULL;
+    _recorder_source = 0;
+    _lost_us = _dropout_us = 0;
+    _main_loop = NULL;
+    _context = NULL;
+    _worker = NULL;
+    _io_source = NULL;
+    _io_eventfd = -1;
+    _io_wakeup_pending = false;
+    _last_pending_id = 0;
+    _nresponses = 0;
+    _response_latency_sum_us = _response_latency_max_us = 0;
+    _ncommands_sent = _nnotifications = _ncommands_dropped = 0;
+    _nqueued_pdus = 0;
+    _polling_source = NULL;
+    _polling_backoff_ms = 0;
+    _npolling_requests = _npolling_bursts = _npolling_backoffs = 0;
+    memset(_last_response_us, 0, sizeof(_last_response_us));
+    memset(_in_flight, 0, sizeof(_in_flight));
+    for (unsigned int t = 0; t < 2; ++t)
+      for (unsigned int cmd = 0; cmd < 256; ++cmd)
+        _latency_histograms[t][cmd] = NULL;
     // default values
     _handle_read = 0x000e;
     _handle_write = 0x13;
+    _attrib = NULL;
     _nattrib = 0;
+    _coalescing = false;
+    _pending_latest_wins_id = 0;
+    _npending_latest_wins = 0;
+    _nlatest_wins_commands = _ncoalesced_commands = 0;
+    _write_budget = 0;
     // default values
     _last_v_ticks = _last_w_ticks = 0;
-    _volume = ERROR;
-    _game_mode = ERROR;
+    _volume = _volume_cached = ERROR;
+    _game_mode = _game_mode_cached = ERROR;
     _battery_voltage = ERROR;
     _status = ERROR;
     _weight = ERROR;
@@ -120,19 +182,118 @@ public:
     _head_led_cached = _head_led;
   }
 
+  //! dtor
+  virtual ~Mip() {
+    stop_polling();
+    if (is_io_thread_running())
+      stop_io_thread();
+    else { // the GLib sources of the robot belong to the context of the caller
+      if (_connect_state == CONNECTING)
+        finish_connect(CONNECT_CANCELLED);
+      disconnect_now();
+    }
+    cancel_pending_requests();
+    for (unsigned int t = 0; t < 2; ++t)
+      for (unsigned int cmd = 0; cmd < 256; ++cmd)
+        delete _latency_histograms[t][cmd];
+  }
+
   //////////////////////////////////////////////////////////////////////////////
 
+  //! the main loop whose context dispatches the events of the robot, NULL for the default one
   inline void set_main_loop(GMainLoop *main_loop) {
-    // connect with GLib - iterate a few times to connect well
     _main_loop = main_loop;
-    _context = g_main_loop_get_context(main_loop);
-    int ntry = 0;
-    while(ntry++ < 100 && !_is_connected) {
-        pump_up_callbacks();
-        usleep(50E3);
-      }
+    _context = (main_loop ? g_main_loop_get_context(main_loop) : g_main_context_default());
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! Run the GLib stuff of the robot in a dedicated I/O thread,
+   *  with its own GMainContext: commands go out and notifications are handled
+   *  as soon as possible, without calling pump_up_callbacks().
+   *  The commands of any thread are pushed onto a lock-free queue
+   *  drained by the I/O thread, the getters can be called from any thread.
+   *  Must be called before connect(), whose main_loop parameter is then ignored.
+   * \return true if success
+   */
+  inline bool start_io_thread() {
+    if (is_io_thread_running())
+      return true;
+    _own_worker.reset(new MipWorker);
+    if (_own_worker->start() && use_worker(_own_worker.get()))
+      return true;
+    _own_worker.reset();
+    return false;
+  }
+
+  /*! Like start_io_thread(), but share the thread of a worker with other robots.
+   *  The worker must be started, and must outlive the use by this robot.
+   *  Must be called before connect(), whose main_loop parameter is then ignored.
+   * \return true if success
+   */
+  inline bool use_worker(MipWorker *worker) {
+    if (is_io_thread_running())
+      return (worker == _worker);
+    if (_is_connected || _connect_state == CONNECTING) {
+      printf("use_worker() must be called before connect()!\n");
+      return false;
+    }
+    if (!worker || !worker->is_running())
+      return false;
+    _io_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_io_eventfd < 0) {
+      printf("Could not create the eventfd of the I/O thread!\n");
+      return false;
+    }
+    _main_loop = NULL;
+    _context = worker->get_context();
+    // the producers write in the eventfd to wake up the I/O thread
+    GIOChannel *channel = g_io_channel_unix_new(_io_eventfd);
+    _io_source = g_io_create_watch(channel, G_IO_IN);
+    // cast through void(*)(void), as G_SOURCE_FUNC() does
+    g_source_set_callback(_io_source, (GSourceFunc) (void (*)(void)) Mip::io_commands_cb,
+                          this, NULL);
+    g_source_attach(_io_source, _context);
+    g_io_channel_unref(channel);
+    _worker = worker;
+    _worker->add_robot();
+    return true;
+  }
+
+  /*! stop using the I/O thread, if any: the robot is disconnected.
+   *  It can then be connected again, after start_io_thread() or use_worker(). */
+  inline void stop_io_thread() {
+    if (!is_io_thread_running())
+      return;
+    // the GLib sources of the robot belong to the I/O thread
+    _worker->invoke_sync([this]() {
+      if (_connect_state == CONNECTING)
+        finish_connect(CONNECT_CANCELLED);
+      disconnect_now();
+      cancel_pending_requests();
+      g_source_destroy(_io_source);
+      IoOrder order; // drop the orders not sent
+      while (_io_orders.pop(order)) {}
+    });
+    g_source_unref(_io_source);
+    _io_source = NULL;
+    close(_io_eventfd);
+    _io_eventfd = -1;
+    _io_wakeup_pending = false;
+    _worker->remove_robot();
+    _worker = NULL;
+    _own_worker.reset(); // joins the thread, if it is ours
+    _context = NULL;
   }
 
+  //! \return true if the events of the robot are dispatched by a MipWorker
+  inline bool is_io_thread_running() const { return _worker != NULL; }
+
+  //! the GLib context dispatching the events of the robot
+  inline GMainContext* get_context() const { return _context; }
+  //! the worker dispatching the events of the robot, NULL if none
+  inline MipWorker* get_worker() const { return _worker; }
+
   //////////////////////////////////////////////////////////////////////////////
 
   /*! Connect with a given Bluetooth Low Energy (BTLE) device
@@ -155,41 +316,182 @@ public:
    *  The MiP mac address.
    *  This parameter corresponds to gatttool parameter -b :
    *    "Specify remote Bluetooth address", "MAC"
-   *  You can get the list of devices by running in a terminal
+   *  You can get the list of robots with the scan_robots sample, \see MipScanner,
+   *  or by running in a terminal
    *  $ sudo hcitool -i hciX lescan
    *  where hciX is your Bluetooth Low Energy (BTLE) device
+   * \param timeout_ms
+   *  the deadline of the connection
    *  \return true if the connection was a success
    */
-  bool connect(GMainLoop *main_loop, const char* device_name, const char* mip_mac) {
-    // -t : "Set LE address type. Default: public", "[public | random]"
-    const char *dst_type = "public",
-        // -l : "Set security level. Default: low", "[low | medium | high]"
-        *sec_level = "low";
-    GError* error = NULL;
-    GIOChannel* iochannel = gatt_connect(device_name, mip_mac, dst_type, sec_level, 0, 0,
-                                         Mip::connect_cb, this, &error);
-    if (iochannel == NULL) {
-        printf("Error in gatt_connect('%s'->'%s'): '%s'\n",
-               device_name, mip_mac, error->message);
-        return false;
-      }
-    set_main_loop(main_loop);
-    if (!_is_connected) {
-        printf("Error in gatt_connect('%s'->'%s'): connect_cb() not called!\n",
-               device_name, mip_mac);
+  bool connect(GMainLoop *main_loop, const char* device_name, const char* mip_mac,
+               unsigned int timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS) {
+    if (!start_connect(main_loop, device_name, mip_mac, timeout_ms) || !wait_connected()) {
+        printf("Error in gatt_connect('%s'->'%s'): %s!\n",
+               device_name, mip_mac, connect_state2str(get_connect_state()));
         return false;
       }
-    DEBUG_PRINT("gatt_connect('%s'->'%s') succesful\n", device_name, mip_mac);
+    MIP_LOG_DEBUG("gatt_connect('%s'->'%s') succesful in %g ms\n",
+                  device_name, mip_mac, get_connect_time_ms());
     return true;
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! the state of the connection, \see start_connect()
+  enum ConnectState {
+    NOT_CONNECTED = 0,
+    CONNECTING,
+    CONNECTED,
+    CONNECT_FAILED,
+    CONNECT_CANCELLED,
+    //! the link dropped after the connection, \see reconnect()
+    CONNECTION_LOST
+  };
+  static const char* connect_state2str(int state) {
+    switch (state) {
+      case NOT_CONNECTED:     return "not connected";
+      case CONNECTING:        return "connecting";
+      case CONNECTED:         return "connected";
+      case CONNECT_FAILED:    return "connection failed";
+      case CONNECT_CANCELLED: return "connection cancelled";
+      case CONNECTION_LOST:   return "connection lost";
+      default:                return "error";
+      }
+  }
+  static const unsigned int DEFAULT_CONNECT_TIMEOUT_MS = 5000;
+
+  /*! Start connecting, without waiting: the connection completes
+   *  when the Bluetooth socket is connected, or fails at the deadline.
+   *  The GLib events must be dispatched in the meantime,
+   *  for instance by wait_connected() or g_main_loop_run().
+   *  The parameters are the ones of connect().
+   * \return false if the connection could not be started
+   */
+  bool start_connect(GMainLoop *main_loop, const char* device_name, const char* mip_mac,
+                     unsigned int timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS) {
+    if (_is_connected || _connect_state == CONNECTING)
+      return false;
+    _device_name = device_name;
+    _mip_mac = mip_mac;
+    if (!is_io_thread_running())
+      set_main_loop(main_loop);
+    return reconnect(timeout_ms);
+  }
+
+  /*! Start connecting again to the robot of start_connect(), with the same GLib context,
+   *  for instance after CONNECTION_LOST. Returns immediately, like start_connect().
+   *  Without I/O thread, must be called by the thread dispatching the GLib events.
+   *  The state of the robot is then restored, \see set_restore_on_reconnect().
+   * \return false if the connection could not be started
+   */
+  inline bool reconnect(unsigned int timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS) {
+    if (_is_connected || _connect_state == CONNECTING || _mip_mac.empty() || !_context)
+      return false;
+    _connect_timeout_ms = timeout_ms;
+    _connect_start_us = g_get_monotonic_time();
+    set_connect_state(CONNECTING);
+    if (is_io_thread_running()) {
+      // the GLib sources must be created by the I/O thread
+      g_main_context_invoke(_context, Mip::io_connect_cb, this);
+      return true;
+    }
+    return gatt_connect_start();
+  }
+
+  /*! wait until the connection started by start_connect() completes,
+   *  fails or is cancelled. Without I/O thread, dispatches the GLib events meanwhile.
+   * \return true if connected */
+  inline bool wait_connected() {
+    if (is_io_thread_running()) {
+      std::unique_lock<std::mutex> lock(_connect_mutex);
+      _connect_cv.wait(lock, [this] { return _connect_state != CONNECTING; });
+    }
+    else {
+      while (_connect_state == CONNECTING) // woken up by connect_cb() or the deadline
+        g_main_context_iteration(_context, TRUE);
+    }
+    return _connect_state == CONNECTED;
+  }
+
+  /*! cancel the connection started by start_connect(), if not completed yet.
+   *  Without I/O thread, must be called by the thread dispatching the GLib events. */
+  inline void cancel_connect() {
+    if (_connect_state != CONNECTING)
+      return;
+    if (is_io_thread_running())
+      g_main_context_invoke(_context, Mip::io_cancel_connect_cb, this);
+    else
+      finish_connect(CONNECT_CANCELLED);
+  }
+
+  //! \see ConnectState enum
+  inline int get_connect_state() const { return _connect_state; }
+
+  //! called by the thread dispatching the GLib events, each time the ConnectState changes
+  typedef std::function<void(Mip &, int)> ConnectCallback;
+  inline void set_connect_callback(const ConnectCallback & callback) {
+    std::lock_guard<std::mutex> lock(_connect_mutex);
+    _connect_callback = callback;
+  }
+  inline bool is_connected() const { return _is_connected; }
+  //! \return the time between start_connect() and the connection, in milliseconds
+  inline double get_connect_time_ms() const { return _connect_time_us / 1000.; }
+  //! \return the time between the last CONNECTION_LOST and the next connection, in milliseconds
+  inline double get_last_dropout_ms() const { return _dropout_us / 1000.; }
+  //! the Bluetooth device and robot MAC of start_connect()
+  inline const std::string & get_device_name() const { return _device_name; }
+  inline const std::string & get_mac() const { return _mip_mac; }
+
+  /*! open the ATT channel of the next connections with a function instead of Bluetooth,
+   *  for instance over a socketpair, \see MipSimulator. Empty to use Bluetooth again.
+   *  The function is called by the thread dispatching the GLib events,
+   *  the channel must be connected and carry one ATT PDU per read() */
+  typedef std::function<GIOChannel*(Mip &)> ChannelFactory;
+  inline void set_channel_factory(const ChannelFactory & factory) { _channel_factory = factory; }
+
+  /*! send again the state cached in this object: the chest and head LEDs,
+   *  the volume and the game mode, if they were set or received.
+   * \return true if the commands have been correctly sent to the robot */
+  inline bool restore_state() {
+    ChestLed chest_led;
+    HeadLed head_led;
+    unsigned int volume;
+    GameMode game_mode;
+    {
+      StateLock lock(_state_mutex);
+      chest_led = _chest_led_cached;
+      head_led = _head_led_cached;
+      volume = _volume_cached;
+      game_mode = _game_mode_cached;
+    }
+    bool ok = set_chest_LED(chest_led);
+    ok = set_head_LED(head_led) && ok;
+    if (volume != (unsigned int) ERROR)
+      ok = set_volume(volume) && ok;
+    if (game_mode != ERROR)
+      ok = set_game_mode(game_mode) && ok;
+    return ok;
+  }
+  //! call restore_state() after each reconnection, true by default
+  inline void set_restore_on_reconnect(bool restore) { _restore_on_reconnect = restore; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! log all the commands sent and notifications received, NULL to stop.
+   *  The recorder can be shared by several robots, told apart by source. */
+  inline void set_recorder(MipRecorder* recorder, uint32_t source = 0) {
+    _recorder_source = source;
+    _recorder = recorder;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
   //! \arg sound_idx Sound file index (1~106) - Send 105 to stop playing
   inline bool play_sound(uint sound_idx) {
-    DEBUG_PRINT("play_sound(%i)\n", sound_idx);
+    MIP_LOG_DEBUG("play_sound(%i)\n", sound_idx);
     // sudo gatttool -­i hci1 ­-b D0:39:72:B7:AF:66 --char­-write­ -a 0x0013 -n 0602
-    return send_order1(CMD_PLAY_SOUND, clamp(sound_idx, (uint) 1, (uint) 106));
+    return send_command<CMD_PLAY_SOUND>(clamp(sound_idx, (uint) 1, (uint) 106));
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -197,18 +499,28 @@ public:
   //! \arg distance_m in meters, no speed control
   inline bool distance_drive(double distance_m,
                              double angle_rad) {
+    uint8_t params[5];
+    distance_drive_params(distance_m, angle_rad, params);
+    return send_command<CMD_DISTANCE_DRIVE>(params[0], params[1], params[2], params[3], params[4]);
+  }
+
+  //! the parameters of CMD_DISTANCE_DRIVE, \see distance_drive()
+  static void distance_drive_params(double distance_m, double angle_rad, uint8_t params[5]) {
     bool backward = (distance_m < 0);
     int angle_deg = rad2deg_norm(angle_rad, -360, 360);
     bool ccw = (angle_deg < 0);
     int distance_cm = clamp((int) fabs(distance_m*100.), 0, 255);
-    DEBUG_PRINT("distance_cm:%i, angle_deg:%i\n", distance_cm, angle_deg);
+    MIP_LOG_DEBUG("distance_cm:%i, angle_deg:%i\n", distance_cm, angle_deg);
     // BYTE 1 : Forward: 0X00 or Backward: 0X01
     // BYTE 2 : Distance (cm): 0x00­0xFF
     // BYTE 3 : Turn Clockwise: 0X00 or Anti­-clockwise: 0X01
     // BYTE 4 : Turn Angle(High byte): 0x00~0x01
     // BYTE 5 : Turn Angle(Low byte): 0x00~0xFF
-    return send_order5(CMD_DISTANCE_DRIVE, backward, distance_cm,
-                       ccw, abs(angle_deg)/256, abs(angle_deg)%256);
+    params[0] = backward;
+    params[1] = distance_cm;
+    params[2] = ccw;
+    params[3] = abs(angle_deg)/256;
+    params[4] = abs(angle_deg)%256;
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -218,10 +530,8 @@ public:
   inline bool time_drive(int speed, double time_s) {
     int time_7ms = clamp((int) (time_s * 1000/7), 0, 255);
     if (speed > 0)
-      return send_order2(CMD_DRIVE_FORWARD_WITH_TIME,
-                         clamp(speed, 0, 30), time_7ms);
-    return send_order2(CMD_DRIVE_BACKWARD_WITH_TIME,
-                       clamp(-speed, 0, 30), time_7ms);
+      return send_command<CMD_DRIVE_FORWARD_WITH_TIME>(clamp(speed, 0, 30), time_7ms);
+    return send_command<CMD_DRIVE_BACKWARD_WITH_TIME>(clamp(-speed, 0, 30), time_7ms);
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -234,21 +544,23 @@ public:
     // BYTE 1 : Angle in intervals of 5 degrees (0~255) - Angle = Byte1 Value * 5
     int angle_deg = rad2deg_norm(angle_rad, -1275, 1275);
     int speed_clamp = clamp((int) fabs(speed), 0, 24);
-    return send_order2(
-          (angle_deg < 0 ? 0x73: 0x74), // CCW : CW,
-          fabs(angle_deg/5),
-          speed_clamp);
+    if (angle_deg < 0) // CCW
+      return send_command<CMD_TURN_LEFT_BY_ANGLE>(fabs(angle_deg/5), speed_clamp);
+    return send_command<CMD_TURN_RIGHT_BY_ANGLE>(fabs(angle_deg/5), speed_clamp); // CW
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
   /*!
+   *  With force_decelerating, if |v_ticks| decreases since the last call,
+   *  a command with v_ticks reversed is sent first, otherwise if |w_ticks|
+   *  decreases, a command with w_ticks reversed.
    *  \arg v_ticks in 1~64 (-64~1 to go backwards)
    *  \arg w_ticks in 0~64 to turn CCW (-64~0 to turn CW)
   */
   inline bool continuous_drive(int v_ticks, int w_ticks,
                                bool force_decelerating = true) {
-    printf("continuous_drive(%i, %i)\n", v_ticks, w_ticks);
+    MIP_LOG_DEBUG("continuous_drive(%i, %i)\n", v_ticks, w_ticks);
     if (force_decelerating
         && fabs(v_ticks) < fabs(_last_v_ticks))// force decelerating
       continuous_drive(-v_ticks, w_ticks, false);
@@ -257,8 +569,14 @@ public:
       continuous_drive(v_ticks, -w_ticks, false);
     _last_v_ticks = v_ticks;
     _last_w_ticks = w_ticks;
+    uint8_t param1, param2;
+    continuous_drive_params(v_ticks, w_ticks, param1, param2);
+    return send_command<CMD_CONTINUOUS_DRIVE>(param1, param2);
+  }
 
-    int param1, param2;
+  //! the parameters of CMD_CONTINUOUS_DRIVE, \see continuous_drive()
+  static void continuous_drive_params(int v_ticks, int w_ticks,
+                                      uint8_t & param1, uint8_t & param2) {
     v_ticks = clamp(v_ticks, -64, 64);
     if (v_ticks > 32) // 33 ~ 64 => crazy Fw:0x81(slow)~­0xA0(fast) = 129 ~ 160
       param1 = 96 + v_ticks;
@@ -280,7 +598,20 @@ public:
       param2 = 64 - w_ticks;
     else  // -33 -> -64 => crazy right spin:0xC1(slow)~0xE0(fast) = 193 ~ 224
       param2 = 160 - w_ticks;
-    return send_order2(CMD_CONTINUOUS_DRIVE, param1, param2);
+  }
+
+  //! the inverse of continuous_drive_params()
+  static void continuous_drive_ticks(uint8_t param1, uint8_t param2,
+                                     int & v_ticks, int & w_ticks) {
+    if (param1 <= 32)        v_ticks = param1;        // forward
+    else if (param1 <= 64)   v_ticks = 32 - param1;   // backward
+    else if (param1 <= 160)  v_ticks = param1 - 96;   // crazy forward
+    else                     v_ticks = 128 - param1;  // crazy backward
+    if (param2 == 0)         w_ticks = 0;
+    else if (param2 <= 96)   w_ticks = 64 - param2;   // right spin
+    else if (param2 <= 128)  w_ticks = param2 - 96;   // left spin
+    else if (param2 <= 224)  w_ticks = 160 - param2;  // crazy right spin
+    else                     w_ticks = param2 - 192;  // crazy left spin
   }
 
   /*!
@@ -304,10 +635,18 @@ public:
                           int & v_ticks, int & w_ticks) {
     double v_clamped = v_ms, w_clamped = w_rads;
     if (fabs(v_ms) > .95 || fabs(w_rads) > 17) {
-        printf("(v:%g, w:%g) out of bounds, clipping!\n", v_clamped, w_clamped);
+        MIP_LOG_WARN("(v:%g, w:%g) out of bounds, clipping!\n", v_clamped, w_clamped);
         v_clamped = clamp(v_ms, -.95, .95);
         w_clamped = clamp(w_rads, -17., 17.);
       }
+    clamped_speed2ticks(v_clamped, w_clamped, v_ticks, w_ticks);
+    MIP_LOG_DEBUG("speed2ticks(%g, %g) -> (%i, %i)\n", v_clamped, w_clamped, v_ticks, w_ticks);
+    return true;
+  } // end speed2ticks
+
+  //! the regressions of speed2ticks(), for speeds within bounds, shared with the batch version
+  static inline void clamped_speed2ticks(const double & v_clamped, const double & w_clamped,
+                                         int & v_ticks, int & w_ticks) {
     // first case: linear speed only
     if (fabs(w_clamped) < 0.05) {
         w_ticks = 0;
@@ -355,9 +694,7 @@ public:
         w_ticks += 32 * signum(w_ticks);
       }
 
-    printf("speed2ticks(%g, %g) -> (%i, %i)\n", v_clamped, w_clamped, v_ticks, w_ticks);
-    return true;
-  } // end speed2ticks
+  } // end clamped_speed2ticks
 
   //////////////////////////////////////////////////////////////////////////////
 
@@ -366,26 +703,87 @@ public:
     // v in [-32, 32]: v = 0,0217453422621 * b1
     if (abs(v_ticks) <= 32)
       v_ms = 0.0217453422621 * v_ticks;
-    else // v in [-64, 64]: v = 0,0290682838088 * b1
-      v_ms = 0.0290682838088 * (v_ticks + 32 * signum<int>(v_ticks));
+    else // v in [-64, 64]: v = 0,0290682838088 * b1, b1 the crazy ticks beyond 32
+      v_ms = 0.0290682838088 * (v_ticks - 32 * signum<int>(v_ticks));
     // w in [-32, 32]: w = 0,4177416860037 * b2 - 0,6876060987078
     if (abs(w_ticks) <= 32)
       w_rads = 0.4177416860037 * w_ticks - .6876060987078;
-    else // w in [-64, 64]: W = 0,7208400618386 * b2 + 0,0191642762841
-      w_rads = 0.7208400618386 * (w_ticks + 32 * signum(w_ticks)) + .0191642762841;
+    else // w in [-64, 64]: W = 0,7208400618386 * b2 + 0,0191642762841, idem
+      w_rads = 0.7208400618386 * (w_ticks - 32 * signum(w_ticks)) + .0191642762841;
     return true;
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
+  /*! the batch version of speed2ticks(), for arrays of n samples,
+   *  with the same results: the regressions are shared.
+   *  The samples out of bounds are clipped, and logged once per call. */
+  static bool speed2ticks(const double *v_ms, const double *w_rads, unsigned int n,
+                          int *v_ticks, int *w_ticks) {
+    unsigned int nclipped = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+      double v = v_ms[i], w = w_rads[i];
+      if (fabs(v) > .95 || fabs(w) > 17) {
+        ++nclipped;
+        v = clamp(v, -.95, .95);
+        w = clamp(w, -17., 17.);
+      }
+      clamped_speed2ticks(v, w, v_ticks[i], w_ticks[i]);
+    }
+    if (nclipped)
+      MIP_LOG_WARN("speed2ticks(): %u samples out of bounds, clipping!\n", nclipped);
+    return true;
+  }
+
+  //! the batch version of ticks2speeds(), for arrays of n samples, with the same results
+  static bool ticks2speeds(const int *v_ticks, const int *w_ticks, unsigned int n,
+                           double *v_ms, double *w_rads) {
+    const SpeedTables & tables = speed_tables();
+    for (unsigned int i = 0; i < n; ++i) {
+      unsigned int v_idx = v_ticks[i] + SpeedTables::MAX_TICKS,
+          w_idx = w_ticks[i] + SpeedTables::MAX_TICKS;
+      if (v_idx < SpeedTables::NTICKS && w_idx < SpeedTables::NTICKS) {
+        v_ms[i] = tables.v_ms[v_idx];
+        w_rads[i] = tables.w_rads[w_idx];
+      }
+      else // out of the tables, never sent by continuous_drive()
+        ticks2speeds(v_ticks[i], w_ticks[i], v_ms[i], w_rads[i]);
+    }
+    return true;
+  }
+
+  //! the results of ticks2speeds() for all the ticks of continuous_drive()
+  struct SpeedTables {
+    static const int MAX_TICKS = 64;
+    static const unsigned int NTICKS = 2 * MAX_TICKS + 1;
+    //! indexed by ticks + MAX_TICKS
+    double v_ms[NTICKS], w_rads[NTICKS];
+    SpeedTables() {
+      for (int t = -MAX_TICKS; t <= MAX_TICKS; ++t)
+        ticks2speeds(t, t, v_ms[t + MAX_TICKS], w_rads[t + MAX_TICKS]);
+    }
+  }; // end struct SpeedTables
+
+  //! built at the first call
+  static const SpeedTables & speed_tables() {
+    static const SpeedTables tables;
+    return tables;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
   //! \see GameMode enum
   inline bool set_game_mode(const GameMode & mode) {
-    return send_order1(0x82, mode);
+    {
+      StateLock lock(_state_mutex);
+      _game_mode_cached = mode;
+    }
+    return send_command<CMD_SET_GAME_MODE>(mode);
   }
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_game_mode() { return send_order0(0x82); }
+  inline bool request_game_mode() { return send_command<CMD_GET_CURRENT_MIP_GAME_MODE>(); }
   //! \see GameMode enum
-  inline GameMode get_game_mode() { return _game_mode; }
+  inline GameMode get_game_mode() { StateLock lock(_state_mutex); return _game_mode; }
   //! \see GameMode enum
   inline const char* get_game_mode2str() {
     return game_mode2str(get_game_mode());
@@ -394,14 +792,14 @@ public:
   //////////////////////////////////////////////////////////////////////////////
 
   //! stop the robot motion
-  inline bool stop() { return send_order0(0x77); }
+  inline bool stop() { return send_command<CMD_STOP>(); }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_battery_voltage() { return send_order0(CMD_MIP_STATUS); }
+  inline bool request_battery_voltage() { return send_command<CMD_REQUEST_MIP_STATUS>(); }
   //! between 4.0V and 6.4V, or < 0 if error
-  inline double get_battery_voltage() { return _battery_voltage; }
+  inline double get_battery_voltage() { StateLock lock(_state_mutex); return _battery_voltage; }
   //! in 0~100, or < 0 if error
   inline int get_battery_percentage() {
     double voltage = get_battery_voltage();
@@ -411,9 +809,9 @@ public:
   //////////////////////////////////////////////////////////////////////////////
 
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_status() { return send_order0(CMD_MIP_STATUS); }
+  inline bool request_status() { return send_command<CMD_REQUEST_MIP_STATUS>(); }
   //! \see Status enum
-  inline Status get_status() { return _status; }
+  inline Status get_status() { StateLock lock(_state_mutex); return _status; }
   //! \see Status enum
   inline const char* get_status2str() {
     return status2str(get_status());
@@ -422,45 +820,44 @@ public:
   //////////////////////////////////////////////////////////////////////////////
 
   //! this command is not really clear...
-  inline bool up() { return send_order1(0x23, 2); }
+  inline bool up() { return send_command<CMD_MIP_GET_UP>(2); }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_weight_update() { return send_order0(0x81); }
+  inline bool request_weight_update() { return send_command<CMD_REQUEST_WEIGHT_UPDATE>(); }
   //! \return angle with vertical, in [-45, 45], or -1 if ERROR.
-  inline int get_weight_update() { return _weight; }
+  inline int get_weight_update() { StateLock lock(_state_mutex); return _weight; }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! r,g,b in [0, 255]
   inline bool set_chest_LED(const int & r, const int & g, const int & b) {
-    _chest_led_cached.r = clamp(r, 0, 255);
-    _chest_led_cached.g = clamp(g, 0, 255);
-    _chest_led_cached.b = clamp(b, 0, 255);
-    _chest_led_cached.time_flash_on_sec = 0;
-    _chest_led_cached.time_flash_off_sec = 0;
-    return send_order3(CMD_SET_CHEST_LED,
-                       _chest_led_cached.r,
-                       _chest_led_cached.g,
-                       _chest_led_cached.b);
+    ChestLed l;
+    l.r = clamp(r, 0, 255);
+    l.g = clamp(g, 0, 255);
+    l.b = clamp(b, 0, 255);
+    l.time_flash_on_sec = 0;
+    l.time_flash_off_sec = 0;
+    set_chest_LED_cached(l);
+    return send_command<CMD_SET_CHEST_LED>(l.r, l.g, l.b);
   }
   //! r,g,b in [0, 255],
   inline bool set_chest_LED(const int & r, const int & g, const int & b,
                             const double & time_flash_on_sec,
                             const double & time_flash_off_sec) {
-    _chest_led_cached.r = clamp(r, 0, 255);
-    _chest_led_cached.g = clamp(g, 0, 255);
-    _chest_led_cached.b = clamp(b, 0, 255);
-    _chest_led_cached.time_flash_on_sec = clamp( (int) (time_flash_on_sec * 50), 1, 255);
-    _chest_led_cached.time_flash_off_sec = clamp( (int) (time_flash_off_sec * 50), 1, 255);
-    // TIME ON in 10ms intervals
-    return send_order5(CMD_FLASH_CHEST_LED,
-                       _chest_led_cached.r,
-                       _chest_led_cached.g,
-                       _chest_led_cached.b,
-                       _chest_led_cached.time_flash_on_sec,
-                       _chest_led_cached.time_flash_off_sec);
+    ChestLed l;
+    l.r = clamp(r, 0, 255);
+    l.g = clamp(g, 0, 255);
+    l.b = clamp(b, 0, 255);
+    // TIME ON and OFF in 20ms intervals, rounded as the seconds are not exact
+    int time_on = clamp( (int) lround(time_flash_on_sec * 50), 1, 255),
+        time_off = clamp( (int) lround(time_flash_off_sec * 50), 1, 255);
+    // cached in seconds, as store_chest_LED(), for restore_state()
+    l.time_flash_on_sec = time_on / 50.;
+    l.time_flash_off_sec = time_off / 50.;
+    set_chest_LED_cached(l);
+    return send_command<CMD_FLASH_CHEST_LED>(l.r, l.g, l.b, time_on, time_off);
   }
   inline bool set_chest_LED(const ChestLed & l) {
     if (l.time_flash_on_sec > 0 && l.time_flash_off_sec > 0)
@@ -468,36 +865,36 @@ public:
     return set_chest_LED(l.r, l.g, l.b);
   }
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_chest_LED() { return send_order0(0x83); }
+  inline bool request_chest_LED() { return send_command<CMD_REQUEST_CHEST_LED>(); }
   //! \return r,g,b in [0, 255]
-  inline ChestLed get_chest_LED() { return _chest_led; }
-  inline ChestLed get_chest_LED_cached() { return _chest_led_cached; }
+  inline ChestLed get_chest_LED() { StateLock lock(_state_mutex); return _chest_led; }
+  inline ChestLed get_chest_LED_cached() { StateLock lock(_state_mutex); return _chest_led_cached; }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! \param HeadLed l: for each of the four leds, 0=off,1=on,2=blink_slow,3=blink_fast
   inline bool set_head_LED(const unsigned int l1, const unsigned int l2,
                            const unsigned int l3, const unsigned int l4) {
-    _head_led_cached.l1 = clamp(l1, (uint) 0, (uint) 3);
-    _head_led_cached.l2 = clamp(l2, (uint) 0, (uint) 3);
-    _head_led_cached.l3 = clamp(l3, (uint) 0, (uint) 3);
-    _head_led_cached.l4 = clamp(l4, (uint) 0, (uint) 3);
-    return send_order4(CMD_SET_HEAD_LED,
-                       _head_led_cached.l1, _head_led_cached.l2,
-                       _head_led_cached.l3, _head_led_cached.l4);
+    HeadLed l;
+    l.l1 = clamp(l1, (uint) 0, (uint) 3);
+    l.l2 = clamp(l2, (uint) 0, (uint) 3);
+    l.l3 = clamp(l3, (uint) 0, (uint) 3);
+    l.l4 = clamp(l4, (uint) 0, (uint) 3);
+    {
+      StateLock lock(_state_mutex);
+      _head_led_cached = l;
+    }
+    return send_command<CMD_SET_HEAD_LED>(l.l1, l.l2, l.l3, l.l4);
   }
   //! \param HeadLed l: for each of the four leds, 0=off,1=on,2=blink_slow,3=blink_fast
   inline bool set_head_LED(const unsigned int idx,
                            const unsigned int value) {
+    HeadLed c = get_head_LED_cached();
     switch (idx) {
-      case 1:   return set_head_LED(value, _head_led_cached.l2,
-                                    _head_led_cached.l3, _head_led_cached.l4);
-      case 2:   return set_head_LED(_head_led_cached.l1, value,
-                                    _head_led_cached.l3, _head_led_cached.l4);
-      case 3:   return set_head_LED(_head_led_cached.l1, _head_led_cached.l2,
-                                    value, _head_led_cached.l4);
-      case 4:   return set_head_LED(_head_led_cached.l1, _head_led_cached.l2,
-                                    _head_led_cached.l3, value);
+      case 1:   return set_head_LED(value, c.l2, c.l3, c.l4);
+      case 2:   return set_head_LED(c.l1, value, c.l3, c.l4);
+      case 3:   return set_head_LED(c.l1, c.l2, value, c.l4);
+      case 4:   return set_head_LED(c.l1, c.l2, c.l3, value);
       default:  return false;
       }
   }
@@ -505,22 +902,32 @@ public:
     return set_head_LED(l.l1, l.l2, l.l3, l.l4);
   }
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_head_LED() { return send_order0(CMD_HEAD_LED); }
+  inline bool request_head_LED() { return send_command<CMD_REQUEST_HEAD_LED>(); }
   //! \return HeadLed l: for each of the four leds, 0=off,1=on,2=blink_slow,3=blink_fast
-  inline HeadLed get_head_LED() { return _head_led; }
-  inline HeadLed get_head_LED_cached() { return _head_led_cached; }
+  inline HeadLed get_head_LED() { StateLock lock(_state_mutex); return _head_led; }
+  inline HeadLed get_head_LED_cached() { StateLock lock(_state_mutex); return _head_led_cached; }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_odometer_reading() { return send_order0(CMD_ODOMETER_READING); }
+  inline bool request_odometer_reading() { return send_command<CMD_READ_ODOMETER>(); }
   //! \return odometry in meters
-  inline double get_odometer_reading() { return _odometer_reading_m; }
+  inline double get_odometer_reading() { StateLock lock(_state_mutex); return _odometer_reading_m; }
+
+  /*! the pose estimated at this instant by dead reckoning: the motion commands sent,
+   *  corrected by the odometer readings, \see set_polling(CMD_READ_ODOMETER, ...).
+   *  Lock-free, can be called by any thread at any rate. \see MipPoseEstimator */
+  inline MipPose get_pose() const { return _pose_estimator.get_pose(); }
+  //! set the estimated pose, for instance to (0, 0, 0) before a mission
+  inline void reset_pose(double x = 0, double y = 0, double theta = 0) {
+    _pose_estimator.reset(x, y, theta);
+  }
+  inline const MipPoseEstimator & get_pose_estimator() const { return _pose_estimator; }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! \return last gesture detected - \see Gesture enum
-  inline Gesture get_gesture_detect() { return _gesture_detect; }
+  inline Gesture get_gesture_detect() { StateLock lock(_state_mutex); return _gesture_detect; }
   //! \return last gesture detected - \see Gesture enum
   inline const char* get_gesture_detect2str() {
     return gesture2str(get_gesture_detect());
@@ -530,14 +937,15 @@ public:
 
   //! \see GestureOrRadarMode enum
   inline bool set_gesture_or_radar_mode(GestureOrRadarMode mode) {
-    return send_order1(CMD_SET_GESTURE_OR_RADAR_MODE, mode);
+    return send_command<CMD_SET_GESTURE_OR_RADAR_MODE>(mode);
   }
   //! \return true if the request has been correctly sent to the robot
   inline bool request_gesture_or_radar_mode() {
-    return send_order0(CMD_RADAR_MODE_STATUS);
+    return send_command<CMD_GET_RADAR_MODE>();
   }
   //! \see GestureOrRadarMode enum
   inline GestureOrRadarMode get_gesture_or_radar_mode() {
+    StateLock lock(_state_mutex);
     return _gesture_or_radar_mode;
   }
   //! \see GestureOrRadarMode enum
@@ -548,7 +956,7 @@ public:
   //////////////////////////////////////////////////////////////////////////////
 
   //! \see RadarResponse enum
-  inline RadarResponse get_radar_response() { return _radar_response; }
+  inline RadarResponse get_radar_response() { StateLock lock(_state_mutex); return _radar_response; }
   //! \see GestureOrRadarMode enum
   inline const char* get_radar_response2str() {
     return radar_response2str(get_radar_response());
@@ -558,41 +966,390 @@ public:
 
   //! \return true if the request has been correctly sent to the robot
   inline bool request_software_version() {
-    return send_order0(CMD_MIP_SOFTWARE_VERSION);
+    return send_command<CMD_GET_MIP_SOFTWARE_VERSION>();
   }
   //! \return "YYYY/MM/DD-NN" where NN is the day's number version
-  inline std::string get_software_version() { return _software_version; }
+  inline std::string get_software_version() { StateLock lock(_state_mutex); return _software_version; }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! \return true if the request has been correctly sent to the robot
   inline bool request_hardware_version() {
-    return send_order0(CMD_MIP_HARDWARE_INFO);
+    return send_command<CMD_GET_MIP_HARDWARE_INFO>();
   }
   //! \return "VV-HH", where VV is the voice chip version and HH is the hardware version
-  inline std::string get_hardware_version() { return _hardware_version; }
+  inline std::string get_hardware_version() { StateLock lock(_state_mutex); return _hardware_version; }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! \arg vol (0~7)
   inline bool set_volume(uint vol) {
-    //return send_order1(CMD_MIP_VOLUME, 247 + clamp(vol, (uint) 0, (uint) 7) ); // 0xF7­~0xFE for volume
-    return send_order1(CMD_SET_MIP_VOLUME, clamp(vol, (uint) 0, (uint) 7) ); // 0xF7­~0xFE for volume
+    {
+      StateLock lock(_state_mutex);
+      _volume_cached = clamp(vol, (uint) 0, (uint) 7);
+    }
+    //return send_command<CMD_SET_MIP_VOLUME>(247 + clamp(vol, (uint) 0, (uint) 7) ); // 0xF7­~0xFE for volume
+    return send_command<CMD_SET_MIP_VOLUME>(clamp(vol, (uint) 0, (uint) 7) );
   }
   //! \return true if the request has been correctly sent to the robot
-  inline bool request_volume() { return send_order0(CMD_GET_MIP_VOLUME); }
+  inline bool request_volume() { return send_command<CMD_GET_MIP_VOLUME>(); }
   //! \return volume in 0-7
-  inline unsigned int get_volume() { return _volume; }
+  inline unsigned int get_volume() { StateLock lock(_state_mutex); return _volume; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! send a command with no parameter, for instance request<CMD_REQUEST_CLAP_ENABLED>(),
+   *  useful for the commands of MIP_COMMAND_TABLE with no dedicated function.
+   * \return true if the request has been correctly sent to the robot */
+  template<MipCommand CMD>
+  inline bool request() {
+    static_assert(mip_command_info(CMD).response_len != MIP_NO_PAYLOAD,
+                  "this command has no answer");
+    return send_command<CMD>();
+  }
+  //! \return the last answer received for a command, with cmd = ERROR if none yet
+  inline MipNotification get_last_response(MipCommand cmd) {
+    StateLock lock(_state_mutex);
+    return _last_responses[(unsigned int) cmd < 256 ? cmd : 0];
+  }
+  //! \return the physical value of the main field of the last answer, ERROR if none yet
+  inline double get_last_response_value(MipCommand cmd) {
+    MipNotification notif = get_last_response(cmd);
+    const MipCommandInfo & info = mip_command_info(cmd);
+    if (notif.cmd == ERROR || info.field_bytes == 0)
+      return ERROR;
+    return info.field_value(notif);
+  }
+  //! \return the age of the last answer received for a command, in milliseconds, ERROR if none yet
+  inline double get_last_response_age_ms(MipCommand cmd) {
+    gint64 last_us;
+    {
+      StateLock lock(_state_mutex);
+      last_us = _last_response_us[(unsigned int) cmd < 256 ? cmd : 0];
+    }
+    return (last_us ? (g_get_monotonic_time() - last_us) / 1000. : ERROR);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! send a PDU built beforehand, for instance by MipTrajectory:
+   *  the command number then its parameters, \see MIP_COMMAND_TABLE.
+   * \return true if the command has been correctly sent to the robot */
+  inline bool send_pdu(const uint8_t *value, unsigned int vlen) {
+    uint8_t value_arr[ATT_DEFAULT_LE_MTU - 3];
+    if (vlen == 0 || vlen > sizeof(value_arr))
+      return false;
+    memcpy(value_arr, value, vlen);
+    return send_order(value_arr, vlen);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the shortest max_age_ms of set_polling(), not to flood the firmware of the robot
+  static const unsigned int MIN_POLLING_AGE_MS = 100;
+  //! the polling is postponed while more commands than this wait to be written
+  static const unsigned int POLLING_BUSY_QUEUE = 2;
+  static const unsigned int MAX_POLLING_BACKOFF_MS = 500;
+
+  /*! Keep the answer of a request fresh, in the background:
+   *  the request is sent again when its last answer gets older than max_age_ms,
+   *  minus the typical response latency. Any answer counts,
+   *  including the ones of the requests sent by the application itself.
+   *  Only the requests without parameter can be polled, for instance
+   *  CMD_REQUEST_MIP_STATUS for the battery voltage and the status,
+   *  CMD_REQUEST_WEIGHT_UPDATE, CMD_READ_ODOMETER, CMD_REQUEST_CHEST_LED.
+   *  The requests due at the same time are sent in a single burst,
+   *  and the sensors due soon after join it.
+   *  The polling is postponed while the link is busy.
+   *  The requests are sent by the GLib context of the robot:
+   *  without I/O thread, they need pump_up_callbacks() or a running main loop.
+   *  Can be called by any thread, before or after connect().
+   * \arg max_age_ms 0 to stop polling this request
+   * \return false if the command cannot be polled */
+  inline bool set_polling(MipCommand cmd, unsigned int max_age_ms) {
+    const MipCommandInfo & info = mip_command_info(cmd);
+    if (info.opcode == ERROR || info.request_len != 0 || info.response_len == MIP_NO_PAYLOAD)
+      return false;
+    std::lock_guard<std::mutex> lock(_polling_mutex);
+    std::vector<PolledRequest>::iterator it = _polled_requests.begin();
+    while (it != _polled_requests.end() && it->cmd != cmd)
+      ++it;
+    if (max_age_ms == 0) {
+      if (it != _polled_requests.end())
+        _polled_requests.erase(it);
+      if (_polled_requests.empty())
+        arm_polling(-1);
+      return true;
+    }
+    if (it == _polled_requests.end()) {
+      PolledRequest req;
+      req.cmd = cmd;
+      req.sent_us = 0;
+      it = _polled_requests.insert(_polled_requests.end(), req);
+    }
+    it->max_age_us = std::max(max_age_ms, (unsigned int) MIN_POLLING_AGE_MS) * 1000LL;
+    arm_polling(0);
+    return true;
+  }
+  //! stop polling all the requests
+  inline void stop_polling() {
+    std::lock_guard<std::mutex> lock(_polling_mutex);
+    _polled_requests.clear();
+    arm_polling(-1);
+  }
+
+  //! the counters of the background polling, \see set_polling()
+  struct PollingStats {
+    //! the requests sent, in how many bursts
+    unsigned long requests, bursts;
+    //! the times the polling was postponed because the link was busy
+    unsigned long backoffs;
+  };
+  inline PollingStats get_polling_stats() const {
+    PollingStats stats;
+    stats.requests = _npolling_requests;
+    stats.bursts = _npolling_bursts;
+    stats.backoffs = _npolling_backoffs;
+    return stats;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the default deadline of the request_*_async() functions
+  static const unsigned int DEFAULT_REQUEST_TIMEOUT_MS = 1000;
+
+  /*! Request-response functions: each one sends the request and returns a future,
+   *  that gets the value as soon as the matching answer is received,
+   *  or a MipTimeoutError if the robot did not answer before the deadline.
+   *  Without I/O thread, wait for them with wait_for_result(),
+   *  that dispatches the GLib events in the meantime.
+   * \example double v = mip.wait_for_result(mip.request_battery_voltage_async());
+   */
+  template<MipCommand CMD>
+  inline std::future<MipNotification> request_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD, MipNotification>
+        ([](const MipNotification & notif) { return notif; }, timeout_ms);
+  }
+  inline std::future<GameMode> request_game_mode_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_GET_CURRENT_MIP_GAME_MODE, GameMode>
+        ([this](const MipNotification &) { return get_game_mode(); }, timeout_ms);
+  }
+  inline std::future<double> request_battery_voltage_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_REQUEST_MIP_STATUS, double>
+        ([this](const MipNotification &) { return get_battery_voltage(); }, timeout_ms);
+  }
+  inline std::future<Status> request_status_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_REQUEST_MIP_STATUS, Status>
+        ([this](const MipNotification &) { return get_status(); }, timeout_ms);
+  }
+  inline std::future<int> request_weight_update_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_REQUEST_WEIGHT_UPDATE, int>
+        ([this](const MipNotification &) { return get_weight_update(); }, timeout_ms);
+  }
+  inline std::future<ChestLed> request_chest_LED_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_REQUEST_CHEST_LED, ChestLed>
+        ([this](const MipNotification &) { return get_chest_LED(); }, timeout_ms);
+  }
+  inline std::future<HeadLed> request_head_LED_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_REQUEST_HEAD_LED, HeadLed>
+        ([this](const MipNotification &) { return get_head_LED(); }, timeout_ms);
+  }
+  inline std::future<double> request_odometer_reading_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_READ_ODOMETER, double>
+        ([this](const MipNotification &) { return get_odometer_reading(); }, timeout_ms);
+  }
+  inline std::future<GestureOrRadarMode> request_gesture_or_radar_mode_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_GET_RADAR_MODE, GestureOrRadarMode>
+        ([this](const MipNotification &) { return get_gesture_or_radar_mode(); }, timeout_ms);
+  }
+  inline std::future<std::string> request_software_version_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_GET_MIP_SOFTWARE_VERSION, std::string>
+        ([this](const MipNotification &) { return get_software_version(); }, timeout_ms);
+  }
+  inline std::future<std::string> request_hardware_version_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_GET_MIP_HARDWARE_INFO, std::string>
+        ([this](const MipNotification &) { return get_hardware_version(); }, timeout_ms);
+  }
+  inline std::future<unsigned int> request_volume_async
+  (unsigned int timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS) {
+    return request_async_impl<CMD_GET_MIP_VOLUME, unsigned int>
+        ([this](const MipNotification &) { return get_volume(); }, timeout_ms);
+  }
+
+  /*! wait for the result of a request_*_async() function.
+   *  Without I/O thread, the GLib events are dispatched until it is ready.
+   *  Must not be called by the I/O thread itself.
+   * \return the value, or throws MipTimeoutError if the deadline passed
+   */
+  template<class T>
+  inline T wait_for_result(std::future<T> future) {
+    if (!is_io_thread_running()) { // nobody else dispatches the events
+      while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        g_main_context_iteration(_context, TRUE); // wakes up at the deadline at the latest
+    }
+    return future.get();
+  }
+
+  //! called with the answer, or NULL when the deadline passed
+  typedef std::function<void(const MipNotification *)> PendingCallback;
+
+  /*! call callback with the next notification of a command,
+   *  or NULL if none is received before the deadline.
+   *  All the callbacks waiting for the command get the same notification,
+   *  while each answer of request_with_callback() goes to the oldest request.
+   *  The callback is called in the thread dispatching the GLib events.
+   * \return the id of the pending request */
+  inline unsigned int expect_response(MipCommand cmd, unsigned int timeout_ms,
+                                      const PendingCallback & callback) {
+    return add_pending_request(cmd, timeout_ms, callback, true);
+  }
+  /*! send a request and call callback with its answer,
+   *  or NULL if it could not be sent or is not answered before the deadline.
+   * \return the id of the pending request */
+  template<MipCommand CMD>
+  inline unsigned int request_with_callback(unsigned int timeout_ms,
+                                            const PendingCallback & callback) {
+    // register before sending, the answer may come very fast from the I/O thread
+    unsigned int id = add_pending_request(CMD, timeout_ms, callback);
+    if (!request<CMD>()) // will never be answered
+      fail_pending_request(id);
+    return id;
+  }
+
+  //! \return the number of requests waiting for an answer
+  inline unsigned int get_pending_requests_count() {
+    std::lock_guard<std::mutex> lock(_pending_mutex);
+    return _pending_requests.size();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! Latest-wins mode for the setpoint commands (LATEST_WINS in MIP_COMMAND_TABLE),
+   *  such as continuous_drive(): at most one of them waits in the GATT queue,
+   *  a newer one overwrites in place the one that has not been sent yet.
+   *  When the radio stalls, the robot then gets the latest setpoint
+   *  instead of playing back seconds of stale motion.
+   */
+  inline void set_coalescing(bool coalescing) { _coalescing = coalescing; }
+  inline bool get_coalescing() const { return _coalescing; }
+  //! \return the number of latest-wins commands asked, sent or coalesced
+  inline unsigned int get_latest_wins_commands_count() const {
+    return _nlatest_wins_commands;
+  }
+  //! \return the number of latest-wins commands that overwrote a pending one
+  inline unsigned int get_coalesced_commands_count() const {
+    return _ncoalesced_commands;
+  }
+
+  /*! \return true if the statistics of the GAttrib command pool could be read.
+   *  hits: commands served by the preallocated slots,
+   *  misses: commands that fell back to the heap. */
+  inline bool get_command_pool_stats(unsigned int & hits, unsigned int & misses) {
+    return _is_connected && g_attrib_get_pool_stats(_attrib, &hits, &misses);
+  }
+
+  /*! set how many queued commands are written each time the link is writable,
+   *  instead of one per call to pump_up_callbacks().
+   *  Can be called before connect(). 0 keeps the GAttrib default. */
+  inline bool set_write_budget(unsigned int budget) {
+    _write_budget = budget;
+    if (!_is_connected || budget == 0)
+      return true;
+    return g_attrib_set_write_budget(_attrib, budget);
+  }
+  /*! \return true if the statistics of the GAttrib sender could be read.
+   *  wakeups: times the link became writable, pdus: PDUs written then.
+   *  pdus / wakeups is the average batch size. */
+  inline bool get_write_stats(unsigned int & wakeups, unsigned int & pdus) {
+    return _is_connected && g_attrib_get_write_stats(_attrib, &wakeups, &pdus);
+  }
+
+  //! the counters of the traffic with the robot, since its creation
+  struct TrafficStats {
+    //! the orders given to GAttrib, and the notifications received
+    unsigned long commands, notifications;
+    //! the orders never given to GAttrib: not connected, or I/O queue full
+    unsigned long dropped_commands;
+    //! the requests answered, \see request_async()
+    unsigned long responses;
+    //! the time between a request and its answer
+    double latency_mean_ms, latency_max_ms;
+  };
+  inline TrafficStats get_traffic_stats() {
+    TrafficStats stats;
+    stats.commands = _ncommands_sent;
+    stats.notifications = _nnotifications;
+    stats.dropped_commands = _ncommands_dropped;
+    std::lock_guard<std::mutex> lock(_pending_mutex);
+    stats.responses = _nresponses;
+    stats.latency_mean_ms = (_nresponses ? _response_latency_sum_us / 1000. / _nresponses : 0);
+    stats.latency_max_ms = _response_latency_max_us / 1000.;
+    return stats;
+  }
+
+  /*! the latencies of each command, recorded in histograms by the thread
+   *  dispatching the GLib events. Each command is timestamped when given to send_order().
+   *  WRITE_LATENCY:    until it is written to the socket by GAttrib, for all commands
+   *  RESPONSE_LATENCY: until the notification with the same opcode reaches store_results(),
+   *                    for the requests, such as request_battery_voltage() */
+  enum LatencyType {
+    WRITE_LATENCY = 0,
+    RESPONSE_LATENCY = 1
+  };
+  struct LatencySnapshot {
+    MipCommand cmd;
+    unsigned long count;
+    double p50_ms, p99_ms, max_ms;
+  };
+  //! can be called by any thread, count = 0 if the command was never sent
+  inline LatencySnapshot get_latency(MipCommand cmd, LatencyType type = RESPONSE_LATENCY) const {
+    LatencySnapshot snap;
+    snap.cmd = cmd;
+    snap.count = 0;
+    snap.p50_ms = snap.p99_ms = snap.max_ms = 0;
+    const MipHistogram* histo = _latency_histograms[type][cmd & 0xFF];
+    if (histo) {
+      snap.count = histo->count();
+      snap.p50_ms = histo->percentile(50) / 1000.;
+      snap.p99_ms = histo->percentile(99) / 1000.;
+      snap.max_ms = histo->max() / 1000.;
+    }
+    return snap;
+  }
+  //! \return the latencies of all the commands sent so far
+  inline std::vector<LatencySnapshot> get_latencies(LatencyType type = RESPONSE_LATENCY) const {
+    std::vector<LatencySnapshot> ans;
+    for (unsigned int cmd = 0; cmd < 256; ++cmd) {
+      LatencySnapshot snap = get_latency(cmd, type);
+      if (snap.count)
+        ans.push_back(snap);
+    }
+    return ans;
+  }
 
   //////////////////////////////////////////////////////////////////////////////
 
   //! extend this function to add behaviours upon reception of a notification
-  virtual void notification_post_hook(MipCommand /*cmd*/, const std::vector<int> & /*values*/) {
+  virtual void notification_post_hook(MipCommand /*cmd*/, const MipNotification & /*notif*/) {
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! does nothing if the I/O thread is running, it dispatches the events itself
   inline bool pump_up_callbacks() {
+    if (is_io_thread_running())
+      return true;
     return g_main_context_iteration(_context, false);
   }
   inline bool pump_up_callbacks(unsigned int ntimes) {
@@ -608,98 +1365,557 @@ protected:
   //////////////////////////////////////////////////////////////////////////////
 
   //! store notification result in Mip class fields
-  inline void store_results(MipCommand cmd, const std::vector<int> & values) {
-    unsigned int nvalues = values.size();
-    if (cmd == CMD_GET_CURRENT_MIP_GAME_MODE && nvalues == 1)
-      _game_mode = values[0];
-    else if (cmd == CMD_MIP_STATUS && nvalues == 2) {
-        // 0x4D = 77 = 4.0V, 0x7C = 124 = 6.4V
-        _battery_voltage = 4.0 + (values[0]-77)*2.4/47;
-        _status = values[1];
-      }
-    else if (cmd == CMD_REQUEST_WEIGHT_UPDATE && nvalues == 1)
-      // 0xD3 = 211 = (-­45 degree) ~­ 0x2D = 45 = (+45 degree)
-      // 0xD3 = 211 (max) ~ 0xFF = 255 (min) is holding the weight on the front
-      // 0x00 = 0 (min) ~ 0x2D = 45 (max) is holding the weight on the back
-      // in other words:0 -> 0, 45 -> 45, 255 -> -1, 211 -> -45
-      _weight = (values[0] < 100 ? values[0] : values[0] - 256) + 5; // -5° when not moving
-    else if (cmd == CMD_CHEST_LED && nvalues == 5) {
-        _chest_led.r = values[0];
-        _chest_led.g = values[1];
-        _chest_led.b = values[2];
-        _chest_led.time_flash_on_sec = values[3] * 20E-3; // step of 50 ms
-        _chest_led.time_flash_off_sec = values[4] * 20E-3;
-        _chest_led_cached = _chest_led; // store cached value
+  inline void store_results(const MipNotification & notif) {
+    const MipCommandInfo & info = mip_command_info(notif.cmd);
+    if (info.opcode == ERROR) // unknown command -> return
+      return;
+    if (info.response_len != MIP_ANY_LENGTH
+        && info.response_len != (int) notif.nvalues) // wrong length -> return
+      return;
+    record_response_latency(info.opcode);
+    { // the getters may be called by other threads
+      StateLock lock(_state_mutex);
+      // O(1) dispatch, the table is built at compile time
+      NotificationHandler handler = notification_dispatch().handlers[info.opcode];
+      if (handler)
+        handler(*this, notif);
+      _last_responses[info.opcode] = notif;
+      _last_response_us[info.opcode] = g_get_monotonic_time();
+    }
+    complete_pending_request(notif);
+    notification_post_hook(notif.cmd, notif);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the functions storing a given response in the Mip class fields
+  typedef void (*NotificationHandler)(Mip &, const MipNotification &);
+  template<void (Mip::*Store)(const MipNotification &)>
+  inline static void call_store(Mip & mip, const MipNotification & notif) {
+    (mip.*Store)(notif);
+  }
+  struct NotificationDispatch {
+    NotificationHandler handlers[256];
+    constexpr NotificationDispatch() : handlers() {
+      handlers[CMD_CURRENT_MIP_GAME_MODE] = &call_store<&Mip::store_game_mode>;
+      handlers[CMD_MIP_STATUS] = &call_store<&Mip::store_status>;
+      handlers[CMD_WEIGHT_UPDATE] = &call_store<&Mip::store_weight_update>;
+      handlers[CMD_CHEST_LED] = &call_store<&Mip::store_chest_LED>;
+      handlers[CMD_HEAD_LED] = &call_store<&Mip::store_head_LED>;
+      handlers[CMD_ODOMETER_READING] = &call_store<&Mip::store_odometer_reading>;
+      handlers[CMD_GESTURE_DETECT] = &call_store<&Mip::store_gesture_detect>;
+      handlers[CMD_RADAR_MODE_STATUS] = &call_store<&Mip::store_gesture_or_radar_mode>;
+      handlers[CMD_RADAR_RESPONSE] = &call_store<&Mip::store_radar_response>;
+      handlers[CMD_SHAKE_DETECTED] = &call_store<&Mip::store_shake_detected>;
+      handlers[CMD_MIP_SOFTWARE_VERSION] = &call_store<&Mip::store_software_version>;
+      handlers[CMD_MIP_HARDWARE_INFO] = &call_store<&Mip::store_hardware_version>;
+      handlers[CMD_MIP_VOLUME] = &call_store<&Mip::store_volume>;
+    }
+  }; // end struct NotificationDispatch
+  inline static const NotificationDispatch & notification_dispatch();
+
+  inline void store_game_mode(const MipNotification & values) {
+    _game_mode = values[0];
+    _game_mode_cached = _game_mode; // store cached value
+  }
+  inline void store_status(const MipNotification & values) {
+    _battery_voltage = mip_command_info(CMD_MIP_STATUS).field_value(values);
+    _status = values[1];
+  }
+  inline void store_weight_update(const MipNotification & values) {
+    // 0xD3 = 211 = (-­45 degree) ~­ 0x2D = 45 = (+45 degree)
+    // 0xD3 = 211 (max) ~ 0xFF = 255 (min) is holding the weight on the front
+    // 0x00 = 0 (min) ~ 0x2D = 45 (max) is holding the weight on the back
+    // in other words:0 -> 0, 45 -> 45, 255 -> -1, 211 -> -45
+    _weight = (values[0] < 100 ? values[0] : values[0] - 256) + 5; // -5° when not moving
+  }
+  inline void store_chest_LED(const MipNotification & values) {
+    _chest_led.r = values[0];
+    _chest_led.g = values[1];
+    _chest_led.b = values[2];
+    _chest_led.time_flash_on_sec = values[3] * 20E-3; // step of 50 ms
+    _chest_led.time_flash_off_sec = values[4] * 20E-3;
+    _chest_led_cached = _chest_led; // store cached value
+  }
+  inline void store_head_LED(const MipNotification & values) {
+    _head_led.l1 = values[0];
+    _head_led.l2 = values[1];
+    _head_led.l3 = values[2];
+    _head_led.l4 = values[3];
+    _head_led_cached = _head_led; // store cached value
+  }
+  inline void store_odometer_reading(const MipNotification & values) {
+    // BYTE 1 & 2 & 3 & 4 : Distance, Byte1 is highest byte
+    // ((0~4294967296)/48.5) cm
+    // 0xFFFFFFFF=4294967295=88556026.7cm
+    _odometer_reading_m = mip_command_info(CMD_ODOMETER_READING).field_value(values);
+    _pose_estimator.odometer_update(_odometer_reading_m, g_get_monotonic_time());
+  }
+  inline void store_gesture_detect(const MipNotification & values) {
+    _gesture_detect = values[0];
+  }
+  inline void store_gesture_or_radar_mode(const MipNotification & values) {
+    _gesture_or_radar_mode = values[0];
+  }
+  inline void store_radar_response(const MipNotification & values) {
+    _radar_response = values[0];
+  }
+  inline void store_shake_detected(const MipNotification & values) {
+    _shake_detected = values[0];
+  }
+  inline void store_software_version(const MipNotification & values) {
+    char vstr[24]; // "20255/255/255-255" at worst
+    snprintf(vstr, sizeof(vstr), "20%02i/%02i/%02i-%02i",
+             values[0], values[1], values[2], values[3]); // year, month, day, version
+    _software_version = vstr;
+  }
+  inline void store_hardware_version(const MipNotification & values) {
+    char vstr[8];
+    snprintf(vstr, sizeof(vstr), "%02i-%02i", values[0], values[1]); // voice chip, hardware
+    _hardware_version = vstr;
+  }
+  inline void store_volume(const MipNotification & values) {
+    _volume = values[0];
+    _volume_cached = _volume; // store cached value
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! a request waiting for its answer, \see request_async()
+  struct PendingRequest {
+    unsigned int id;
+    MipCommand cmd;
+    //! expect_response(): every notification of cmd, not only the oldest request
+    bool listener;
+    //! the GLib timeout source of the deadline
+    GSource *timeout;
+    //! called with the answer, or NULL when the deadline passed
+    PendingCallback callback;
+    //! g_get_monotonic_time() when sent
+    gint64 start_us;
+  };
+  struct PendingTimeout {
+    Mip *mip;
+    unsigned int id;
+  };
+
+  //! send CMD and return a future, filled by convert(answer) or MipTimeoutError
+  template<MipCommand CMD, class T, class Convert>
+  inline std::future<T> request_async_impl(Convert convert, unsigned int timeout_ms) {
+    std::shared_ptr<std::promise<T> > promise = std::make_shared<std::promise<T> >();
+    std::future<T> future = promise->get_future();
+    request_with_callback<CMD>
+        (timeout_ms, [promise, convert](const MipNotification * notif) {
+      if (notif)
+        promise->set_value(convert(*notif));
+      else
+        promise->set_exception(std::make_exception_ptr(MipTimeoutError(CMD)));
+    });
+    return future;
+  }
+
+  //! register a request and its deadline in the GLib context
+  inline unsigned int add_pending_request(MipCommand cmd, unsigned int timeout_ms,
+                                          const PendingCallback & callback,
+                                          bool listener = false) {
+    PendingRequest req;
+    req.cmd = cmd;
+    req.listener = listener;
+    req.callback = callback;
+    req.start_us = g_get_monotonic_time();
+    req.timeout = g_timeout_source_new(timeout_ms);
+    PendingTimeout *data = new PendingTimeout;
+    data->mip = this;
+    g_source_set_callback(req.timeout, Mip::pending_timeout_cb, data,
+                          Mip::pending_timeout_free);
+    // attach with the lock held: the I/O thread cannot complete the request,
+    // nor fire its deadline, before the source is both listed and attached
+    std::lock_guard<std::mutex> lock(_pending_mutex);
+    req.id = data->id = ++_last_pending_id;
+    _pending_requests.push_back(req);
+    g_source_attach(req.timeout, _context);
+    return req.id;
+  }
+
+  //! answer the oldest request waiting for this notification, if any, and all the listeners
+  inline void complete_pending_request(const MipNotification & notif) {
+    std::vector<PendingRequest> reqs;
+    {
+      std::lock_guard<std::mutex> lock(_pending_mutex);
+      bool answered = false;
+      unsigned int nkept = 0;
+      for (unsigned int i = 0; i < _pending_requests.size(); ++i) {
+        const PendingRequest & req = _pending_requests[i];
+        if (req.cmd == notif.cmd && (req.listener || !answered)) {
+          answered = answered || !req.listener;
+          reqs.push_back(req);
+        }
+        else { // keep the others, in order
+          if (nkept != i)
+            _pending_requests[nkept] = req;
+          ++nkept;
+        }
       }
-    else if (cmd == CMD_HEAD_LED && nvalues == 4) {
-        _head_led.l1 = values[0];
-        _head_led.l2 = values[1];
-        _head_led.l3 = values[2];
-        _head_led.l4 = values[3];
-        _head_led_cached = _head_led; // store cached value
+      if (reqs.empty())
+        return;
+      _pending_requests.resize(nkept);
+      // one response per notification, however many waited for it
+      gint64 latency_us = g_get_monotonic_time() - reqs.front().start_us;
+      ++_nresponses;
+      _response_latency_sum_us += latency_us;
+      if (_response_latency_max_us < latency_us)
+        _response_latency_max_us = latency_us;
+    }
+    for (unsigned int i = 0; i < reqs.size(); ++i) {
+      g_source_destroy(reqs[i].timeout);
+      g_source_unref(reqs[i].timeout);
+    }
+    for (unsigned int i = 0; i < reqs.size(); ++i)
+      reqs[i].callback(&notif);
+  }
+
+  //! fail a request with MipTimeoutError, if it is still waiting
+  inline void fail_pending_request(unsigned int id) {
+    PendingRequest req;
+    {
+      std::lock_guard<std::mutex> lock(_pending_mutex);
+      std::vector<PendingRequest>::iterator it = _pending_requests.begin();
+      while (it != _pending_requests.end() && it->id != id)
+        ++it;
+      if (it == _pending_requests.end())
+        return;
+      req = *it;
+      _pending_requests.erase(it);
+    }
+    g_source_destroy(req.timeout);
+    g_source_unref(req.timeout);
+    req.callback(NULL);
+  }
+
+  //! fail all the waiting requests
+  inline void cancel_pending_requests() {
+    std::vector<unsigned int> ids;
+    {
+      std::lock_guard<std::mutex> lock(_pending_mutex);
+      for (unsigned int i = 0; i < _pending_requests.size(); ++i)
+        ids.push_back(_pending_requests[i].id);
+    }
+    for (unsigned int i = 0; i < ids.size(); ++i)
+      fail_pending_request(ids[i]);
+  }
+
+  //! the deadline of a request, in the GLib context
+  static gboolean pending_timeout_cb(gpointer user_data) {
+    PendingTimeout *data = (PendingTimeout*) user_data;
+    data->mip->fail_pending_request(data->id);
+    return FALSE;
+  }
+  static void pending_timeout_free(gpointer user_data) {
+    delete (PendingTimeout*) user_data;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! (re)schedule the polling in delay_ms, -1 to stop it, with _polling_mutex locked.
+   *  Before connect(), the context is not known yet: connect_cb() arms it */
+  inline void arm_polling(int delay_ms) {
+    if (_polling_source) {
+      g_source_destroy(_polling_source);
+      g_source_unref(_polling_source);
+      _polling_source = NULL;
+    }
+    if (delay_ms < 0 || !_context)
+      return;
+    _polling_source = g_timeout_source_new(delay_ms);
+    g_source_set_callback(_polling_source, Mip::polling_cb, this, NULL);
+    g_source_attach(_polling_source, _context);
+  }
+
+  static gboolean polling_cb(gpointer user_data) {
+    ((Mip*) user_data)->poll_requests();
+    return FALSE; // poll_requests() armed the next one
+  }
+
+  //! send the requests due, in the GLib context, and schedule the next burst
+  inline void poll_requests() {
+    std::vector<MipCommand> burst;
+    int next_ms = MAX_POLLING_BACKOFF_MS;
+    {
+      std::lock_guard<std::mutex> lock(_polling_mutex);
+      if (!_is_connected || !_attrib) { // check again later, until connect_cb()
+        arm_polling(next_ms);
+        return;
       }
-    else if (cmd == CMD_ODOMETER_READING && nvalues == 4) {
-        // BYTE 1 & 2 & 3 & 4 : Distance, Byte1 is highest byte
-        // ((0~4294967296)/48.5) cm
-        // 1 cm=48.5 units,
-        // 0xFFFFFFFF=4294967295=88556026.7cm
-        double value = values[3]
-            + 255 * values[2]
-            + 255 * 255 * values[1]
-            + 255 * 255 * 255 * values[0];
-        double dist_cm = value / 48.5;
-        _odometer_reading_m = dist_cm * .01;
+      if (_nqueued_pdus > (int) POLLING_BUSY_QUEUE) { // the link is busy, back off
+        _polling_backoff_ms = std::min(std::max(2 * _polling_backoff_ms, 10u),
+                                       (unsigned int) MAX_POLLING_BACKOFF_MS);
+        ++_npolling_backoffs;
+        arm_polling(_polling_backoff_ms);
+        return;
       }
-    else if (cmd == CMD_GESTURE_DETECT && nvalues == 1)
-      _gesture_detect = values[0];
-    else if (cmd == CMD_RADAR_MODE_STATUS && nvalues == 1)
-      _gesture_or_radar_mode = values[0];
-    else if (cmd == CMD_RADAR_RESPONSE && nvalues == 1)
-      _radar_response = values[0];
-    else if (cmd == CMD_SHAKE_DETECTED && nvalues == 1)
-      _shake_detected = values[0];
-    else if (cmd == CMD_MIP_SOFTWARE_VERSION && nvalues == 4) {
-        std::ostringstream vstr;
-        vstr << "20" << std::setw(2) << std::setfill('0') << values[0] // year
-             << "/"  << std::setw(2) << std::setfill('0') << values[1] // month
-             << "/"  << std::setw(2) << std::setfill('0') << values[2] // day
-             << "-"  << std::setw(2) << std::setfill('0') << values[3]; // version
-        _software_version = vstr.str();
+      _polling_backoff_ms = 0;
+      gint64 now_us = g_get_monotonic_time(), timeout_us = DEFAULT_REQUEST_TIMEOUT_MS * 1000LL;
+      // when each answer should be refreshed, in microseconds from now
+      unsigned int nreqs = _polled_requests.size();
+      std::vector<gint64> due_in_us(nreqs);
+      std::vector<bool> waiting(nreqs);
+      bool any_due = false;
+      for (unsigned int i = 0; i < nreqs; ++i) {
+        PolledRequest & req = _polled_requests[i];
+        gint64 last_us;
+        {
+          StateLock state_lock(_state_mutex);
+          last_us = _last_response_us[req.cmd];
+        }
+        // waiting for the answer: do not ask again before the deadline
+        waiting[i] = (req.sent_us > last_us && now_us - req.sent_us < timeout_us);
+        if (waiting[i])
+          due_in_us[i] = req.sent_us + timeout_us - now_us;
+        else if (!last_us)
+          due_in_us[i] = 0;
+        else // ask again one response latency before the answer gets too old
+          due_in_us[i] = last_us + req.max_age_us - now_us
+              - (gint64) (get_latency(req.cmd).p50_ms * 1000);
+        any_due = any_due || (!waiting[i] && due_in_us[i] <= 0);
       }
-    else if (cmd == CMD_MIP_HARDWARE_INFO && nvalues == 2) {
-        std::ostringstream vstr;
-        vstr << std::setw(2) << std::setfill('0') << values[0] // voice chip
-             << "-"
-             << std::setw(2) << std::setfill('0') << values[1];
-        _hardware_version = vstr.str();
+      for (unsigned int i = 0; i < nreqs; ++i) {
+        PolledRequest & req = _polled_requests[i];
+        // the requests due soon join the burst, instead of another one later
+        if (any_due && !waiting[i] && due_in_us[i] <= req.max_age_us / 4) {
+          burst.push_back(req.cmd);
+          req.sent_us = now_us;
+          due_in_us[i] = req.max_age_us; // if answered in time
+        }
+        next_ms = std::min(next_ms, (int) std::max(due_in_us[i] / 1000, (gint64) 1));
       }
-    else if (cmd == CMD_MIP_VOLUME && nvalues == 1)
-      _volume = values[0];
-    else // unknown command -> return
+      arm_polling(next_ms);
+    }
+    if (burst.empty())
       return;
-    notification_post_hook(cmd, values);
+    ++_npolling_bursts;
+    for (unsigned int i = 0; i < burst.size(); ++i) {
+      uint8_t value = burst[i];
+      if (send_order(&value, 1))
+        ++_npolling_requests;
+    }
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
-  //! low-level GATT order send
+  //! store the cached value of the chest LED
+  inline void set_chest_LED_cached(const ChestLed & l) {
+    StateLock lock(_state_mutex);
+    _chest_led_cached = l;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! low-level GATT order send, deferred to the I/O thread if any
   inline bool send_order(uint8_t *value, int vlen) {
+    bool ok;
+    if (is_io_thread_running() && !_worker->is_current_thread())
+      ok = post_order(value, vlen, g_get_monotonic_time());
+    else
+      ok = send_order_now(value, vlen);
+    if (ok) // the orders not sent do not move the robot
+      track_motion(value, vlen);
+    return ok;
+  }
+
+  //! give the motion commands to the pose estimator, whatever sent them
+  inline void track_motion(const uint8_t *value, int vlen) {
+    if (value[0] == CMD_CONTINUOUS_DRIVE && vlen == 3) {
+      int v_ticks, w_ticks;
+      double v_ms, w_rads;
+      continuous_drive_ticks(value[1], value[2], v_ticks, w_ticks);
+      ticks2speeds(v_ticks, w_ticks, v_ms, w_rads);
+      // the regressions of ticks2speeds() are not null for 0 ticks
+      _pose_estimator.set_command(v_ticks ? v_ms : 0, w_ticks ? w_rads : 0,
+                                  g_get_monotonic_time());
+    }
+    else if (value[0] == CMD_STOP)
+      _pose_estimator.set_command(0, 0, g_get_monotonic_time());
+  }
+
+  /*! low-level GATT order send, in the thread running the GLib context
+   * \arg enqueue_us the time of send_order(), for the latencies, 0 for now */
+  inline bool send_order_now(uint8_t *value, int vlen, gint64 enqueue_us = 0) {
+    if (!_attrib) { // not connected yet, or connection lost
+      ++_ncommands_dropped;
+      return false;
+    }
+    MipRecorder* recorder = _recorder;
+    if (recorder)
+      recorder->record(MipRecord::COMMAND, _recorder_source, value, vlen);
     bool ok = false;
+    bool latest_wins = mip_command_info(value[0]).latest_wins;
+    if (latest_wins) {
+      ++_nlatest_wins_commands;
+      if (_coalescing && replace_pending_latest_wins(value, vlen)) {
+        pump_up_callbacks();
+        return true;
+      }
+    }
     // the return value of gatt_write_cmd() should be equal to the number of commands sent
     ++_nattrib;
+    _in_flight[value[0]].push(enqueue_us ? enqueue_us : g_get_monotonic_time());
+    ++_ncommands_sent;
     unsigned int retval = gatt_write_cmd(_attrib, _handle_write, value, vlen,
-                                         NULL, this);
+                                         (latest_wins ? Mip::latest_wins_sent_cb : NULL),
+                                         this);
+    if (retval)
+      ++_nqueued_pdus;
+    if (latest_wins && retval) {
+      ++_npending_latest_wins;
+      _pending_latest_wins_id = retval;
+    }
     //Mip::notify_cb, &_nattrib);
     //printf("retval:%i\n", retval);
     ok = (retval == _nattrib);
     if (retval != _nattrib) {
-        printf("gattmip: command %i='%s' did not return expected value!\n",
-               value[0], cmd2str(value[0]));
+        MIP_LOG_WARN("gattmip: command %i='%s' did not return expected value!\n",
+                     value[0], cmd2str(value[0]));
       }
     ok = ok && pump_up_callbacks();
     return ok;
   }
 
+  //! overwrite the pending latest-wins command, if any and not sent yet
+  inline bool replace_pending_latest_wins(uint8_t *value, int vlen) {
+    if (!_pending_latest_wins_id)
+      return false;
+    size_t buflen;
+    uint8_t *buf = g_attrib_get_buffer(_attrib, &buflen);
+    uint16_t plen = enc_write_cmd(_handle_write, value, vlen, buf, buflen);
+    if (!plen || !g_attrib_replace(_attrib, _pending_latest_wins_id, buf, plen))
+      return false;
+    ++_ncoalesced_commands;
+    MIP_LOG_DEBUG("gattmip: command %i='%s' coalesced\n", value[0], cmd2str(value[0]));
+    return true;
+  }
+
+  //! called by GAttrib once a latest-wins command left the queue (sent or cancelled)
+  static void latest_wins_sent_cb(gpointer user_data) {
+    Mip* this_ = (Mip*) user_data;
+    // the queue is FIFO: the last one queued is the last one to leave
+    if (this_->_npending_latest_wins > 0 && --this_->_npending_latest_wins == 0)
+      this_->_pending_latest_wins_id = 0;
+  }
+
+  //! called by GAttrib each time a PDU is written to the socket
+  static void pdu_written_cb(const guint8 *pdu, guint16 len, gpointer user_data) {
+    Mip* this_ = (Mip*) user_data;
+    if (this_->_nqueued_pdus > 0)
+      --this_->_nqueued_pdus;
+    if (len < 4 || pdu[0] != ATT_OP_WRITE_CMD) // opcode, handle, command number
+      return;
+    MipCommand cmd = pdu[3];
+    InFlight & in_flight = this_->_in_flight[cmd];
+    gint64 enqueue_us = in_flight.written();
+    if (enqueue_us < 0)
+      return;
+    this_->latency_histogram(WRITE_LATENCY, cmd)->record(g_get_monotonic_time() - enqueue_us);
+    if (!expects_response(cmd)) // nothing else to wait for
+      in_flight.pop();
+  }
+
+  //! record the latency of the oldest request of a command, just answered
+  inline void record_response_latency(MipCommand cmd) {
+    InFlight & in_flight = _in_flight[cmd];
+    if (!in_flight.count || !expects_response(cmd)) // unsolicited notification
+      return;
+    gint64 now_us = g_get_monotonic_time();
+    // forget the requests never answered
+    while (in_flight.count && now_us - in_flight.front() > DEFAULT_REQUEST_TIMEOUT_MS * 1000)
+      in_flight.pop();
+    if (in_flight.count)
+      latency_histogram(RESPONSE_LATENCY, cmd)->record(now_us - in_flight.pop());
+  }
+
+  static inline bool expects_response(MipCommand cmd) {
+    const MipCommandInfo & info = mip_command_info(cmd);
+    return info.request_len != MIP_NO_PAYLOAD && info.response_len != MIP_NO_PAYLOAD;
+  }
+
+  //! allocated at the first use, in the thread dispatching the GLib events
+  inline MipHistogram* latency_histogram(LatencyType type, MipCommand cmd) {
+    MipHistogram* histo = _latency_histograms[type][cmd];
+    if (!histo) {
+      histo = new MipHistogram();
+      _latency_histograms[type][cmd] = histo;
+    }
+    return histo;
+  }
+
+  //! push an order onto the queue of the I/O thread, and wake it up if needed
+  inline bool post_order(uint8_t *value, int vlen, gint64 enqueue_us) {
+    IoOrder order;
+    if (vlen <= 0 || vlen > (int) sizeof(order.value))
+      return false;
+    if (!_is_connected) { // the I/O thread would drop it
+      ++_ncommands_dropped;
+      MIP_LOG_WARN("gattmip: not connected, command %i='%s' dropped!\n",
+                   value[0], cmd2str(value[0]));
+      return false;
+    }
+    order.enqueue_us = enqueue_us;
+    order.len = vlen;
+    memcpy(order.value, value, vlen);
+    if (!_io_orders.push(order)) {
+      ++_ncommands_dropped;
+      MIP_LOG_WARN("gattmip: I/O queue full, command %i='%s' dropped!\n",
+                   value[0], cmd2str(value[0]));
+      return false;
+    }
+    // only the first producer since the last drain needs a system call
+    if (!_io_wakeup_pending.exchange(true)) {
+      uint64_t one = 1;
+      if (write(_io_eventfd, &one, sizeof(one)) != sizeof(one))
+        MIP_LOG_ERROR("gattmip: could not wake up the I/O thread!\n");
+    }
+    return true;
+  }
+
+  //! called in the I/O thread when the eventfd is written: drain the orders
+  static gboolean io_commands_cb(GIOChannel *, GIOCondition, gpointer user_data) {
+    Mip* this_ = (Mip*) user_data;
+    uint64_t count;
+    if (read(this_->_io_eventfd, &count, sizeof(count)) < 0) {
+      // EAGAIN: already cleared, nothing to do
+    }
+    // clear the flag before draining, a later push will write again
+    this_->_io_wakeup_pending = false;
+    IoOrder order;
+    unsigned int norders = 0, ndropped = 0;
+    while (this_->_io_orders.pop(order)) {
+      if (this_->_is_connected)
+        this_->send_order_now(order.value, order.len, order.enqueue_us);
+      else // the link was lost after post_order()
+        ++ndropped;
+      ++norders;
+    }
+    if (ndropped) {
+      this_->_ncommands_dropped += ndropped;
+      MIP_LOG_WARN("gattmip: connection lost, %u commands dropped!\n", ndropped);
+    }
+    this_->_worker->count_orders(norders);
+    return TRUE;
+  }
+
+  //! called in the I/O thread by start_connect()
+  static gboolean io_connect_cb(gpointer user_data) {
+    ((Mip*) user_data)->gatt_connect_start();
+    return FALSE;
+  }
+
+  //! called in the I/O thread by cancel_connect()
+  static gboolean io_cancel_connect_cb(gpointer user_data) {
+    Mip* this_ = (Mip*) user_data;
+    if (this_->_connect_state == CONNECTING)
+      this_->finish_connect(CONNECT_CANCELLED);
+    return FALSE;
+  }
+
   // g_attrib_send(attrib, 0, buf, plen, NULL, user_data, notify);
   // evt->notify(evt->user_data);
   //  static void notify_cb(void*val) {
@@ -709,45 +1925,18 @@ protected:
 
   //////////////////////////////////////////////////////////////////////////////
 
-  //! send_order() versions for fixed number of parameters
-  inline bool send_order0(uint8_t cmd) {
-    DEBUG_PRINT("send_order0(0x%02x=%s)\n", cmd, cmd2str(cmd));
-    uint8_t value_arr[1] = {cmd};
-    return send_order(value_arr, 1);
-  }
-  inline bool send_order1(uint8_t cmd, uint8_t param1) {
-    DEBUG_PRINT("send_order1(0x%02x=%s, params:%i=0x%02x)\n",
-                cmd, cmd2str(cmd), param1, param1);
-    uint8_t value_arr[2] = {cmd, param1};
-    return send_order(value_arr, 2);
-  }
-  inline bool send_order2(uint8_t cmd, uint8_t param1, uint8_t param2) {
-    DEBUG_PRINT("send_order2(0x%02x=%s, params:%i=0x%02x, %i=0x%02x)\n",
-                cmd, cmd2str(cmd), param1, param1, param2, param2);
-    uint8_t value_arr[3] = {cmd, param1, param2};
-    return send_order(value_arr, 3);
-  }
-  inline bool send_order3(uint8_t cmd, uint8_t param1, uint8_t param2, uint8_t param3) {
-    DEBUG_PRINT("send_order3(0x%02x=%s, params:%i=0x%02x, %i=0x%02x, %i=0x%02x)\n",
-                cmd, cmd2str(cmd), param1, param1, param2, param2, param3, param3);
-    uint8_t value_arr[4] = {cmd, param1, param2, param3};
-    return send_order(value_arr, 4);
-  }
-  inline bool send_order4(uint8_t cmd, uint8_t param1, uint8_t param2,
-                          uint8_t param3, uint8_t param4) {
-    DEBUG_PRINT("send_order4(0x%02x=%s, params:%i=0x%02x, %i=0x%02x, %i=0x%02x, %i=0x%02x)\n",
-                cmd, cmd2str(cmd), param1, param1, param2, param2,
-                param3, param3, param4, param4);
-    uint8_t value_arr[5] = {cmd, param1, param2, param3, param4};
-    return send_order(value_arr, 5);
-  }
-  inline bool send_order5(uint8_t cmd, uint8_t param1, uint8_t param2,
-                          uint8_t param3, uint8_t param4, uint8_t param5) {
-    DEBUG_PRINT("send_order5(0x%02x=%s, params:%i=0x%02x, %i=0x%02x, %i=0x%02x, %i=0x%02x, %i=0x%02x)\n",
-                cmd, cmd2str(cmd), param1, param1, param2, param2, param3, param3,
-                param4, param4, param5, param5);
-    uint8_t value_arr[6] = {cmd, param1, param2, param3, param4, param5};
-    return send_order(value_arr, 6);
+  /*! typed send_order(): the number of parameters is checked at compile time
+   *  against MIP_COMMAND_TABLE, for instance send_command<CMD_STOP>()
+   *  or send_command<CMD_CONTINUOUS_DRIVE>(param1, param2) */
+  template<MipCommand CMD, typename... Params>
+  inline bool send_command(Params... params) {
+    static_assert(mip_command_info(CMD).request_len == (int) sizeof...(Params)
+                  || mip_command_info(CMD).request_len == MIP_ANY_LENGTH,
+                  "wrong number of parameters for this command, see MIP_COMMAND_TABLE");
+    uint8_t value_arr[1 + sizeof...(Params)] = { (uint8_t) CMD, ((uint8_t) params)... };
+    MIP_LOG_DEBUG("send_command(0x%02x=%s, params:%s)\n", CMD, mip_command_info(CMD).name,
+                  MipLog::join(value_arr + 1, sizeof...(Params), " %i=0x%02x"));
+    return send_order(value_arr, 1 + sizeof...(Params));
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -760,18 +1949,6 @@ protected:
 
   //////////////////////////////////////////////////////////////////////////////
 
-  /*! convert a hex value into ints
-   https://stackoverflow.com/questions/13490977/convert-hex-stdstring-to-unsigned-char */
-  inline static unsigned int hex2int(const std::string & char_pair){
-    std::stringstream convertStream;
-    convertStream << std::hex << char_pair;
-    unsigned int buffer;
-    convertStream >> std::hex >> buffer;
-    return buffer;
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-
   //! convert an angle in radians into an angle in degrees, clamping it in given boundaries
   inline static double rad2deg_norm(const double & angle_rad,
                                     double angle_min = 0,
@@ -786,58 +1963,170 @@ protected:
 
   //! the events handler callback
   static void events_handler(const uint8_t *pdu, uint16_t len, gpointer user_data) {
-    //DEBUG_PRINT("events_handler()\n");
-    uint16_t handle, i;
-    handle = att_get_u16(&pdu[1]);
-    switch (pdu[0]) {
-      case ATT_OP_HANDLE_NOTIFY:
-        DEBUG_PRINT("Notification handle = 0x%04x: ", handle);
-        break;
-      case ATT_OP_HANDLE_IND:
-        DEBUG_PRINT("Indication   handle = 0x%04x: ", handle);
-        break;
-      default:
-        printf("Invalid opcode %i\n", pdu[0]);
+    //MIP_LOG_DEBUG("events_handler()\n");
+    if (len < 3) {
+        MIP_LOG_WARN("Notification too short (%i bytes)\n", len);
+        return;
+      }
+    if (pdu[0] != ATT_OP_HANDLE_NOTIFY && pdu[0] != ATT_OP_HANDLE_IND) {
+        MIP_LOG_WARN("Invalid opcode %i\n", pdu[0]);
         return;
       }
 
-    std::ostringstream hex_ans_stream;
-    //DEBUG_PRINT("values: ");
-    for (i = 3; i < len; i++) {
-        hex_ans_stream << (char) pdu[i];
-        //DEBUG_PRINT("'%c'=%i=0x%02x ", pdu[i], pdu[i], pdu[i]);
+    // the payload is ASCII-hex: the first 2 chars are the command number,
+    // then each pair of chars is a value - decoded in place, on the stack
+    MipNotification notif;
+    if (!notif.decode(pdu + 3, len - 3)) {
+        MIP_LOG_WARN("Could not decode notification '%s'\n",
+                     std::string((const char*) pdu + 3, len - 3));
+        return;
       }
-    // DEBUG_PRINT("\n");
-    std::string hex_ans = hex_ans_stream.str();
-    // command - the first 2 chars are the command number
-    MipCommand cmd = hex2int(hex_ans.substr(0, 2)); // in decimal base
-    // convert each pair of values from hex to int
-    unsigned int npairs = (hex_ans.size()-2) / 2;
-    std::vector<int> values(npairs);
-    for (unsigned int i = 0; i < npairs; ++i)
-      values[i] = hex2int(hex_ans.substr(2+i*2, 2));
-    std::ostringstream values_str;
-    for (unsigned int i = 0; i < npairs; ++i)
-      values_str << values[i] << ";";
-    DEBUG_PRINT("cmd:0x%02x=%s, values:'%s'\n",
-                cmd, cmd2str(cmd), values_str.str().c_str());
+    MIP_LOG_DEBUG("%s handle = 0x%04x: cmd:0x%02x=%s, values:'%s'\n",
+                  (pdu[0] == ATT_OP_HANDLE_NOTIFY ? "Notification" : "Indication  "),
+                  att_get_u16(&pdu[1]), notif.cmd, cmd2str(notif.cmd),
+                  MipLog::join(notif.values, notif.nvalues, "%i;"));
 
     Mip* this_ = (Mip*) user_data;
-    this_->store_results(cmd, values);
+    ++this_->_nnotifications;
+    MipRecorder* recorder = this_->_recorder;
+    if (recorder)
+      recorder->record(this_->_recorder_source, notif);
+    this_->store_results(notif);
   } // end events_handler();
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! start the GATT connection and its deadline, connect_cb() is called when done
+  inline bool gatt_connect_start() {
+    if (_channel_factory) { // no Bluetooth, the channel is connected at once
+      GIOChannel* iochannel = _channel_factory(*this);
+      if (iochannel == NULL) {
+        printf("Could not open the channel to '%s'\n", _mip_mac.c_str());
+        finish_connect(CONNECT_FAILED);
+        return false;
+      }
+      _connect_channel = iochannel;
+      connect_cb(iochannel, NULL, this);
+      return true;
+    }
+    // -t : "Set LE address type. Default: public", "[public | random]"
+    const char *dst_type = "public",
+        // -l : "Set security level. Default: low", "[low | medium | high]"
+        *sec_level = "low";
+    GError* error = NULL;
+    GIOChannel* iochannel = gatt_connect(_device_name.c_str(), _mip_mac.c_str(),
+                                         dst_type, sec_level, 0, 0,
+                                         Mip::connect_cb, this, &error);
+    if (iochannel == NULL) {
+        printf("Error in gatt_connect('%s'->'%s'): '%s'\n",
+               _device_name.c_str(), _mip_mac.c_str(), error->message);
+        g_error_free(error);
+        finish_connect(CONNECT_FAILED);
+        return false;
+      }
+    _connect_channel = iochannel;
+    _connect_timeout = g_timeout_source_new(_connect_timeout_ms);
+    g_source_set_callback(_connect_timeout, Mip::connect_timeout_cb, this, NULL);
+    g_source_attach(_connect_timeout, _context);
+    return true;
+  }
+
+  //! end the connection attempt, in the thread dispatching the GLib events
+  inline void finish_connect(ConnectState state) {
+    if (_connect_timeout) {
+      g_source_destroy(_connect_timeout);
+      g_source_unref(_connect_timeout);
+      _connect_timeout = NULL;
+    }
+    if (state != CONNECTED && _connect_channel) {
+      // btio gets G_IO_NVAL and drops the attempt silently
+      g_io_channel_shutdown(_connect_channel, FALSE, NULL);
+      g_io_channel_unref(_connect_channel);
+      _connect_channel = NULL;
+    }
+    gint64 now_us = g_get_monotonic_time();
+    _connect_time_us = now_us - _connect_start_us;
+    if (state == CONNECTED && _lost_us) {
+      _dropout_us = now_us - _lost_us;
+      _lost_us = 0;
+    }
+    set_connect_state(state);
+  }
+
+  inline void set_connect_state(ConnectState state) {
+    ConnectCallback callback;
+    {
+      std::lock_guard<std::mutex> lock(_connect_mutex);
+      _connect_state = state;
+      callback = _connect_callback;
+    }
+    _connect_cv.notify_all();
+    if (callback)
+      callback(*this, state);
+  }
+
+  //! the deadline of the connection
+  static gboolean connect_timeout_cb(gpointer user_data) {
+    Mip* this_ = (Mip*) user_data;
+    printf("gatt_connect('%s'->'%s'): not connected after %i ms\n",
+           this_->_device_name.c_str(), this_->_mip_mac.c_str(), this_->_connect_timeout_ms);
+    this_->finish_connect(CONNECT_FAILED);
+    return FALSE;
+  }
+
+  //! close the connection, in the thread dispatching the GLib events
+  inline void disconnect_now(ConnectState state = NOT_CONNECTED) {
+    _is_connected = false;
+    if (_attrib) {
+      g_attrib_set_disconnect_function(_attrib, NULL, NULL);
+      g_attrib_set_write_function(_attrib, NULL, NULL);
+      g_attrib_unregister_all(_attrib);
+      g_attrib_unref(_attrib);
+      _attrib = NULL;
+    }
+    if (_connect_channel) {
+      g_io_channel_shutdown(_connect_channel, FALSE, NULL);
+      g_io_channel_unref(_connect_channel);
+      _connect_channel = NULL;
+    }
+    set_connect_state(state);
+  }
+
+  //! called by GAttrib when the link is lost
+  static void disconnected_cb(gpointer user_data) {
+    Mip* this_ = (Mip*) user_data;
+    printf("gattmip: connection to '%s' lost!\n", this_->_mip_mac.c_str());
+    this_->_lost_us = g_get_monotonic_time();
+    this_->disconnect_now(CONNECTION_LOST);
+    this_->cancel_pending_requests();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
   //! the GATT connect callback
   static void connect_cb(GIOChannel *io, GError *err, gpointer user_data) {
-    DEBUG_PRINT("connect_cb()\n");
+    MIP_LOG_DEBUG("connect_cb()\n");
+    Mip* this_ = (Mip*) user_data;
+    if (this_->_connect_state != CONNECTING) // cancelled meanwhile
+      return;
     if (err) {
         g_printerr("%s\n", err->message);
+        this_->finish_connect(CONNECT_FAILED);
         return;
       }
-    Mip* this_ = (Mip*) user_data;
-    this_->_attrib = g_attrib_new(io);
+    this_->_attrib = (this_->_channel_factory ? g_attrib_new_with_mtu(io, ATT_DEFAULT_LE_MTU)
+                      : g_attrib_new(io));
+    // the ids of a new GAttrib start again from 1
+    this_->_nattrib = 0;
+    this_->_pending_latest_wins_id = 0;
+    this_->_npending_latest_wins = 0;
     this_->_is_connected = true;
+    if (this_->_write_budget > 0)
+      g_attrib_set_write_budget(this_->_attrib, this_->_write_budget);
+    g_attrib_set_disconnect_function(this_->_attrib, Mip::disconnected_cb, this_);
+    g_attrib_set_write_function(this_->_attrib, Mip::pdu_written_cb, this_);
+    memset(this_->_in_flight, 0, sizeof(this_->_in_flight));
+    this_->_nqueued_pdus = 0;
     // register the callback
     // g_attrib_register(GAttrib *attrib, guint8 opcode, guint16 handle,
     //              GAttribNotifyFunc func, gpointer user_data, GDestroyNotify notify)
@@ -847,6 +2136,16 @@ protected:
     g_attrib_register(this_->_attrib, ATT_OP_HANDLE_IND, this_->_handle_read,
                       Mip::events_handler, this_,
                       NULL);
+    bool reconnection = this_->_was_connected;
+    this_->_was_connected = true;
+    this_->finish_connect(CONNECTED);
+    if (reconnection && this_->_restore_on_reconnect)
+      this_->restore_state();
+    { // refresh the polled answers now
+      std::lock_guard<std::mutex> lock(this_->_polling_mutex);
+      if (!this_->_polled_requests.empty())
+        this_->arm_polling(0);
+    }
   } // end connect_cb();
 
   //////////////////////////////////////////////////////////////////////////////
@@ -857,15 +2156,114 @@ protected:
   unsigned int _nattrib;
   GMainLoop *_main_loop;
   GMainContext * _context;
-  bool _is_connected;
+  std::atomic<bool> _is_connected;
+  //! the Bluetooth device and robot MAC given to connect()
+  std::string _device_name, _mip_mac;
+  //! the connection attempt, \see start_connect()
+  std::atomic<int> _connect_state;
+  GIOChannel *_connect_channel;
+  GSource *_connect_timeout;
+  unsigned int _connect_timeout_ms;
+  gint64 _connect_start_us, _connect_time_us;
+  std::mutex _connect_mutex;
+  std::condition_variable _connect_cv;
+  ConnectCallback _connect_callback;
+  ChannelFactory _channel_factory;
+  //! the reconnections, \see reconnect()
+  bool _was_connected, _restore_on_reconnect;
+  gint64 _lost_us, _dropout_us;
+  //! \see set_recorder()
+  std::atomic<MipRecorder*> _recorder;
+  std::atomic<uint32_t> _recorder_source;
+  //! the I/O thread, \see start_io_thread() and use_worker()
+  struct IoOrder {
+    gint64 enqueue_us;
+    uint8_t len;
+    uint8_t value[ATT_DEFAULT_LE_MTU - 3];
+  };
+  MipWorker *_worker;
+  std::unique_ptr<MipWorker> _own_worker;
+  GSource *_io_source;
+  MpscRing<IoOrder, 256> _io_orders;
+  int _io_eventfd;
+  std::atomic<bool> _io_wakeup_pending;
+  //! the requests waiting for an answer, \see request_async()
+  std::vector<PendingRequest> _pending_requests;
+  unsigned int _last_pending_id;
+  std::mutex _pending_mutex;
+  //! \see get_traffic_stats(), the latencies are protected by _pending_mutex
+  unsigned long _nresponses;
+  gint64 _response_latency_sum_us, _response_latency_max_us;
+  std::atomic<unsigned long> _ncommands_sent, _nnotifications, _ncommands_dropped;
+  //! the commands not written or answered yet, for each opcode, oldest first
+  struct InFlight {
+    static const unsigned int SIZE = 4;
+    gint64 enqueue_us[SIZE];
+    bool is_written[SIZE];
+    uint8_t head, count;
+    //! when full, the oldest command is forgotten
+    inline void push(gint64 t_us) {
+      if (count == SIZE)
+        pop();
+      unsigned int i = (head + count++) % SIZE;
+      enqueue_us[i] = t_us;
+      is_written[i] = false;
+    }
+    inline gint64 front() const { return enqueue_us[head]; }
+    inline gint64 pop() {
+      gint64 t_us = enqueue_us[head];
+      head = (head + 1) % SIZE;
+      --count;
+      return t_us;
+    }
+    //! mark the oldest command not written yet. \return its enqueue time, -1 if none
+    inline gint64 written() {
+      for (unsigned int j = 0; j < count; ++j) {
+        unsigned int i = (head + j) % SIZE;
+        if (!is_written[i]) {
+          is_written[i] = true;
+          return enqueue_us[i];
+        }
+      }
+      return -1;
+    }
+  };
+  InFlight _in_flight[256];
+  //! \see get_latency(), indexed by LatencyType and opcode
+  std::atomic<MipHistogram*> _latency_histograms[2][256];
+  //! the commands given to GAttrib and not written to the socket yet
+  std::atomic<int> _nqueued_pdus;
+  //! the background polling, \see set_polling()
+  struct PolledRequest {
+    MipCommand cmd;
+    gint64 max_age_us;
+    //! g_get_monotonic_time() of the last request sent by the scheduler
+    gint64 sent_us;
+  };
+  std::vector<PolledRequest> _polled_requests;
+  //! protects _polled_requests and _polling_source
+  std::mutex _polling_mutex;
+  GSource *_polling_source;
+  unsigned int _polling_backoff_ms;
+  std::atomic<unsigned long> _npolling_requests, _npolling_bursts, _npolling_backoffs;
+  //! protects the values written by the notifications, read by the getters
+  typedef std::lock_guard<std::mutex> StateLock;
+  std::mutex _state_mutex;
   //! handles for reading and writing parameters from/to the robot
   int _handle_read, _handle_write;
   //! in 0-7
-  unsigned int _volume;
+  unsigned int _volume, _volume_cached;
   //! buffers for continuous_drive()
   int _last_v_ticks, _last_w_ticks;
+  //! latest-wins coalescing, \see set_coalescing()
+  bool _coalescing;
+  guint _pending_latest_wins_id;
+  unsigned int _npending_latest_wins;
+  std::atomic<unsigned int> _nlatest_wins_commands, _ncoalesced_commands;
+  //! the number of PDUs written per wake-up of the sender, 0 for default
+  unsigned int _write_budget;
   //! \see GameMode enum
-  GameMode _game_mode;
+  GameMode _game_mode, _game_mode_cached;
   //! between 4.0V and 6.4V, or < 0 if error
   double _battery_voltage;
   //! \see Status enum
@@ -882,13 +2280,25 @@ protected:
   HeadLed _head_led, _head_led_cached;
   //! meters
   double _odometer_reading_m;
+  //! fed by send_order() and store_odometer_reading()
+  MipPoseEstimator _pose_estimator;
   //! \see Gesture enum
   Gesture _gesture_detect;
   //! \see GestureOrRadarMode enum
   GestureOrRadarMode _gesture_or_radar_mode;
   //! \see RadarResponse enum
   RadarResponse _radar_response;
+  //! the last answer received for each opcode, and g_get_monotonic_time() then, 0 if none
+  MipNotification _last_responses[256];
+  gint64 _last_response_us[256];
   //! 1 when shaken
   int _shake_detected;
 }; // end class Mip
+
+//! defined out of the class, where the handlers are complete
+inline const Mip::NotificationDispatch & Mip::notification_dispatch() {
+  static constexpr NotificationDispatch dispatch;
+  return dispatch;
+}
+
 #endif // Mip_H
@@ -24,6 +24,7 @@ A standalone prompt to test the MIP library.
  */
 
 #include "gattmip.h"
+#include "miprateloop.h"
 #include "bluetooth_mac2device.h"
 #include <iostream>
 
@@ -80,116 +81,109 @@ int main(int argc, char** argv) {
   double param3 = (argc >= 5 ? atof(argv[4]) : -1);
   double param4 = (argc >= 6 ? atof(argv[5]) : -1);
   double param5 = (argc >= 7 ? atof(argv[6]) : -1);
-  if (choice == "sou" && nparams == 1)
-    printf("retval:%i\n", mip.play_sound(param1));
-  else if (choice == "dis" && nparams == 2)
-    printf("retval:%i\n", mip.distance_drive(param1, param2));
-  else if (choice == "tim" && nparams == 2)
-    printf("retval:%i\n", mip.time_drive(param1, param2));
-  else if (choice == "ang" && nparams == 2)
-    printf("retval:%i\n", mip.angle_drive(param1, param2));
-  else if (choice == "con" && nparams == 2)
-    printf("retval:%i\n", mip.continuous_drive(param1, param2));
-  else if (choice == "con" && nparams == 3) {
-    unsigned int ntimes = param3 / 50.; // a command each 50 ms
-    printf("ntimes:%i\n", ntimes);
-    for (unsigned int i = 0; i < ntimes; ++i) {
-      mip.continuous_drive(param1, param2);
-      usleep(50 * 1000);
+  // the queries throw MipTimeoutError if the robot does not answer
+  try {
+    if (choice == "sou" && nparams == 1)
+      printf("retval:%i\n", mip.play_sound(param1));
+    else if (choice == "dis" && nparams == 2)
+      printf("retval:%i\n", mip.distance_drive(param1, param2));
+    else if (choice == "tim" && nparams == 2)
+      printf("retval:%i\n", mip.time_drive(param1, param2));
+    else if (choice == "ang" && nparams == 2)
+      printf("retval:%i\n", mip.angle_drive(param1, param2));
+    else if (choice == "con" && nparams == 2)
+      printf("retval:%i\n", mip.continuous_drive(param1, param2));
+    else if (choice == "con" && nparams == 3) {
+      unsigned int ntimes = param3 / 50.; // a command each 50 ms
+      printf("ntimes:%i\n", ntimes);
+      MipRateLoop loop(20);
+      if (ntimes)
+        loop.run([&]() {
+          mip.continuous_drive(param1, param2);
+          return (loop.get_stats().ticks < ntimes);
+        });
+      printf("%s\n", loop.get_stats().to_string().c_str());
     }
+    else if (choice == "mod" && nparams == 0) {
+      GameMode mode = mip.wait_for_result(mip.request_game_mode_async());
+      printf("game_mode:%i = '%s'\n", mode, game_mode2str(mode));
+    }
+    else if (choice == "sto" && nparams == 0)
+      printf("retval:%i\n", mip.stop());
+    else if (choice == "sta" && nparams == 0) {
+      Status status = mip.wait_for_result(mip.request_status_async());
+      printf("status:%i = '%s'\n", status, status2str(status));
+    }
+    else if (choice == "up" && nparams == 0)
+      mip.up();
+    else if (choice == "wei" && nparams == 0) {
+      printf("weight:%i\n", mip.wait_for_result(mip.request_weight_update_async()));
+    }
+    else if (choice == "cled" && nparams == 0) {
+      Mip::ChestLed led = mip.wait_for_result(mip.request_chest_LED_async());
+      printf("chest_led:%s\n", led.to_string().c_str());
+    }
+    else if (choice == "cled" && nparams == 3) {
+      printf("retval:%i\n", mip.set_chest_LED(param1, param2, param3));
+    }
+    else if (choice == "cled" && nparams == 5) {
+      Mip::ChestLed led;
+      led.r = param1;
+      led.g = param2;
+      led.b = param3;
+      led.time_flash_on_sec = param4;
+      led.time_flash_off_sec = param5;
+      printf("retval:%i\n", mip.set_chest_LED(led));
+    }
+    else if (choice == "hled" && nparams == 0) {
+      Mip::HeadLed led = mip.wait_for_result(mip.request_head_LED_async());
+      printf("head_led:%s\n", led.to_string().c_str());
+    }
+    else if (choice == "hled" && nparams == 4) {
+      Mip::HeadLed led;
+      led.l1 = param1;
+      led.l2 = param2;
+      led.l3 = param3;
+      led.l4 = param4;
+      printf("retval:%i\n", mip.set_head_LED(led));
+    }
+    else if (choice == "odo" && nparams == 0) {
+      printf("odometer:%f\n", mip.wait_for_result(mip.request_odometer_reading_async()));
+    }
+    else if (choice == "ges" && nparams == 0)
+      printf("gesture:%i = '%s'\n", mip.get_gesture_detect(), mip.get_gesture_detect2str());
+    else if (choice == "gmod" && nparams == 0) {
+      GestureOrRadarMode mode = mip.wait_for_result(mip.request_gesture_or_radar_mode_async());
+      printf("gesture_or_radar_mode:%i = '%s'\n", mode, gesture_or_radar_mode2str(mode));
+    }
+    else if (choice == "gmod" && nparams == 1)
+      mip.set_gesture_or_radar_mode(param1);
+    else if (choice == "rad" && nparams == 0)
+      printf("radar_response:%i = '%s'\n",
+             mip.get_radar_response(), mip.get_radar_response2str());
+    else if (choice == "bat" && nparams == 0) {
+      mip.wait_for_result(mip.request_battery_voltage_async());
+      printf("battery:%fV = %i%%\n", mip.get_battery_voltage(), mip.get_battery_percentage());
+    }
+    else if (choice == "sve" && nparams == 0) {
+      printf("software version:'%s'\n",
+             mip.wait_for_result(mip.request_software_version_async()).c_str());
+    }
+    else if (choice == "hve" && nparams == 0) {
+      printf("hardware version:'%s'\n",
+             mip.wait_for_result(mip.request_hardware_version_async()).c_str());
+    }
+    else if (choice == "vol" && nparams == 0) {
+      printf("volume:%i\n", mip.wait_for_result(mip.request_volume_async()));
+    }
+    else if (choice == "vol" && nparams == 1)
+      printf("retval:%i\n", mip.set_volume(param1));
+    else // nothing done
+      print_help(argc, argv);
+  } catch (const MipTimeoutError & e) {
+    printf("%s\n", e.what());
+    return -1;
   }
-  else if (choice == "mod" && nparams == 0) {
-    mip.request_game_mode();
-    mip.pump_up_callbacks(5);
-    printf("game_mode:%i = '%s'\n", mip.get_game_mode(), mip.get_game_mode2str());
-  }
-  else if (choice == "sto" && nparams == 0)
-    printf("retval:%i\n", mip.stop());
-  else if (choice == "sta" && nparams == 0) {
-    mip.request_status();
-    mip.pump_up_callbacks(5);
-    printf("status:%i = '%s'\n", mip.get_status(), mip.get_status2str());
-  }
-  else if (choice == "up" && nparams == 0)
-    mip.up();
-  else if (choice == "wei" && nparams == 0) {
-    mip.request_weight_update();
-    mip.pump_up_callbacks(5);
-    printf("weight:%i\n", mip.get_weight_update());
-  }
-  else if (choice == "cled" && nparams == 0) {
-    mip.request_chest_LED();
-    mip.pump_up_callbacks(5);
-    printf("chest_led:%s\n", mip.get_chest_LED().to_string().c_str());
-  }
-  else if (choice == "cled" && nparams == 3) {
-    printf("retval:%i\n", mip.set_chest_LED(param1, param2, param3));
-  }
-  else if (choice == "cled" && nparams == 5) {
-    Mip::ChestLed led;
-    led.r = param1;
-    led.g = param2;
-    led.b = param3;
-    led.time_flash_on_sec = param4;
-    led.time_flash_off_sec = param5;
-    printf("retval:%i\n", mip.set_chest_LED(led));
-  }
-  else if (choice == "hled" && nparams == 0) {
-    mip.request_head_LED();
-    mip.pump_up_callbacks(5);
-    printf("head_led:%s\n", mip.get_head_LED().to_string().c_str());
-  }
-  else if (choice == "hled" && nparams == 4) {
-    Mip::HeadLed led;
-    led.l1 = param1;
-    led.l2 = param2;
-    led.l3 = param3;
-    led.l4 = param4;
-    printf("retval:%i\n", mip.set_head_LED(led));
-  }
-  else if (choice == "odo" && nparams == 0) {
-    mip.request_odometer_reading();
-    mip.pump_up_callbacks(5);
-    printf("odometer:%f\n", mip.get_odometer_reading());
-  }
-  else if (choice == "ges" && nparams == 0)
-    printf("gesture:%i = '%s'\n", mip.get_gesture_detect(), mip.get_gesture_detect2str());
-  else if (choice == "gmod" && nparams == 0) {
-    mip.request_gesture_or_radar_mode();
-    mip.pump_up_callbacks(5);
-    printf("gesture_or_radar_mode:%i = '%s'\n",
-           mip.get_gesture_or_radar_mode(),
-           mip.get_gesture_or_radar_mode2str());
-  }
-  else if (choice == "gmod" && nparams == 1)
-    mip.set_gesture_or_radar_mode(param1);
-  else if (choice == "rad" && nparams == 0)
-    printf("radar_response:%i = '%s'\n",
-           mip.get_radar_response(), mip.get_radar_response2str());
-  else if (choice == "bat" && nparams == 0) {
-    mip.request_battery_voltage();
-    mip.pump_up_callbacks(5);
-    printf("battery:%fV = %i%%\n", mip.get_battery_voltage(), mip.get_battery_percentage());
-  }
-  else if (choice == "sve" && nparams == 0) {
-    mip.request_software_version();
-    mip.pump_up_callbacks(5);
-    printf("software version:'%s'\n", mip.get_software_version().c_str());
-  }
-  else if (choice == "hve" && nparams == 0) {
-    mip.request_hardware_version();
-    mip.pump_up_callbacks(5);
-    printf("hardware version:'%s'\n", mip.get_hardware_version().c_str());
-  }
-  else if (choice == "vol" && nparams == 0) {
-    mip.request_volume();
-    mip.pump_up_callbacks(5);
-    printf("volume:%i\n", mip.get_volume());
-  }
-  else if (choice == "vol" && nparams == 1)
-    printf("retval:%i\n", mip.set_volume(param1));
-  else // nothing done
-    print_help(argc, argv);
 
   // ensure order was sent
   sleep(1);
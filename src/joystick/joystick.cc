@@ -15,6 +15,8 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <iostream>
 #include <string>
@@ -41,6 +43,19 @@ Joystick::Joystick(std::string devicePath)
 void Joystick::openPath(std::string devicePath)
 {
   _fd = open(devicePath.c_str(), O_RDONLY | O_NONBLOCK);
+  _epollFd = -1;
+  if (_fd < 0)
+    return;
+
+  _epollFd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = _fd;
+  if (_epollFd >= 0 && epoll_ctl(_epollFd, EPOLL_CTL_ADD, _fd, &ev) < 0)
+  {
+    close(_epollFd);
+    _epollFd = -1;
+  }
 }
 
 bool Joystick::sample(JoystickEvent* event)
@@ -55,6 +70,65 @@ bool Joystick::sample(JoystickEvent* event)
   return bytes == sizeof(*event);
 }
 
+int Joystick::sampleAll(JoystickEvent* events, int maxEvents)
+{
+  int bytes = read(_fd, events, maxEvents * sizeof(*events));
+
+  if (bytes <= 0)
+    return 0;
+
+  // the kernel only returns whole events
+  return bytes / sizeof(*events);
+}
+
+int Joystick::readState(JoystickState* state)
+{
+  JoystickEvent events[JOYSTICK_BATCH_SIZE];
+  int total = 0;
+  while (true)
+  {
+    int count = sampleAll(events, JOYSTICK_BATCH_SIZE);
+    for (int i = 0; i < count; ++i)
+      state->update(events[i]);
+    total += count;
+
+    // a partial batch means the queue is drained, no need for another read
+    if (count < JOYSTICK_BATCH_SIZE)
+      return total;
+  }
+}
+
+bool Joystick::waitForEvents(int timeoutMs)
+{
+  if (_epollFd < 0)
+    return false;
+
+  struct epoll_event ev;
+  int count;
+  do
+  {
+    count = epoll_wait(_epollFd, &ev, 1, timeoutMs);
+  } while (count < 0 && errno == EINTR);
+  if (count <= 0)
+    return false;
+
+  // the joystick was unplugged: drop it, isFound() tells the caller
+  if (ev.events & (EPOLLHUP | EPOLLERR))
+  {
+    close(_epollFd);
+    _epollFd = -1;
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+  return true;
+}
+
+int Joystick::getFd()
+{
+  return _fd;
+}
+
 bool Joystick::isFound()
 {
   return _fd >= 0;
@@ -62,5 +136,7 @@ bool Joystick::isFound()
 
 Joystick::~Joystick()
 {
+  if (_epollFd >= 0)
+    close(_epollFd);
   close(_fd);
 };
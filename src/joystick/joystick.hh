@@ -20,6 +20,10 @@
 #define JS_EVENT_AXIS   0x02 // joystick moved
 #define JS_EVENT_INIT   0x80 // initial state of device
 
+#define JOYSTICK_MAX_AXES    16
+#define JOYSTICK_MAX_BUTTONS 32
+#define JOYSTICK_BATCH_SIZE  64 // events read at once by Joystick::readState()
+
 /**
  * Encapsulates all data relevant to a sampled joystick event.
  */
@@ -74,6 +78,76 @@ public:
   }
 };
 
+/**
+ * The latest state of the axes and buttons of a joystick, folded from
+ * its events: only the last position of each axis is kept.
+ */
+class JoystickState
+{
+public:
+  /**
+   * The latest position of each axis, between -32768 and 32767.
+   */
+  short axes[JOYSTICK_MAX_AXES];
+
+  /**
+   * True for each button currently down.
+   */
+  bool buttons[JOYSTICK_MAX_BUTTONS];
+
+  /**
+   * The number of times each button was pressed, even if released since.
+   * \see takePresses()
+   */
+  unsigned int presses[JOYSTICK_MAX_BUTTONS];
+
+  /**
+   * The timestamp of the latest event, in milliseconds.
+   */
+  unsigned int time;
+
+  JoystickState()
+  {
+    for (int i = 0; i < JOYSTICK_MAX_AXES; ++i)
+      axes[i] = 0;
+    for (int i = 0; i < JOYSTICK_MAX_BUTTONS; ++i)
+    {
+      buttons[i] = false;
+      presses[i] = 0;
+    }
+    time = 0;
+  }
+
+  /**
+   * Folds an event into the state.
+   */
+  void update(const JoystickEvent& event)
+  {
+    time = event.time;
+    if ((event.type & JS_EVENT_AXIS) && event.number < JOYSTICK_MAX_AXES)
+      axes[event.number] = event.value;
+    else if ((event.type & JS_EVENT_BUTTON) && event.number < JOYSTICK_MAX_BUTTONS)
+    {
+      bool down = (event.value != 0);
+      if (down && !buttons[event.number] && !(event.type & JS_EVENT_INIT))
+        ++presses[event.number];
+      buttons[event.number] = down;
+    }
+  }
+
+  /**
+   * Returns the number of presses of a button since the previous call.
+   */
+  unsigned int takePresses(int button)
+  {
+    if (button < 0 || button >= JOYSTICK_MAX_BUTTONS)
+      return 0;
+    unsigned int count = presses[button];
+    presses[button] = 0;
+    return count;
+  }
+};
+
 /**
  * Represents a joystick device. Allows data to be sampled from it.
  */
@@ -83,6 +157,7 @@ private:
   void openPath(std::string devicePath);
   
   int _fd;
+  int _epollFd;
   
 public:
   ~Joystick();
@@ -113,6 +188,32 @@ public:
    * from the joystick. Returns true if data is available, otherwise false.
    */
   bool sample(JoystickEvent* event);
+
+  /**
+   * Reads at once up to maxEvents events from the joystick, without blocking.
+   * Returns the number of events read, 0 if none is available.
+   */
+  int sampleAll(JoystickEvent* events, int maxEvents);
+
+  /**
+   * Reads all the pending events, in batches, and folds them into state,
+   * so that a slow reader always gets the latest position of the axes.
+   * Returns the number of events read.
+   */
+  int readState(JoystickState* state);
+
+  /**
+   * Waits with epoll until an event is available, or timeoutMs
+   * milliseconds (-1 for no timeout). Returns true if an event is available,
+   * false on timeout or error. If the joystick was unplugged, it is closed
+   * and isFound() returns false.
+   */
+  bool waitForEvents(int timeoutMs);
+
+  /**
+   * The file descriptor of the device, to add it to an event loop.
+   */
+  int getFd();
 };
 
 #endif
@@ -27,13 +27,20 @@ int main(int argc, char** argv)
 
   while (true)
   {
-    // Restrict rate
-    usleep(1000);
+    // Sleep until the joystick moves
+    // Without timeout, only an error or an unplugged joystick wakes us up
+    if (!joystick.waitForEvents(-1))
+    {
+      printf("joystick lost.\n");
+      exit(1);
+    }
 
-    // Attempt to sample an event from the joystick
-    JoystickEvent event;
-    if (joystick.sample(&event))
+    // Read all the pending events at once
+    JoystickEvent events[JOYSTICK_BATCH_SIZE];
+    int count = joystick.sampleAll(events, JOYSTICK_BATCH_SIZE);
+    for (int i = 0; i < count; ++i)
     {
+      JoystickEvent& event = events[i];
       if (event.isButton())
       {
         printf("Button %u is %s\n",
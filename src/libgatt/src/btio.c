@@ -267,6 +267,18 @@ static gboolean server_cb(GIOChannel *io, GIOCondition cond,
 	return TRUE;
 }
 
+/* Attach to the thread default main context, the global one if none */
+static void io_add_watch(GIOChannel *io, GIOCondition cond, GIOFunc func,
+				gpointer user_data, GDestroyNotify destroy)
+{
+	GSource *source;
+
+	source = g_io_create_watch(io, cond);
+	g_source_set_callback(source, (GSourceFunc) func, user_data, destroy);
+	g_source_attach(source, g_main_context_get_thread_default());
+	g_source_unref(source);
+}
+
 static void server_add(GIOChannel *io, BtIOConnect connect,
 				BtIOConfirm confirm, gpointer user_data,
 				GDestroyNotify destroy)
@@ -281,8 +293,7 @@ static void server_add(GIOChannel *io, BtIOConnect connect,
 	server->destroy = destroy;
 
 	cond = G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
-	g_io_add_watch_full(io, G_PRIORITY_DEFAULT, cond, server_cb, server,
-					(GDestroyNotify) server_remove);
+	io_add_watch(io, cond, server_cb, server, (GDestroyNotify) server_remove);
 }
 
 static void connect_add(GIOChannel *io, BtIOConnect connect,
@@ -297,8 +308,7 @@ static void connect_add(GIOChannel *io, BtIOConnect connect,
 	conn->destroy = destroy;
 
 	cond = G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
-	g_io_add_watch_full(io, G_PRIORITY_DEFAULT, cond, connect_cb, conn,
-					(GDestroyNotify) connect_remove);
+	io_add_watch(io, cond, connect_cb, conn, (GDestroyNotify) connect_remove);
 }
 
 static void accept_add(GIOChannel *io, BtIOConnect connect, gpointer user_data,
@@ -313,8 +323,7 @@ static void accept_add(GIOChannel *io, BtIOConnect connect, gpointer user_data,
 	accept->destroy = destroy;
 
 	cond = G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
-	g_io_add_watch_full(io, G_PRIORITY_DEFAULT, cond, accept_cb, accept,
-					(GDestroyNotify) accept_remove);
+	io_add_watch(io, cond, accept_cb, accept, (GDestroyNotify) accept_remove);
 }
 
 static int l2cap_bind(int sock, const bdaddr_t *src, uint8_t src_type,
@@ -43,6 +43,29 @@
 
 #define GATT_TIMEOUT 30
 
+/* Default number of PDUs written per wake-up of the sender */
+#define WRITE_BUDGET_DEFAULT 16
+
+/* Number of preallocated command slots per GAttrib */
+#define COMMAND_POOL_SIZE 32
+
+struct command;
+
+/*
+ * Fixed-capacity pool of command slots, each one followed by an inline PDU
+ * buffer of the ATT MTU. Commands fall back to the heap when the pool is
+ * empty or the PDU is bigger than a slot.
+ */
+struct command_pool {
+	guint8 *slab;
+	size_t slot_size;
+	guint16 pdu_size;
+	struct command *free_slots[COMMAND_POOL_SIZE];
+	guint nfree;
+	guint hits;
+	guint misses;
+};
+
 struct _GAttrib {
 	GIOChannel *io;
 	int refs;
@@ -57,7 +80,16 @@ struct _GAttrib {
 	guint next_cmd_id;
 	GDestroyNotify destroy;
 	gpointer destroy_user_data;
+	GAttribDisconnectFunc disconnect;
+	gpointer disconnect_user_data;
+	GAttribWriteFunc write;
+	gpointer write_user_data;
 	bool stale;
+	struct command_pool pool;
+	guint write_budget;
+	guint write_wakeups;
+	guint write_pdus;
+	GMainContext *context;
 };
 
 struct command {
@@ -70,6 +102,7 @@ struct command {
 	GAttribResultFunc func;
 	gpointer user_data;
 	GDestroyNotify notify;
+	struct command_pool *pool;	/* NULL if allocated on the heap */
 };
 
 struct event {
@@ -156,11 +189,63 @@ GAttrib *g_attrib_ref(GAttrib *attrib)
 	return attrib;
 }
 
+static void command_pool_init(struct command_pool *pool, guint16 pdu_size)
+{
+	guint i;
+
+	/* Keep every slot aligned for struct command */
+	pool->slot_size = sizeof(struct command) + pdu_size;
+	pool->slot_size = (pool->slot_size + sizeof(void *) - 1) &
+							~(sizeof(void *) - 1);
+	pool->pdu_size = pdu_size;
+	pool->hits = 0;
+	pool->misses = 0;
+	pool->nfree = 0;
+
+	pool->slab = g_try_malloc(pool->slot_size * COMMAND_POOL_SIZE);
+	if (pool->slab == NULL)
+		return;
+
+	for (i = 0; i < COMMAND_POOL_SIZE; i++)
+		pool->free_slots[pool->nfree++] = (struct command *)
+					(pool->slab + i * pool->slot_size);
+}
+
+static struct command *command_new(struct _GAttrib *attrib, guint16 len)
+{
+	struct command_pool *pool = &attrib->pool;
+	struct command *c;
+
+	if (pool->nfree > 0 && len <= pool->pdu_size) {
+		c = pool->free_slots[--pool->nfree];
+		memset(c, 0, sizeof(*c));
+		c->pool = pool;
+		c->pdu = (guint8 *) (c + 1);
+		pool->hits++;
+		return c;
+	}
+
+	pool->misses++;
+
+	c = g_try_new0(struct command, 1);
+	if (c == NULL)
+		return NULL;
+
+	c->pdu = g_malloc(len);
+
+	return c;
+}
+
 static void command_destroy(struct command *cmd)
 {
 	if (cmd->notify)
 		cmd->notify(cmd->user_data);
 
+	if (cmd->pool) {
+		cmd->pool->free_slots[cmd->pool->nfree++] = cmd;
+		return;
+	}
+
 	g_free(cmd->pdu);
 	g_free(cmd);
 }
@@ -173,6 +258,50 @@ static void event_destroy(struct event *evt)
 	g_free(evt);
 }
 
+/*
+ * The sources of a GAttrib live in the main context that was the thread
+ * default when it was created, so that it can be driven by a dedicated
+ * I/O thread. Without thread default context, this is the global one.
+ */
+static guint attrib_add_watch(struct _GAttrib *attrib, GIOCondition cond,
+				GIOFunc func, gpointer user_data,
+				GDestroyNotify notify)
+{
+	GSource *source;
+	guint id;
+
+	source = g_io_create_watch(attrib->io, cond);
+	g_source_set_callback(source, (GSourceFunc) func, user_data, notify);
+	id = g_source_attach(source, attrib->context);
+	g_source_unref(source);
+
+	return id;
+}
+
+static guint attrib_add_timeout_seconds(struct _GAttrib *attrib,
+					guint interval, GSourceFunc func,
+					gpointer user_data)
+{
+	GSource *source;
+	guint id;
+
+	source = g_timeout_source_new_seconds(interval);
+	g_source_set_callback(source, func, user_data, NULL);
+	id = g_source_attach(source, attrib->context);
+	g_source_unref(source);
+
+	return id;
+}
+
+static void attrib_remove_source(struct _GAttrib *attrib, guint id)
+{
+	GSource *source;
+
+	source = g_main_context_find_source_by_id(attrib->context, id);
+	if (source)
+		g_source_destroy(source);
+}
+
 static void attrib_destroy(GAttrib *attrib)
 {
 	GSList *l;
@@ -197,19 +326,23 @@ static void attrib_destroy(GAttrib *attrib)
 	attrib->events = NULL;
 
 	if (attrib->timeout_watch > 0)
-		g_source_remove(attrib->timeout_watch);
+		attrib_remove_source(attrib, attrib->timeout_watch);
 
 	if (attrib->write_watch > 0)
-		g_source_remove(attrib->write_watch);
+		attrib_remove_source(attrib, attrib->write_watch);
 
 	if (attrib->read_watch > 0)
-		g_source_remove(attrib->read_watch);
+		attrib_remove_source(attrib, attrib->read_watch);
 
 	if (attrib->io)
 		g_io_channel_unref(attrib->io);
 
 	g_free(attrib->buf);
 
+	g_free(attrib->pool.slab);
+
+	g_main_context_unref(attrib->context);
+
 	if (attrib->destroy)
 		attrib->destroy(attrib->destroy_user_data);
 
@@ -251,6 +384,30 @@ gboolean g_attrib_set_destroy_function(GAttrib *attrib,
 	return TRUE;
 }
 
+gboolean g_attrib_set_disconnect_function(GAttrib *attrib,
+		GAttribDisconnectFunc disconnect, gpointer user_data)
+{
+	if (attrib == NULL)
+		return FALSE;
+
+	attrib->disconnect = disconnect;
+	attrib->disconnect_user_data = user_data;
+
+	return TRUE;
+}
+
+gboolean g_attrib_set_write_function(GAttrib *attrib,
+		GAttribWriteFunc write, gpointer user_data)
+{
+	if (attrib == NULL)
+		return FALSE;
+
+	attrib->write = write;
+	attrib->write_user_data = user_data;
+
+	return TRUE;
+}
+
 static gboolean disconnect_timeout(gpointer data)
 {
 	struct _GAttrib *attrib = data;
@@ -290,6 +447,7 @@ static gboolean can_write_data(GIOChannel *io, GIOCondition cond,
 	gsize len;
 	GIOStatus iostat;
 	GQueue *queue;
+	guint budget;
 
 	if (attrib->stale)
 		return FALSE;
@@ -297,47 +455,68 @@ static gboolean can_write_data(GIOChannel *io, GIOCondition cond,
 	if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL))
 		return FALSE;
 
-	queue = attrib->responses;
-	cmd = g_queue_peek_head(queue);
-	if (cmd == NULL) {
-		queue = attrib->requests;
-		cmd = g_queue_peek_head(queue);
-	}
-	if (cmd == NULL)
-		return FALSE;
+	attrib->write_wakeups++;
 
 	/*
-	 * Verify that we didn't already send this command. This can only
-	 * happen with elementes from attrib->requests.
+	 * Drain the commands expecting no answer while the socket accepts
+	 * them, up to the write budget, instead of one per main loop
+	 * iteration.
 	 */
-	if (cmd->sent)
-		return FALSE;
-
-	iostat = g_io_channel_write_chars(io, (char *) cmd->pdu, cmd->len,
-								&len, &gerr);
-	if (iostat != G_IO_STATUS_NORMAL) {
-		if (gerr) {
-			error("%s", gerr->message);
-			g_error_free(gerr);
+	for (budget = attrib->write_budget; budget > 0; budget--) {
+		queue = attrib->responses;
+		cmd = g_queue_peek_head(queue);
+		if (cmd == NULL) {
+			queue = attrib->requests;
+			cmd = g_queue_peek_head(queue);
 		}
+		if (cmd == NULL)
+			return FALSE;
 
-		return FALSE;
-	}
+		/*
+		 * Verify that we didn't already send this command. This can
+		 * only happen with elementes from attrib->requests.
+		 */
+		if (cmd->sent)
+			return FALSE;
 
-	if (cmd->expected == 0) {
-		g_queue_pop_head(queue);
-		command_destroy(cmd);
+		iostat = g_io_channel_write_chars(io, (char *) cmd->pdu,
+							cmd->len, &len, &gerr);
+		if (iostat == G_IO_STATUS_AGAIN)
+			/* Socket full, wait until it is writable again */
+			return TRUE;
 
-		return TRUE;
-	}
+		if (iostat != G_IO_STATUS_NORMAL) {
+			if (gerr) {
+				error("%s", gerr->message);
+				g_error_free(gerr);
+			}
+
+			return FALSE;
+		}
+
+		attrib->write_pdus++;
 
-	cmd->sent = true;
+		if (attrib->write)
+			attrib->write(cmd->pdu, cmd->len, attrib->write_user_data);
 
-	if (attrib->timeout_watch == 0)
-		attrib->timeout_watch = g_timeout_add_seconds(GATT_TIMEOUT,
+		if (cmd->expected != 0) {
+			cmd->sent = true;
+
+			if (attrib->timeout_watch == 0)
+				attrib->timeout_watch =
+					attrib_add_timeout_seconds(attrib,
+						GATT_TIMEOUT,
 						disconnect_timeout, attrib);
 
-	return FALSE;
+			return FALSE;
+		}
+
+		g_queue_pop_head(queue);
+		command_destroy(cmd);
+	}
+
+	/* Budget exhausted, keep the watch for the next iteration */
+	return TRUE;
 }
 
 static void destroy_sender(gpointer data)
@@ -354,8 +533,7 @@ static void wake_up_sender(struct _GAttrib *attrib)
 		return;
 
 	attrib = g_attrib_ref(attrib);
-	attrib->write_watch = g_io_add_watch_full(attrib->io,
-				G_PRIORITY_DEFAULT, G_IO_OUT,
+	attrib->write_watch = attrib_add_watch(attrib, G_IO_OUT,
 				can_write_data, attrib, destroy_sender);
 }
 
@@ -397,6 +575,9 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 
 	if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)) {
 		attrib->read_watch = 0;
+		/* last access to attrib: the callback may release it */
+		if (attrib->disconnect)
+			attrib->disconnect(attrib->disconnect_user_data);
 		return FALSE;
 	}
 
@@ -420,7 +601,7 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 		return TRUE;
 
 	if (attrib->timeout_watch > 0) {
-		g_source_remove(attrib->timeout_watch);
+		attrib_remove_source(attrib, attrib->timeout_watch);
 		attrib->timeout_watch = 0;
 	}
 
@@ -459,15 +640,10 @@ done:
 
 GAttrib *g_attrib_new(GIOChannel *io)
 {
-	struct _GAttrib *attrib;
 	uint16_t imtu;
-	uint16_t att_mtu;
 	uint16_t cid;
 	GError *gerr = NULL;
 
-	g_io_channel_set_encoding(io, NULL, NULL);
-	g_io_channel_set_buffered(io, FALSE);
-
 	bt_io_get(io, &gerr, BT_IO_OPT_IMTU, &imtu,
 				BT_IO_OPT_CID, &cid, BT_IO_OPT_INVALID);
 	if (gerr) {
@@ -476,22 +652,35 @@ GAttrib *g_attrib_new(GIOChannel *io)
 		return NULL;
 	}
 
+	return g_attrib_new_with_mtu(io, (cid == ATT_CID) ? ATT_DEFAULT_LE_MTU : imtu);
+}
+
+GAttrib *g_attrib_new_with_mtu(GIOChannel *io, uint16_t att_mtu)
+{
+	struct _GAttrib *attrib;
+
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+
 	attrib = g_try_new0(struct _GAttrib, 1);
 	if (attrib == NULL)
 		return NULL;
 
-	att_mtu = (cid == ATT_CID) ? ATT_DEFAULT_LE_MTU : imtu;
-
 	attrib->buf = g_malloc0(att_mtu);
 	attrib->buflen = att_mtu;
 
+	command_pool_init(&attrib->pool, att_mtu);
+
+	attrib->write_budget = WRITE_BUDGET_DEFAULT;
+
+	attrib->context = g_main_context_ref_thread_default();
 	attrib->io = g_io_channel_ref(io);
 	attrib->requests = g_queue_new();
 	attrib->responses = g_queue_new();
 
-	attrib->read_watch = g_io_add_watch(attrib->io,
+	attrib->read_watch = attrib_add_watch(attrib,
 			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-			received_data, attrib);
+			received_data, attrib, NULL);
 
 	return g_attrib_ref(attrib);
 }
@@ -507,7 +696,7 @@ guint g_attrib_send(GAttrib *attrib, guint id, const guint8 *pdu, guint16 len,
 	if (attrib->stale)
 		return 0;
 
-	c = g_try_new0(struct command, 1);
+	c = command_new(attrib, len);
 	if (c == NULL)
 		return 0;
 
@@ -515,7 +704,6 @@ guint g_attrib_send(GAttrib *attrib, guint id, const guint8 *pdu, guint16 len,
 
 	c->opcode = opcode;
 	c->expected = opcode2expected(opcode);
-	c->pdu = g_malloc(len);
 	memcpy(c->pdu, pdu, len);
 	c->len = len;
 	c->func = func;
@@ -594,6 +782,31 @@ gboolean g_attrib_cancel(GAttrib *attrib, guint id)
 	return TRUE;
 }
 
+gboolean g_attrib_replace(GAttrib *attrib, guint id, const guint8 *pdu,
+								guint16 len)
+{
+	GList *l;
+	struct command *cmd;
+
+	if (attrib == NULL || attrib->stale || attrib->requests == NULL)
+		return FALSE;
+
+	l = g_queue_find_custom(attrib->requests, GUINT_TO_POINTER(id),
+							command_cmp_by_id);
+	if (l == NULL)
+		return FALSE;
+
+	cmd = l->data;
+
+	/* Too late if it left the socket, or does not fit in place */
+	if (cmd->sent || cmd->len != len)
+		return FALSE;
+
+	memcpy(cmd->pdu, pdu, len);
+
+	return TRUE;
+}
+
 static gboolean cancel_all_per_queue(GQueue *queue)
 {
 	struct command *c, *head = NULL;
@@ -651,6 +864,46 @@ uint8_t *g_attrib_get_buffer(GAttrib *attrib, size_t *len)
 	return attrib->buf;
 }
 
+gboolean g_attrib_get_pool_stats(GAttrib *attrib, guint *hits,
+							guint *misses)
+{
+	if (attrib == NULL)
+		return FALSE;
+
+	if (hits)
+		*hits = attrib->pool.hits;
+
+	if (misses)
+		*misses = attrib->pool.misses;
+
+	return TRUE;
+}
+
+gboolean g_attrib_set_write_budget(GAttrib *attrib, guint budget)
+{
+	if (attrib == NULL || budget == 0)
+		return FALSE;
+
+	attrib->write_budget = budget;
+
+	return TRUE;
+}
+
+gboolean g_attrib_get_write_stats(GAttrib *attrib, guint *wakeups,
+								guint *pdus)
+{
+	if (attrib == NULL)
+		return FALSE;
+
+	if (wakeups)
+		*wakeups = attrib->write_wakeups;
+
+	if (pdus)
+		*pdus = attrib->write_pdus;
+
+	return TRUE;
+}
+
 gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu)
 {
 	if (mtu < ATT_DEFAULT_LE_MTU)
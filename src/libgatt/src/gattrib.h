@@ -38,11 +38,16 @@ typedef struct _GAttrib GAttrib;
 typedef void (*GAttribResultFunc) (guint8 status, const guint8 *pdu,
 					guint16 len, gpointer user_data);
 typedef void (*GAttribDisconnectFunc)(gpointer user_data);
+typedef void (*GAttribWriteFunc)(const guint8 *pdu, guint16 len,
+							gpointer user_data);
 typedef void (*GAttribDebugFunc)(const char *str, gpointer user_data);
 typedef void (*GAttribNotifyFunc)(const guint8 *pdu, guint16 len,
 							gpointer user_data);
 
 GAttrib *g_attrib_new(GIOChannel *io);
+/* for channels that are not Bluetooth sockets, such as a socketpair:
+ * does not query the socket options, one PDU per read() */
+GAttrib *g_attrib_new_with_mtu(GIOChannel *io, uint16_t att_mtu);
 GAttrib *g_attrib_ref(GAttrib *attrib);
 void g_attrib_unref(GAttrib *attrib);
 
@@ -51,11 +56,23 @@ GIOChannel *g_attrib_get_channel(GAttrib *attrib);
 gboolean g_attrib_set_destroy_function(GAttrib *attrib,
 		GDestroyNotify destroy, gpointer user_data);
 
+/* called once when the link is lost, the GAttrib can then be released */
+gboolean g_attrib_set_disconnect_function(GAttrib *attrib,
+		GAttribDisconnectFunc disconnect, gpointer user_data);
+
+/* called each time a PDU is written to the socket */
+gboolean g_attrib_set_write_function(GAttrib *attrib,
+		GAttribWriteFunc write, gpointer user_data);
+
 guint g_attrib_send(GAttrib *attrib, guint id, const guint8 *pdu, guint16 len,
 			GAttribResultFunc func, gpointer user_data,
 			GDestroyNotify notify);
 
 gboolean g_attrib_cancel(GAttrib *attrib, guint id);
+/* Overwrite the PDU of a command still waiting in the queue, keeping its
+ * position. Returns FALSE if it was already sent or has another length. */
+gboolean g_attrib_replace(GAttrib *attrib, guint id, const guint8 *pdu,
+								guint16 len);
 gboolean g_attrib_cancel_all(GAttrib *attrib);
 
 gboolean g_attrib_set_debug(GAttrib *attrib,
@@ -70,6 +87,16 @@ gboolean g_attrib_is_encrypted(GAttrib *attrib);
 uint8_t *g_attrib_get_buffer(GAttrib *attrib, size_t *len);
 gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu);
 
+/* Commands served by the preallocated pool (hits) or by the heap (misses) */
+gboolean g_attrib_get_pool_stats(GAttrib *attrib, guint *hits,
+							guint *misses);
+
+/* Maximum number of PDUs written each time the socket becomes writable */
+gboolean g_attrib_set_write_budget(GAttrib *attrib, guint budget);
+/* Number of sender wake-ups, and of PDUs written during them */
+gboolean g_attrib_get_write_stats(GAttrib *attrib, guint *wakeups,
+								guint *pdus);
+
 gboolean g_attrib_unregister(GAttrib *attrib, guint id);
 gboolean g_attrib_unregister_all(GAttrib *attrib);
 
@@ -29,133 +29,144 @@ static const int ERROR = -100;
 
 ////////////////////////////////////////////////////////////////////////////////
 typedef int MipCommand;
-static const MipCommand CMD_PLAY_SOUND=0x06;
-static const MipCommand CMD_SET_MIP_POSITION=0x08;
-static const MipCommand CMD_DISTANCE_DRIVE=0x70;
-static const MipCommand CMD_DRIVE_FORWARD_WITH_TIME=0x71;
-static const MipCommand CMD_DRIVE_BACKWARD_WITH_TIME=0x72;
-static const MipCommand CMD_TURN_LEFT_BY_ANGLE=0x73;
-static const MipCommand CMD_TURN_RIGHT_BY_ANGLE=0x74;
-static const MipCommand CMD_CONTINUOUS_DRIVE=0x78;
-static const MipCommand CMD_SET_GAME_MODE=0x76;
-static const MipCommand CMD_GET_CURRENT_MIP_GAME_MODE=0x82;
-static const MipCommand CMD_CURRENT_MIP_GAME_MODE=0x82;
-static const MipCommand CMD_STOP=0x77;
-static const MipCommand CMD_REQUEST_MIP_STATUS=0x79;
-static const MipCommand CMD_MIP_STATUS=0x79;
-static const MipCommand CMD_MIP_GET_UP=0x23;
-static const MipCommand CMD_REQUEST_WEIGHT_UPDATE=0x81;
-static const MipCommand CMD_WEIGHT_UPDATE=0x81;
-static const MipCommand CMD_REQUEST_CHEST_LED=0x83;
-static const MipCommand CMD_CHEST_LED=0x83;
-static const MipCommand CMD_SET_CHEST_LED=0x84;
-static const MipCommand CMD_FLASH_CHEST_LED=0x89;
-static const MipCommand CMD_SET_HEAD_LED=0x8A;
-static const MipCommand CMD_REQUEST_HEAD_LED=0x8B;
-static const MipCommand CMD_HEAD_LED=0x8B;
-static const MipCommand CMD_READ_ODOMETER=0x85;
-static const MipCommand CMD_ODOMETER_READING=0x85;
-static const MipCommand CMD_REST_ODOMETER=0x86;
-static const MipCommand CMD_GESTURE_DETECT=0x0A;
-static const MipCommand CMD_SET_GESTURE_OR_RADAR_MODE=0x0C;
-static const MipCommand CMD_GET_RADAR_MODE=0x0D;
-static const MipCommand CMD_RADAR_MODE_STATUS=0x0D;
-static const MipCommand CMD_RADAR_RESPONSE=0x0C;
-static const MipCommand CMD_MIP_DETECTION_MODE=0x0E;
-static const MipCommand CMD_REQUEST_MIP_DETECTION_MODE=0x0F;
-static const MipCommand CMD_MIP_DETECTION_STATUS=0x0F;
-static const MipCommand CMD_MIP_DETECTED=0x04;
-static const MipCommand CMD_SHAKE_DETECTED=0x1A;
-static const MipCommand CMD_IR_REMOTE_CONTROL_ENABLED=0x10;
-static const MipCommand CMD_REQUEST_IR_CONTROL_ENABLED=0x11;
-static const MipCommand CMD_IR_CONTROL_STATUS=0x11;
-static const MipCommand CMD_SLEEP=0xFA;
-static const MipCommand CMD_DISCONNECT_APP=0xFE;
-static const MipCommand CMD_FORCE_BLE_DISCONNECT=0xFC;
-static const MipCommand CMD_SET_USER_DATA=0x12;
-static const MipCommand CMD_GET_USER_OR_OTHER_EEPROM_DATA=0x13;
-static const MipCommand CMD_MIP_USER_OR_OTHER_EEPROM_DATA=0x13;
-static const MipCommand CMD_GET_MIP_SOFTWARE_VERSION=0x14;
-static const MipCommand CMD_MIP_SOFTWARE_VERSION=0x14;
-static const MipCommand CMD_GET_MIP_HARDWARE_INFO=0x19;
-static const MipCommand CMD_MIP_HARDWARE_INFO=0x19;
-static const MipCommand CMD_SET_MIP_VOLUME=0x15;
-static const MipCommand CMD_GET_MIP_VOLUME=0x16;
-static const MipCommand CMD_MIP_VOLUME=0x16;
-static const MipCommand CMD_SEND_IR_DONGLE_CODE=0x8C;
-static const MipCommand CMD_RECEIVE_IR_DONGLE_CODE=0x03;
-static const MipCommand CMD_CLAP_TIMES=0x1D;
-static const MipCommand CMD_CLAP_ENABLED=0x1E;
-static const MipCommand CMD_REQUEST_CLAP_ENABLED=0x1F;
-static const MipCommand CMD_CLAP_STATUS=0x1F;
-static const MipCommand CMD_DELAY_TIME_BETWEEN_TWO_CLAPS=0x20;
 
-inline static const char* cmd2str(const MipCommand cmd) {
-  switch (cmd) {
-    case CMD_PLAY_SOUND: return "PLAY_SOUND";
-    case CMD_SET_MIP_POSITION: return "SET_MIP_POSITION";
-    case CMD_DISTANCE_DRIVE: return "DISTANCE_DRIVE";
-    case CMD_DRIVE_FORWARD_WITH_TIME: return "DRIVE_FORWARD_WITH_TIME";
-    case CMD_DRIVE_BACKWARD_WITH_TIME: return "DRIVE_BACKWARD_WITH_TIME";
-    case CMD_TURN_LEFT_BY_ANGLE: return "TURN_LEFT_BY_ANGLE";
-    case CMD_TURN_RIGHT_BY_ANGLE: return "TURN_RIGHT_BY_ANGLE";
-    case CMD_CONTINUOUS_DRIVE: return "CONTINUOUS_DRIVE";
-    case CMD_SET_GAME_MODE: return "SET_GAME_MODE";
-    //case CMD_GET_CURRENT_MIP_GAME_MODE: return "GET_CURRENT_MIP_GAME_MODE";
-    case CMD_CURRENT_MIP_GAME_MODE: return "CURRENT_MIP_GAME_MODE";
-    case CMD_STOP: return "STOP";
-    //case CMD_REQUEST_MIP_STATUS: return "REQUEST_MIP_STATUS";
-    case CMD_MIP_STATUS: return "MIP_STATUS";
-    case CMD_MIP_GET_UP: return "MIP_GET_UP";
-    //case CMD_REQUEST_WEIGHT_UPDATE: return "REQUEST_WEIGHT_UPDATE";
-    case CMD_WEIGHT_UPDATE: return "WEIGHT_UPDATE";
-    //case CMD_REQUEST_CHEST_LED: return "REQUEST_CHEST_LED";
-    case CMD_CHEST_LED: return "CHEST_LED";
-    case CMD_SET_CHEST_LED: return "SET_CHEST_LED";
-    case CMD_FLASH_CHEST_LED: return "FLASH_CHEST_LED";
-    case CMD_SET_HEAD_LED: return "SET_HEAD_LED";
-    //case CMD_REQUEST_HEAD_LED: return "REQUEST_HEAD_LED";
-    case CMD_HEAD_LED: return "HEAD_LED";
-    //case CMD_READ_ODOMETER: return "READ_ODOMETER";
-    case CMD_ODOMETER_READING: return "ODOMETER_READING";
-    case CMD_REST_ODOMETER: return "REST_ODOMETER";
-    case CMD_GESTURE_DETECT: return "GESTURE_DETECT";
-    //case CMD_SET_GESTURE_OR_RADAR_MODE: return "SET_GESTURE_OR_RADAR_MODE";
-    //case CMD_GET_RADAR_MODE: return "GET_RADAR_MODE";
-    case CMD_RADAR_MODE_STATUS: return "RADAR_MODE_STATUS";
-    case CMD_RADAR_RESPONSE: return "RADAR_RESPONSE";
-    case CMD_MIP_DETECTION_MODE: return "MIP_DETECTION_MODE";
-    //case CMD_REQUEST_MIP_DETECTION_MODE: return "REQUEST_MIP_DETECTION_MODE";
-    case CMD_MIP_DETECTION_STATUS: return "MIP_DETECTION_STATUS";
-    case CMD_MIP_DETECTED: return "MIP_DETECTED";
-    case CMD_SHAKE_DETECTED: return "SHAKE_DETECTED";
-    case CMD_IR_REMOTE_CONTROL_ENABLED: return "IR_REMOTE_CONTROL_ENABLED";
-    //case CMD_REQUEST_IR_CONTROL_ENABLED: return "REQUEST_IR_CONTROL_ENABLED";
-    case CMD_IR_CONTROL_STATUS: return "IR_CONTROL_STATUS";
-    case CMD_SLEEP: return "SLEEP";
-    case CMD_DISCONNECT_APP: return "DISCONNECT_APP";
-    case CMD_FORCE_BLE_DISCONNECT: return "FORCE_BLE_DISCONNECT";
-    case CMD_SET_USER_DATA: return "SET_USER_DATA";
-    //case CMD_GET_USER_OR_OTHER_EEPROM_DATA: return "GET_USER_OR_OTHER_EEPROM_DATA";
-    case CMD_MIP_USER_OR_OTHER_EEPROM_DATA: return "MIP_USER_OR_OTHER_EEPROM_DATA";
-    //case CMD_GET_MIP_SOFTWARE_VERSION: return "GET_MIP_SOFTWARE_VERSION";
-    case CMD_MIP_SOFTWARE_VERSION: return "MIP_SOFTWARE_VERSION";
-    //case CMD_GET_MIP_HARDWARE_INFO: return "GET_MIP_HARDWARE_INFO";
-    case CMD_MIP_HARDWARE_INFO: return "MIP_HARDWARE_INFO";
-    case CMD_SET_MIP_VOLUME: return "MIP_VOLUME";
-    //case CMD_GET_MIP_VOLUME: return "GET_MIP_VOLUME";
-    case CMD_MIP_VOLUME: return "MIP_VOLUME";
-    case CMD_SEND_IR_DONGLE_CODE: return "SEND_IR_DONGLE_CODE";
-    case CMD_RECEIVE_IR_DONGLE_CODE: return "RECEIVE_IR_DONGLE_CODE";
-    case CMD_CLAP_TIMES: return "CLAP_TIMES";
-    case CMD_CLAP_ENABLED: return "CLAP_ENABLED";
-    //case CMD_REQUEST_CLAP_ENABLED: return "REQUEST_CLAP_ENABLED";
-    case CMD_CLAP_STATUS: return "CLAP_STATUS";
-    case CMD_DELAY_TIME_BETWEEN_TWO_CLAPS: return "DELAY_TIME_BETWEEN_TWO_CLAPS";
-    case ERROR:
-    default:
-      return "ERROR";
+//! request_len or response_len of a command that is never sent or never received
+static const int MIP_NO_PAYLOAD = -1;
+//! request_len or response_len of a command with a variable payload
+static const int MIP_ANY_LENGTH = -2;
+
+/*! The schema of all the commands understood by the robot.
+ *  Each command is described by one line, everything else is generated from it:
+ *  the CMD_xxx constants, the MipCommandInfo lookup table, cmd2str(),
+ *  and, in gattmip.h, the checks of the typed encoders and decoders.
+ *
+ *  X(NAME, OPCODE, REQUEST_LEN, RESPONSE_LEN, FIELD_BYTES, SCALE, OFFSET, LATEST_WINS)
+ *  REQUEST_LEN:  number of parameter bytes sent to the robot
+ *  RESPONSE_LEN: number of values in the notification sent by the robot
+ *  FIELD_BYTES:  number of leading response values forming, big-endian,
+ *                the main field of the response, 0 if none
+ *  SCALE, OFFSET: physical value of the main field = SCALE * raw + OFFSET
+ *  LATEST_WINS:  1 for the setpoint commands, such as the motion ones:
+ *                a newer command may overwrite an older one not sent yet
+ *
+ *  When a request and its answer share the same opcode, they share one line,
+ *  named after the answer - the request name is an alias, defined below.
+ */
+#define MIP_COMMAND_TABLE(X) \
+  X(PLAY_SOUND,                    0x06, 1,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(SET_MIP_POSITION,              0x08, 1,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(DISTANCE_DRIVE,                0x70, 5,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(DRIVE_FORWARD_WITH_TIME,       0x71, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(DRIVE_BACKWARD_WITH_TIME,      0x72, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(TURN_LEFT_BY_ANGLE,            0x73, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(TURN_RIGHT_BY_ANGLE,           0x74, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(CONTINUOUS_DRIVE,              0x78, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 1) \
+  X(SET_GAME_MODE,                 0x76, 1,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(CURRENT_MIP_GAME_MODE,         0x82, 0,              1,              1, 1, 0, 0) \
+  X(STOP,                          0x77, 0,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  /* 0x4D = 77 = 4.0V, 0x7C = 124 = 6.4V */ \
+  X(MIP_STATUS,                    0x79, 0,              2,              1, 2.4/47, 4.0 - 77 * 2.4/47, 0) \
+  X(MIP_GET_UP,                    0x23, 1,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(WEIGHT_UPDATE,                 0x81, 0,              1,              1, 1, 0, 0) \
+  X(CHEST_LED,                     0x83, 0,              5,              0, 1, 0, 0) \
+  X(SET_CHEST_LED,                 0x84, 3,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(FLASH_CHEST_LED,               0x89, 5,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(SET_HEAD_LED,                  0x8A, 4,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(HEAD_LED,                      0x8B, 0,              4,              0, 1, 0, 0) \
+  /* 1 cm = 48.5 units */ \
+  X(ODOMETER_READING,              0x85, 0,              4,              4, .01 / 48.5, 0, 0) \
+  X(REST_ODOMETER,                 0x86, 0,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(GESTURE_DETECT,                0x0A, MIP_NO_PAYLOAD, 1,              1, 1, 0, 0) \
+  X(RADAR_RESPONSE,                0x0C, 1,              1,              1, 1, 0, 0) \
+  X(RADAR_MODE_STATUS,             0x0D, 0,              1,              1, 1, 0, 0) \
+  X(MIP_DETECTION_MODE,            0x0E, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(MIP_DETECTION_STATUS,          0x0F, 0,              2,              1, 1, 0, 0) \
+  X(MIP_DETECTED,                  0x04, MIP_NO_PAYLOAD, 1,              1, 1, 0, 0) \
+  X(SHAKE_DETECTED,                0x1A, MIP_NO_PAYLOAD, 1,              1, 1, 0, 0) \
+  X(IR_REMOTE_CONTROL_ENABLED,     0x10, 1,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(IR_CONTROL_STATUS,             0x11, 0,              1,              1, 1, 0, 0) \
+  X(SLEEP,                         0xFA, 0,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(DISCONNECT_APP,                0xFE, 0,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(FORCE_BLE_DISCONNECT,          0xFC, 0,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(SET_USER_DATA,                 0x12, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(MIP_USER_OR_OTHER_EEPROM_DATA, 0x13, 1,              2,              0, 1, 0, 0) \
+  X(MIP_SOFTWARE_VERSION,          0x14, 0,              4,              0, 1, 0, 0) \
+  X(MIP_HARDWARE_INFO,             0x19, 0,              2,              0, 1, 0, 0) \
+  X(SET_MIP_VOLUME,                0x15, 1,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(MIP_VOLUME,                    0x16, 0,              1,              1, 1, 0, 0) \
+  X(SEND_IR_DONGLE_CODE,           0x8C, MIP_ANY_LENGTH, MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(RECEIVE_IR_DONGLE_CODE,        0x03, MIP_NO_PAYLOAD, MIP_ANY_LENGTH, 0, 1, 0, 0) \
+  X(CLAP_TIMES,                    0x1D, MIP_NO_PAYLOAD, 1,              1, 1, 0, 0) \
+  X(CLAP_ENABLED,                  0x1E, 1,              MIP_NO_PAYLOAD, 0, 1, 0, 0) \
+  X(CLAP_STATUS,                   0x1F, 0,              2,              1, 1, 0, 0) \
+  X(DELAY_TIME_BETWEEN_TWO_CLAPS,  0x20, 2,              MIP_NO_PAYLOAD, 0, 1, 0, 0)
+
+#define MIP_COMMAND_CONSTANT(name, opcode, request_len, response_len, field_bytes, scale, offset, latest_wins) \
+  static const MipCommand CMD_##name = opcode;
+MIP_COMMAND_TABLE(MIP_COMMAND_CONSTANT)
+#undef MIP_COMMAND_CONSTANT
+
+// requests sharing the opcode of their answer
+static const MipCommand CMD_GET_CURRENT_MIP_GAME_MODE = CMD_CURRENT_MIP_GAME_MODE;
+static const MipCommand CMD_REQUEST_MIP_STATUS = CMD_MIP_STATUS;
+static const MipCommand CMD_REQUEST_WEIGHT_UPDATE = CMD_WEIGHT_UPDATE;
+static const MipCommand CMD_REQUEST_CHEST_LED = CMD_CHEST_LED;
+static const MipCommand CMD_REQUEST_HEAD_LED = CMD_HEAD_LED;
+static const MipCommand CMD_READ_ODOMETER = CMD_ODOMETER_READING;
+static const MipCommand CMD_SET_GESTURE_OR_RADAR_MODE = CMD_RADAR_RESPONSE;
+static const MipCommand CMD_GET_RADAR_MODE = CMD_RADAR_MODE_STATUS;
+static const MipCommand CMD_REQUEST_MIP_DETECTION_MODE = CMD_MIP_DETECTION_STATUS;
+static const MipCommand CMD_REQUEST_IR_CONTROL_ENABLED = CMD_IR_CONTROL_STATUS;
+static const MipCommand CMD_GET_USER_OR_OTHER_EEPROM_DATA = CMD_MIP_USER_OR_OTHER_EEPROM_DATA;
+static const MipCommand CMD_GET_MIP_SOFTWARE_VERSION = CMD_MIP_SOFTWARE_VERSION;
+static const MipCommand CMD_GET_MIP_HARDWARE_INFO = CMD_MIP_HARDWARE_INFO;
+static const MipCommand CMD_GET_MIP_VOLUME = CMD_MIP_VOLUME;
+static const MipCommand CMD_REQUEST_CLAP_ENABLED = CMD_CLAP_STATUS;
+
+//! the description of a command, \see MIP_COMMAND_TABLE
+struct MipCommandInfo {
+  MipCommand opcode;
+  const char* name;
+  int request_len, response_len;
+  unsigned int field_bytes;
+  double scale, offset;
+  bool latest_wins;
+
+  //! \return the physical value of the main field of a response
+  template<class Values>
+  inline double field_value(const Values & values) const {
+    double raw = 0;
+    for (unsigned int i = 0; i < field_bytes; ++i)
+      raw = raw * 256 + values[i];
+    return scale * raw + offset;
+  }
+}; // end struct MipCommandInfo
+
+//! the MipCommandInfo of all opcodes, built at compile time from MIP_COMMAND_TABLE
+struct MipCommandTable {
+  MipCommandInfo by_opcode[256];
+  constexpr MipCommandTable() : by_opcode() {
+    for (unsigned int i = 0; i < 256; ++i)
+      by_opcode[i] = MipCommandInfo { ERROR, "ERROR", MIP_NO_PAYLOAD, MIP_NO_PAYLOAD,
+                                      0, 1, 0, false };
+#define MIP_COMMAND_INFO(name, opcode, request_len, response_len, field_bytes, scale, offset, latest_wins) \
+    by_opcode[opcode] = MipCommandInfo { opcode, #name, request_len, response_len, \
+                                         field_bytes, scale, offset, latest_wins };
+    MIP_COMMAND_TABLE(MIP_COMMAND_INFO)
+#undef MIP_COMMAND_INFO
   }
+}; // end struct MipCommandTable
+
+static constexpr MipCommandTable MIP_COMMANDS;
+
+//! \return the description of a command, in O(1). Its opcode is ERROR if unknown.
+inline static constexpr const MipCommandInfo & mip_command_info(const MipCommand cmd) {
+  return MIP_COMMANDS.by_opcode[(unsigned int) cmd < 256 ? cmd : 0];
+}
+
+//! \return the name of a command, "ERROR" if unknown
+inline static const char* cmd2str(const MipCommand cmd) {
+  return mip_command_info(cmd).name;
 } // end cmd2str()
 
 ////////////////////////////////////////////////////////////////////////////////
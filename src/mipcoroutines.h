@@ -0,0 +1,309 @@
+/*!
+  \file        mipcoroutines.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A C++20 coroutine interface for the MiP robot.
+
+A behaviour is a function returning a MipTask,
+that co_await's the answers of the robot instead of sleeping and polling:
+\code
+MipTask watch_battery(AwaitableMip & robot) {
+  while (true) {
+    double voltage = co_await robot.battery_voltage();
+    if (voltage < 4.5)
+      robot.mip().play_sound(40);
+    co_await robot.sleep(5000);
+  }
+}
+\endcode
+The coroutines are resumed by the GLib context of the robot,
+so that hundreds of behaviours can run concurrently on a single thread,
+the one running g_main_loop_run() or run_tasks().
+The awaited answers throw MipTimeoutError when the robot does not answer in time.
+
+Needs a C++20 compiler, for instance -std=gnu++20.
+ */
+#ifndef MIPCOROUTINES_H
+#define MIPCOROUTINES_H
+
+#include "gattmip.h"
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <vector>
+
+//! a behaviour of a robot, started as soon as it is called
+class MipTask {
+public:
+  struct promise_type {
+    std::exception_ptr exception;
+    MipTask get_return_object() {
+      return MipTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    //! keep the frame after the end, so that done() can be checked
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  }; // end struct promise_type
+
+  MipTask() {}
+  explicit MipTask(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+  MipTask(MipTask && other) : _handle(other._handle) { other._handle = nullptr; }
+  MipTask & operator = (MipTask && other) {
+    if (this != &other) {
+      destroy();
+      _handle = other._handle;
+      other._handle = nullptr;
+    }
+    return *this;
+  }
+  MipTask(const MipTask &) = delete;
+  MipTask & operator = (const MipTask &) = delete;
+  //! destroy a task only once done(), or once its robots are not dispatched anymore
+  ~MipTask() { destroy(); }
+
+  //! \return true if the behaviour returned or threw
+  inline bool done() const { return !_handle || _handle.done(); }
+  //! throw again the exception that ended the behaviour, if any
+  inline void rethrow_if_failed() const {
+    if (_handle && _handle.promise().exception)
+      std::rethrow_exception(_handle.promise().exception);
+  }
+
+private:
+  inline void destroy() {
+    if (_handle)
+      _handle.destroy();
+    _handle = nullptr;
+  }
+
+  std::coroutine_handle<promise_type> _handle;
+}; // end class MipTask
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*! The awaitable facade of a Mip.
+ *  Each awaiter registers a callback in the GLib context of the robot,
+ *  the coroutine is resumed from an idle source of this context:
+ *  never in the middle of the dispatch of a notification.
+ */
+class AwaitableMip {
+public:
+  AwaitableMip(Mip & mip) : _mip(mip) {}
+
+  inline Mip & mip() { return _mip; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the answer, or the end of a deadline, of a pending request
+  struct ResponseState {
+    bool received;
+    MipNotification notif;
+    ResponseState() : received(false) {}
+  };
+
+  //! wait for the next notification of a command, sending its request first if send is set
+  typedef void (*SendFunc)(Mip &, unsigned int, const Mip::PendingCallback &);
+  struct ResponseAwaiter {
+    Mip *mip;
+    MipCommand cmd;
+    unsigned int timeout_ms;
+    //! sends the request of cmd before waiting, NULL to only wait
+    SendFunc send;
+    std::shared_ptr<ResponseState> state;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      std::shared_ptr<ResponseState> st = state;
+      GMainContext *context = mip->get_context();
+      Mip::PendingCallback callback = [st, handle, context](const MipNotification * notif) {
+        if (notif) {
+          st->received = true;
+          st->notif = *notif;
+        }
+        resume_later(context, handle);
+      };
+      if (send)
+        send(*mip, timeout_ms, callback);
+      else
+        mip->expect_response(cmd, timeout_ms, callback);
+    }
+    MipNotification await_resume() const {
+      if (!state->received)
+        throw MipTimeoutError(cmd);
+      return state->notif;
+    }
+  }; // end struct ResponseAwaiter
+
+  //! a ResponseAwaiter that converts the answer into a value
+  template<class T>
+  struct ValueAwaiter : public ResponseAwaiter {
+    typedef T (*Convert)(Mip &, const MipNotification &);
+    Convert convert;
+    ValueAwaiter(const ResponseAwaiter & awaiter, Convert c)
+      : ResponseAwaiter(awaiter), convert(c) {}
+    T await_resume() const {
+      MipNotification notif = ResponseAwaiter::await_resume();
+      return convert(*mip, notif);
+    }
+  }; // end struct ValueAwaiter
+
+  //! wait for a given time, without blocking the thread
+  struct SleepAwaiter {
+    GMainContext *context;
+    unsigned int time_ms;
+
+    bool await_ready() const noexcept { return time_ms == 0; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      GSource *source = g_timeout_source_new(time_ms);
+      g_source_set_callback(source, AwaitableMip::resume_cb, handle.address(), NULL);
+      g_source_attach(source, context);
+      g_source_unref(source);
+    }
+    void await_resume() const noexcept {}
+  }; // end struct SleepAwaiter
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! wait for the next notification of a command, for instance CMD_RADAR_RESPONSE.
+   *  All the coroutines waiting for the command are resumed by the same notification.
+   *  \return the notification, or throws MipTimeoutError */
+  inline ResponseAwaiter wait_for(MipCommand cmd,
+                                  unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return ResponseAwaiter{&_mip, cmd, timeout_ms, NULL, std::make_shared<ResponseState>()};
+  }
+
+  //! send a request, for instance request<CMD_REQUEST_CLAP_ENABLED>(), and wait for its answer
+  template<MipCommand CMD>
+  inline ResponseAwaiter request(unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return ResponseAwaiter{&_mip, CMD, timeout_ms, &AwaitableMip::send_request<CMD>,
+                           std::make_shared<ResponseState>()};
+  }
+
+  //! wait for a given time, in milliseconds
+  inline SleepAwaiter sleep(unsigned int time_ms) {
+    return SleepAwaiter{_mip.get_context(), time_ms};
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return between 4.0V and 6.4V
+  inline ValueAwaiter<double> battery_voltage
+  (unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return value_awaiter<CMD_REQUEST_MIP_STATUS, double>
+        (timeout_ms, [](Mip & m, const MipNotification &) { return m.get_battery_voltage(); });
+  }
+  //! \see Status enum
+  inline ValueAwaiter<Status> status(unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return value_awaiter<CMD_REQUEST_MIP_STATUS, Status>
+        (timeout_ms, [](Mip & m, const MipNotification &) { return m.get_status(); });
+  }
+  //! \see GameMode enum
+  inline ValueAwaiter<GameMode> game_mode
+  (unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return value_awaiter<CMD_GET_CURRENT_MIP_GAME_MODE, GameMode>
+        (timeout_ms, [](Mip & m, const MipNotification &) { return m.get_game_mode(); });
+  }
+  //! \return angle with vertical, in [-45, 45]
+  inline ValueAwaiter<int> weight_update
+  (unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return value_awaiter<CMD_REQUEST_WEIGHT_UPDATE, int>
+        (timeout_ms, [](Mip & m, const MipNotification &) { return m.get_weight_update(); });
+  }
+  //! \return odometry in meters
+  inline ValueAwaiter<double> odometer_reading
+  (unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return value_awaiter<CMD_READ_ODOMETER, double>
+        (timeout_ms, [](Mip & m, const MipNotification &) { return m.get_odometer_reading(); });
+  }
+  //! \return volume in 0-7
+  inline ValueAwaiter<unsigned int> volume
+  (unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return value_awaiter<CMD_GET_MIP_VOLUME, unsigned int>
+        (timeout_ms, [](Mip & m, const MipNotification &) { return m.get_volume(); });
+  }
+  //! \see RadarResponse enum
+  inline ValueAwaiter<RadarResponse> radar_response
+  (unsigned int timeout_ms = Mip::DEFAULT_REQUEST_TIMEOUT_MS) {
+    return ValueAwaiter<RadarResponse>
+        (wait_for(CMD_RADAR_RESPONSE, timeout_ms),
+         [](Mip &, const MipNotification & notif) { return (RadarResponse) notif[0]; });
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! dispatch the events of a GLib context until all the tasks are done.
+   *  Without I/O thread, this is the context of the robots.
+   *  \return false if one of the tasks ended with an exception */
+  static bool run_tasks(GMainContext *context, const std::vector<MipTask*> & tasks) {
+    while (true) {
+      bool all_done = true;
+      for (unsigned int i = 0; i < tasks.size(); ++i)
+        all_done = all_done && tasks[i]->done();
+      if (all_done)
+        break;
+      g_main_context_iteration(context, TRUE);
+    }
+    bool ok = true;
+    for (unsigned int i = 0; i < tasks.size(); ++i) {
+      try {
+        tasks[i]->rethrow_if_failed();
+      } catch (const std::exception & e) {
+        printf("Task %i failed: '%s'\n", i, e.what());
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+protected:
+  template<MipCommand CMD, class T>
+  inline ValueAwaiter<T> value_awaiter(unsigned int timeout_ms,
+                                       typename ValueAwaiter<T>::Convert convert) {
+    return ValueAwaiter<T>(request<CMD>(timeout_ms), convert);
+  }
+
+  template<MipCommand CMD>
+  static void send_request(Mip & mip, unsigned int timeout_ms,
+                           const Mip::PendingCallback & callback) {
+    mip.request_with_callback<CMD>(timeout_ms, callback);
+  }
+
+  //! resume a coroutine from an idle source, out of the current dispatch
+  static void resume_later(GMainContext *context, std::coroutine_handle<> handle) {
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, AwaitableMip::resume_cb, handle.address(), NULL);
+    g_source_attach(source, context);
+    g_source_unref(source);
+  }
+  static gboolean resume_cb(gpointer handle_address) {
+    std::coroutine_handle<>::from_address(handle_address).resume();
+    return FALSE;
+  }
+
+  Mip & _mip;
+}; // end class AwaitableMip
+
+#endif // __cpp_impl_coroutine
+
+#endif // MIPCOROUTINES_H
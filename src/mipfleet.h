@@ -0,0 +1,418 @@
+/*!
+  \file        mipfleet.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A runtime driving many MiP robots from one host,
+for instance a classroom fleet.
+
+The robots are sharded over a few MipWorker's, one thread and GMainContext each,
+typically one per core: the commands and notifications of the different shards
+are processed in parallel, until the radio becomes the limit.
+Each (re)connection goes to the least loaded worker, measured from
+the orders it recently sent: a robot lost during a burst of commands
+on its shard comes back on a quieter one.
+The connections are pipelined: connect_all() keeps a few LE connection
+attempts in flight on each adapter, queues the others, and retries the failed
+ones with an exponential backoff. The bring-up time of the fleet is then
+bounded by the concurrency of the adapters, not by the number of robots.
+\code
+MipFleet fleet;
+fleet.add_robot("hci0", "D0:39:72:B7:AF:66");
+fleet.add_robot("hci0", "D0:39:72:B7:AF:67");
+fleet.connect_all();
+for (unsigned int i = 0; i < fleet.size(); ++i)
+  fleet[i].set_chest_LED(255, 0, 0);
+\endcode
+The MipFleet methods must be called by a single thread,
+the Mip's of the fleet can be used by any thread, \see Mip::use_worker().
+ */
+#ifndef MIPFLEET_H
+#define MIPFLEET_H
+
+#include "gattmip.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+class MipFleet {
+public:
+  //! the orders per second counted for each robot of a worker, even idle, when balancing
+  static const unsigned int ROBOT_BASE_LOAD = 10;
+
+  //! the counters of the fleet, \see get_stats()
+  struct FleetStats {
+    unsigned int nrobots, nconnected;
+    //! since the previous call to get_stats()
+    double commands_per_s, notifications_per_s;
+    //! the requests answered since the creation, \see Mip::TrafficStats
+    unsigned long responses;
+    double latency_mean_ms, latency_max_ms;
+    //! for each worker
+    std::vector<unsigned int> worker_robots;
+    std::vector<double> worker_orders_per_s;
+
+    inline std::string to_string() const {
+      std::ostringstream out;
+      out << nconnected << '/' << nrobots << " robots, "
+          << commands_per_s << " commands/s, " << notifications_per_s << " notifications/s, "
+          << "latency mean:" << latency_mean_ms << "ms, max:" << latency_max_ms << "ms, workers:[";
+      for (unsigned int i = 0; i < worker_robots.size(); ++i)
+        out << (i ? ";" : "") << worker_robots[i] << " robots@" << worker_orders_per_s[i] << "/s";
+      out << ']';
+      return out.str();
+    }
+  }; // end struct FleetStats
+
+  //! the parameters of connect_all()
+  struct ConnectOptions {
+    //! the deadline of each attempt
+    unsigned int timeout_ms;
+    //! the LE connection attempts in flight at the same time on each adapter.
+    //! Most controllers only handle one, the others fail as busy.
+    unsigned int max_attempts_per_adapter;
+    //! the attempts for each robot, the first one included
+    unsigned int max_attempts;
+    //! the wait before the second attempt, doubled for each of the next ones
+    unsigned int backoff_ms;
+    ConnectOptions() : timeout_ms(Mip::DEFAULT_CONNECT_TIMEOUT_MS),
+      max_attempts_per_adapter(1), max_attempts(3), backoff_ms(500) {}
+  }; // end struct ConnectOptions
+
+  //! how the connection of a robot went, \see connect_all()
+  struct ConnectReport {
+    unsigned int robot_idx;
+    std::string device_name, mip_mac;
+    bool connected;
+    unsigned int attempts;
+    //! the duration of the successful attempt
+    double connect_ms;
+    //! the time between the call to connect_all() and the end, queue and retries included
+    double total_ms;
+
+    inline std::string to_string() const {
+      std::ostringstream out;
+      out << mip_mac << " on " << device_name << ": "
+          << (connected ? "connected" : "not connected") << " after " << attempts
+          << " attempt(s), " << connect_ms << "ms, total " << total_ms << "ms";
+      return out.str();
+    }
+  }; // end struct ConnectReport
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! ctor, with nworkers threads, 0 for one per core
+  explicit MipFleet(unsigned int nworkers = 0) {
+    if (nworkers == 0)
+      nworkers = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < nworkers; ++i) {
+      _workers.push_back(std::unique_ptr<MipWorker>(new MipWorker));
+      _workers.back()->start();
+    }
+    _last_worker_orders.resize(nworkers, 0);
+    _worker_orders_per_s.resize(nworkers, 0);
+    _last_loads_us = _last_stats_us = g_get_monotonic_time();
+    _last_commands = _last_notifications = 0;
+    _connect_event = false;
+  }
+
+  //! dtor: disconnects the robots, then stops the workers
+  virtual ~MipFleet() {
+    _robots.clear();
+    _workers.clear();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! add a robot to the fleet, not connected yet.
+   * \param device_name
+   *  the Bluetooth device to use, for instance "hci0", \see bluetooth_mac2device()
+   * \return the index of the robot */
+  inline unsigned int add_robot(const std::string & device_name, const std::string & mip_mac) {
+    Robot robot;
+    robot.mip.reset(new Mip);
+    // wake up connect_all() as soon as an attempt ends
+    robot.mip->set_connect_callback([this](Mip &, int) {
+      {
+        std::lock_guard<std::mutex> lock(_connect_mutex);
+        _connect_event = true;
+      }
+      _connect_cv.notify_one();
+    });
+    robot.device_name = device_name;
+    robot.mip_mac = mip_mac;
+    _robots.push_back(std::move(robot));
+    return _robots.size() - 1;
+  }
+
+  inline unsigned int size() const { return _robots.size(); }
+  inline unsigned int nworkers() const { return _workers.size(); }
+  inline Mip & operator [] (unsigned int robot_idx) { return *_robots[robot_idx].mip; }
+  inline const std::string & get_mac(unsigned int robot_idx) const {
+    return _robots[robot_idx].mip_mac;
+  }
+  //! \return the index of the worker of a robot, -1 if not assigned
+  inline int get_worker_index(unsigned int robot_idx) const {
+    MipWorker *worker = _robots[robot_idx].mip->get_worker();
+    for (unsigned int i = 0; i < _workers.size(); ++i)
+      if (_workers[i].get() == worker)
+        return i;
+    return -1;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! connect the robots that are not connected, for instance after a loss,
+   *  each on the least loaded worker.
+   *  The attempts are pipelined on each adapter, \see ConnectOptions.
+   *  A report per robot is then given by get_connect_reports().
+   * \return true if all the robots are connected */
+  inline bool connect_all(const ConnectOptions & options = ConnectOptions()) {
+    gint64 start_us = g_get_monotonic_time();
+    _connect_reports.clear();
+    std::map<std::string, AdapterQueue> adapters;
+    for (unsigned int i = 0; i < _robots.size(); ++i) {
+      if (_robots[i].mip->is_connected())
+        continue;
+      ConnectReport report;
+      report.robot_idx = i;
+      report.device_name = _robots[i].device_name;
+      report.mip_mac = _robots[i].mip_mac;
+      report.connected = false;
+      report.attempts = 0;
+      report.connect_ms = report.total_ms = 0;
+      QueuedRobot queued;
+      queued.report_idx = _connect_reports.size();
+      queued.next_try_us = start_us;
+      _connect_reports.push_back(report);
+      adapters[report.device_name].queue.push_back(queued);
+    }
+
+    unsigned int max_in_flight = std::max(options.max_attempts_per_adapter, 1u);
+    while (true) {
+      gint64 now_us = g_get_monotonic_time();
+      // wait at most one deadline: the attempts in flight wake us up before
+      gint64 wakeup_us = now_us + options.timeout_ms * 1000;
+      bool busy = false;
+      std::map<std::string, AdapterQueue>::iterator adapter = adapters.begin();
+      for (; adapter != adapters.end(); ++adapter) {
+        AdapterQueue & aq = adapter->second;
+        // the attempts that ended: success, failure to retry later, or give up
+        std::vector<QueuedRobot>::iterator it = aq.in_flight.begin();
+        while (it != aq.in_flight.end()) {
+          ConnectReport & report = _connect_reports[it->report_idx];
+          Mip & mip = *_robots[report.robot_idx].mip;
+          int state = mip.get_connect_state();
+          if (state == Mip::CONNECTING) {
+            ++it;
+            continue;
+          }
+          ++report.attempts;
+          report.total_ms = (now_us - start_us) / 1000.;
+          if (state == Mip::CONNECTED) {
+            report.connected = true;
+            report.connect_ms = mip.get_connect_time_ms();
+          }
+          else if (report.attempts < options.max_attempts && state != Mip::CONNECT_CANCELLED) {
+            it->next_try_us = now_us
+                + ((gint64) options.backoff_ms * 1000 << (report.attempts - 1));
+            aq.queue.push_back(*it);
+          }
+          else
+            printf("MipFleet: could not connect to '%s' with '%s' after %i attempt(s): %s\n",
+                   report.mip_mac.c_str(), report.device_name.c_str(), report.attempts,
+                   Mip::connect_state2str(state));
+          it = aq.in_flight.erase(it);
+        } // end while (it)
+
+        // start the queued attempts whose backoff is over, in order
+        std::deque<QueuedRobot>::iterator q = aq.queue.begin();
+        while (q != aq.queue.end() && aq.in_flight.size() < max_in_flight) {
+          if (q->next_try_us > now_us) {
+            ++q;
+            continue;
+          }
+          // a synchronous failure is seen as CONNECT_FAILED at the next iteration
+          start_connect(_connect_reports[q->report_idx].robot_idx, options.timeout_ms);
+          aq.in_flight.push_back(*q);
+          q = aq.queue.erase(q);
+        }
+        if (aq.in_flight.size() < max_in_flight) // else woken up by the end of an attempt
+          for (q = aq.queue.begin(); q != aq.queue.end(); ++q)
+            wakeup_us = std::min(wakeup_us, q->next_try_us);
+        busy = busy || !aq.queue.empty() || !aq.in_flight.empty();
+      } // end for (adapter)
+      if (!busy)
+        break;
+
+      // sleep until an attempt ends or a backoff is over
+      std::unique_lock<std::mutex> lock(_connect_mutex);
+      std::chrono::microseconds wait(std::max(wakeup_us - now_us, (gint64) 0));
+      _connect_cv.wait_for(lock, wait, [this] { return _connect_event; });
+      _connect_event = false;
+    } // end while (true)
+
+    bool ok = true;
+    for (unsigned int i = 0; i < _robots.size(); ++i)
+      ok = ok && _robots[i].mip->is_connected();
+    return ok;
+  }
+
+  //! \return the reports of the last call to connect_all()
+  inline const std::vector<ConnectReport> & get_connect_reports() const {
+    return _connect_reports;
+  }
+
+  //! disconnect a robot and connect it again on the least loaded worker
+  inline bool reconnect(unsigned int robot_idx,
+                        unsigned int timeout_ms = Mip::DEFAULT_CONNECT_TIMEOUT_MS) {
+    return start_connect(robot_idx, timeout_ms) && wait_connected(robot_idx);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the counters of all the robots, the rates since the previous call
+  inline FleetStats get_stats() {
+    update_loads();
+    FleetStats stats;
+    stats.nrobots = _robots.size();
+    stats.nconnected = 0;
+    stats.responses = 0;
+    stats.latency_mean_ms = stats.latency_max_ms = 0;
+    unsigned long commands = 0, notifications = 0;
+    double latency_sum_ms = 0;
+    for (unsigned int i = 0; i < _robots.size(); ++i) {
+      Mip & mip = *_robots[i].mip;
+      if (mip.is_connected())
+        ++stats.nconnected;
+      Mip::TrafficStats traffic = mip.get_traffic_stats();
+      commands += traffic.commands;
+      notifications += traffic.notifications;
+      stats.responses += traffic.responses;
+      latency_sum_ms += traffic.latency_mean_ms * traffic.responses;
+      stats.latency_max_ms = std::max(stats.latency_max_ms, traffic.latency_max_ms);
+    }
+    if (stats.responses)
+      stats.latency_mean_ms = latency_sum_ms / stats.responses;
+    gint64 now_us = g_get_monotonic_time();
+    double dt_s = std::max(now_us - _last_stats_us, (gint64) 1) / 1E6;
+    stats.commands_per_s = (commands - _last_commands) / dt_s;
+    stats.notifications_per_s = (notifications - _last_notifications) / dt_s;
+    _last_stats_us = now_us;
+    _last_commands = commands;
+    _last_notifications = notifications;
+    for (unsigned int i = 0; i < _workers.size(); ++i)
+      stats.worker_robots.push_back(_workers[i]->get_robots_count());
+    stats.worker_orders_per_s = _worker_orders_per_s;
+    return stats;
+  }
+
+protected:
+  struct Robot {
+    std::unique_ptr<Mip> mip;
+    std::string device_name, mip_mac;
+  };
+
+  //! a robot waiting for its connection, \see connect_all()
+  struct QueuedRobot {
+    unsigned int report_idx;
+    //! the end of the backoff
+    gint64 next_try_us;
+  };
+  //! the connections of an adapter, in flight or waiting for a slot
+  struct AdapterQueue {
+    std::vector<QueuedRobot> in_flight;
+    std::deque<QueuedRobot> queue;
+  };
+
+  //! detach a robot from its worker, attach it to the least loaded one and start connecting
+  inline bool start_connect(unsigned int robot_idx, unsigned int timeout_ms) {
+    Robot & robot = _robots[robot_idx];
+    robot.mip->stop_io_thread(); // disconnects it
+    update_loads();
+    if (!robot.mip->use_worker(least_loaded_worker()))
+      return false;
+    return robot.mip->start_connect(NULL, robot.device_name.c_str(), robot.mip_mac.c_str(),
+                                    timeout_ms);
+  }
+
+  inline bool wait_connected(unsigned int robot_idx) {
+    Robot & robot = _robots[robot_idx];
+    if (robot.mip->wait_connected())
+      return true;
+    printf("MipFleet: could not connect to '%s' with '%s': %s\n",
+           robot.mip_mac.c_str(), robot.device_name.c_str(),
+           Mip::connect_state2str(robot.mip->get_connect_state()));
+    return false;
+  }
+
+  //! refresh the order rate of each worker, smoothed over about a second
+  inline void update_loads() {
+    gint64 now_us = g_get_monotonic_time();
+    double dt_s = (now_us - _last_loads_us) / 1E6;
+    if (dt_s < .1) // too short to be meaningful
+      return;
+    double alpha = std::min(dt_s, 1.);
+    for (unsigned int i = 0; i < _workers.size(); ++i) {
+      unsigned long orders = _workers[i]->get_orders_count();
+      double rate = (orders - _last_worker_orders[i]) / dt_s;
+      _worker_orders_per_s[i] = alpha * rate + (1 - alpha) * _worker_orders_per_s[i];
+      _last_worker_orders[i] = orders;
+    }
+    _last_loads_us = now_us;
+  }
+
+  inline MipWorker* least_loaded_worker() const {
+    unsigned int best = 0;
+    double best_load = -1;
+    for (unsigned int i = 0; i < _workers.size(); ++i) {
+      double load = _worker_orders_per_s[i]
+          + ROBOT_BASE_LOAD * _workers[i]->get_robots_count();
+      if (best_load < 0 || load < best_load) {
+        best = i;
+        best_load = load;
+      }
+    }
+    return _workers[best].get();
+  }
+
+  //! declared before the robots, that must be destroyed first
+  std::vector<std::unique_ptr<MipWorker> > _workers;
+  std::vector<Robot> _robots;
+  //! the load of the workers, \see update_loads()
+  std::vector<unsigned long> _last_worker_orders;
+  std::vector<double> _worker_orders_per_s;
+  gint64 _last_loads_us;
+  //! for the rates of get_stats()
+  gint64 _last_stats_us;
+  unsigned long _last_commands, _last_notifications;
+  //! set when a connection attempt ends, \see connect_all()
+  std::mutex _connect_mutex;
+  std::condition_variable _connect_cv;
+  bool _connect_event;
+  std::vector<ConnectReport> _connect_reports;
+}; // end class MipFleet
+
+#endif // MIPFLEET_H
@@ -0,0 +1,104 @@
+/*!
+  \file        miphistogram.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A histogram of latencies, in the spirit of HdrHistogram:
+the values are counted in log-linear buckets, exact below 64,
+then 32 buckets per power of two, i.e. a relative error below 3%.
+Recording is a few shifts and one relaxed atomic increment, without lock nor allocation.
+A single thread records, any thread can read the percentiles meanwhile.
+ */
+#ifndef MIPHISTOGRAM_H
+#define MIPHISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+
+class MipHistogram {
+public:
+  //! 2^SUB_BITS buckets per power of two
+  static const unsigned int SUB_BITS = 5, SUB_COUNT = 1 << SUB_BITS;
+  //! the values above are counted as MAX_VALUE, 2^24 us = 16.7 s for latencies in us
+  static const uint64_t MAX_VALUE = (1ULL << 24) - 1;
+  static const unsigned int NBUCKETS = (24 - SUB_BITS) * SUB_COUNT + SUB_COUNT;
+
+  MipHistogram() { reset(); }
+
+  //! forget all the values, not thread-safe
+  inline void reset() {
+    for (unsigned int i = 0; i < NBUCKETS; ++i)
+      _counts[i].store(0, std::memory_order_relaxed);
+    _count.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+  }
+
+  //! must always be called by the same thread
+  inline void record(uint64_t value) {
+    if (value > MAX_VALUE)
+      value = MAX_VALUE;
+    std::atomic<uint32_t> & bucket = _counts[bucket_index(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (value > _max.load(std::memory_order_relaxed))
+      _max.store(value, std::memory_order_relaxed);
+  }
+
+  inline unsigned long count() const { return _count.load(std::memory_order_relaxed); }
+  inline uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+
+  /*! \arg p in [0, 100], for instance 99 for the 99th percentile
+   * \return the highest value equivalent to the bucket of the percentile, 0 if empty */
+  inline uint64_t percentile(double p) const {
+    unsigned long n = count();
+    if (n == 0)
+      return 0;
+    unsigned long rank = (unsigned long) (p / 100. * n + .5);
+    if (rank < 1)
+      rank = 1;
+    unsigned long cumul = 0;
+    for (unsigned int i = 0; i < NBUCKETS; ++i) {
+      cumul += _counts[i].load(std::memory_order_relaxed);
+      if (cumul >= rank) {
+        uint64_t value = bucket_highest_value(i);
+        return (value < max() ? value : max());
+      }
+    }
+    return max(); // values recorded meanwhile
+  }
+
+  //! values < 64 have their own bucket, then 32 buckets per power of two
+  static inline unsigned int bucket_index(uint64_t value) {
+    unsigned int msb = 63 - __builtin_clzll(value | 1);
+    unsigned int shift = (msb > SUB_BITS ? msb - SUB_BITS : 0);
+    return shift * SUB_COUNT + (unsigned int) (value >> shift);
+  }
+  static inline uint64_t bucket_highest_value(unsigned int idx) {
+    unsigned int shift = (idx < SUB_COUNT ? 0 : idx / SUB_COUNT - 1);
+    uint64_t sub = idx - shift * SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+  }
+
+protected:
+  std::atomic<uint32_t> _counts[NBUCKETS];
+  std::atomic<unsigned long> _count;
+  std::atomic<uint64_t> _max;
+}; // end class MipHistogram
+
+#endif // MIPHISTOGRAM_H
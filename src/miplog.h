@@ -0,0 +1,380 @@
+/*!
+  \file        miplog.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+An asynchronous logger for the hot paths of the library.
+
+The level is chosen at compile time, by defining MIP_LOG_LEVEL before
+including, for instance -DMIP_LOG_LEVEL=MIP_LOG_LEVEL_DEBUG:
+the messages of the lower levels are removed by the compiler,
+their arguments are not even evaluated.
+
+The enabled messages are not formatted by the caller:
+the format string (necessarily a literal) and the arguments are copied
+into a record, pushed onto a lock-free queue. A background thread pops them
+every few milliseconds, formats and writes them.
+Logging thus never blocks the GLib callbacks nor the drive loops.
+The messages are written at most WRITE_PERIOD_MS later,
+so they may appear after the printf()'s that followed them.
+When the queue is full, messages are dropped and counted.
+\code
+MIP_LOG_WARN("command %i='%s' dropped!\n", cmd, cmd2str(cmd));
+\endcode
+The arguments are integers, floating point numbers, pointers,
+C strings or std::string's, at most MipLogRecord::MAX_ARGS.
+Strings are copied, truncated to MipLogRecord::MAX_STRINGS characters in total.
+ */
+#ifndef MIPLOG_H
+#define MIPLOG_H
+
+#include "mpsc_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#define MIP_LOG_LEVEL_DEBUG 0
+#define MIP_LOG_LEVEL_INFO  1
+#define MIP_LOG_LEVEL_WARN  2
+#define MIP_LOG_LEVEL_ERROR 3
+#define MIP_LOG_LEVEL_OFF   4
+
+// can be defined before including, for instance to MIP_LOG_LEVEL_DEBUG
+#ifndef MIP_LOG_LEVEL
+#define MIP_LOG_LEVEL MIP_LOG_LEVEL_INFO
+#endif
+
+//! true if the messages of this level are compiled
+#define MIP_LOG_ENABLED(level) ((level) >= MIP_LOG_LEVEL)
+
+//! "" fmt only compiles with a literal, that must outlive the record
+#define MIP_LOG_AT(level, fmt, ...) \
+  do { \
+    if (MIP_LOG_ENABLED(level)) \
+      MipLog::instance().log(level, "" fmt, ##__VA_ARGS__); \
+  } while (0)
+
+#define MIP_LOG_DEBUG(fmt, ...) MIP_LOG_AT(MIP_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define MIP_LOG_INFO(fmt, ...)  MIP_LOG_AT(MIP_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define MIP_LOG_WARN(fmt, ...)  MIP_LOG_AT(MIP_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define MIP_LOG_ERROR(fmt, ...) MIP_LOG_AT(MIP_LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+
+//! a message not formatted yet
+struct MipLogRecord {
+  static const unsigned int MAX_ARGS = 8;
+  static const unsigned int MAX_STRINGS = 96;
+  enum ArgType {
+    INT = 0,    //!< int or smaller, formatted without length modifier
+    LONG = 1,   //!< 64 bits, formatted with "ll"
+    DOUBLE = 2,
+    POINTER = 3,
+    STRING = 4  //!< offset of the copy in strings
+  };
+  union Arg {
+    long long i;
+    double d;
+    const void* p;
+  };
+
+  const char* fmt;
+  uint8_t level;
+  uint8_t nargs;
+  uint8_t strings_len;
+  uint8_t types[MAX_ARGS];
+  Arg args[MAX_ARGS];
+  char strings[MAX_STRINGS];
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  template<class T>
+  inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+  add(T value) {
+    types[nargs] = (sizeof(T) <= sizeof(int) ? INT : LONG);
+    args[nargs++].i = (sizeof(T) <= sizeof(int) ? (long long) (int) value : (long long) value);
+  }
+  inline void add(double value) {
+    types[nargs] = DOUBLE;
+    args[nargs++].d = value;
+  }
+  inline void add(float value) { add((double) value); }
+  inline void add(const void* value) {
+    types[nargs] = POINTER;
+    args[nargs++].p = value;
+  }
+  inline void add(const char* value) { add_string(value, (value ? strlen(value) : 0)); }
+  inline void add(char* value) { add((const char*) value); }
+  inline void add(const std::string & value) { add_string(value.data(), value.size()); }
+
+  //! copy a string, truncated if there is no room left.
+  //! The last byte is kept for a '\0', the empty string of the arguments that do not fit
+  inline void add_string(const char* str, size_t len) {
+    types[nargs] = STRING;
+    if (strings_len >= MAX_STRINGS - 1) {
+      strings[MAX_STRINGS - 1] = '\0';
+      args[nargs++].i = MAX_STRINGS - 1;
+      return;
+    }
+    unsigned int room = MAX_STRINGS - strings_len - 1;
+    if (len > room)
+      len = room;
+    args[nargs++].i = strings_len;
+    memcpy(strings + strings_len, str, len);
+    strings_len += len;
+    strings[strings_len++] = '\0';
+  }
+}; // end struct MipLogRecord
+
+////////////////////////////////////////////////////////////////////////////////
+
+class MipLog {
+public:
+  static const unsigned int QUEUE_SIZE = 1024;
+  //! how often the background thread drains the queue, in milliseconds
+  static const unsigned int WRITE_PERIOD_MS = 10;
+
+  /*! the logger of the process, started at the first message.
+   *  Never destroyed: Mip's may log in their destructors, after the static ones.
+   *  The pending messages are written at exit() */
+  static MipLog & instance() {
+    static MipLog* log = create();
+    return *log;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! called by the macros, from any thread, never blocks. \return false if dropped
+  template<typename... Args>
+  inline bool log(int level, const char* fmt, const Args & ... args) {
+    static_assert(sizeof...(Args) <= MipLogRecord::MAX_ARGS,
+                  "too many arguments for MipLog, see MipLogRecord::MAX_ARGS");
+    MipLogRecord r;
+    r.fmt = fmt;
+    r.level = level;
+    r.nargs = 0;
+    r.strings_len = 0;
+    add_args(r, args...);
+    if (!_queue.push(r)) {
+      ++_ndropped;
+      return false;
+    }
+    if (_stopped.load(std::memory_order_relaxed)) // after exit(): write it now
+      flush();
+    return true;
+  }
+
+  //! write all the pending messages, from any thread. Blocks until written
+  inline void flush() {
+    std::lock_guard<std::mutex> lock(_drain_mutex);
+    drain();
+  }
+
+  //! where to write the messages, stdout by default
+  inline void set_output(FILE* output) {
+    std::lock_guard<std::mutex> lock(_drain_mutex);
+    drain();
+    _output = output;
+  }
+
+  //! \return the number of messages written, and dropped because the queue was full
+  inline unsigned long get_messages_count() const { return _nmessages; }
+  inline unsigned long get_dropped_count() const { return _ndropped; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! format a record as printf() would have done, appending it to out
+  static void format(const MipLogRecord & r, std::string & out) {
+    char buffer[256];
+    unsigned int argi = 0;
+    for (const char* c = r.fmt; *c; ++c) {
+      if (*c != '%') {
+        out += *c;
+        continue;
+      }
+      if (c[1] == '%') {
+        out += '%';
+        ++c;
+        continue;
+      }
+      // copy the flags, width and precision, and skip the length modifiers
+      char spec[32];
+      unsigned int speclen = 0, nstars = 0;
+      int stars[2] = {0, 0};
+      spec[speclen++] = *c++;
+      for (; *c && strchr("-+ #0123456789.*hlLqjzt", *c); ++c) {
+        if (strchr("hlLqjzt", *c))
+          continue;
+        if (*c == '*' && nstars < 2)
+          stars[nstars++] = (argi < r.nargs ? (int) r.args[argi++].i : 0);
+        if (speclen < sizeof(spec) - 4)
+          spec[speclen++] = *c;
+      }
+      if (!*c)
+        break;
+      char conv = *c;
+      if (argi >= r.nargs) { // missing argument
+        out += "(?)";
+        continue;
+      }
+      uint8_t type = r.types[argi];
+      const MipLogRecord::Arg & arg = r.args[argi++];
+      int n = 0;
+      if (strchr("diouxXc", conv)) {
+        if (type == MipLogRecord::INT || type == MipLogRecord::LONG) {
+          if (type == MipLogRecord::LONG && conv != 'c') {
+            spec[speclen++] = 'l';
+            spec[speclen++] = 'l';
+          }
+          spec[speclen++] = conv;
+          spec[speclen] = '\0';
+          if (type == MipLogRecord::LONG && conv != 'c')
+            n = print(buffer, sizeof(buffer), spec, nstars, stars, arg.i);
+          else
+            n = print(buffer, sizeof(buffer), spec, nstars, stars, (int) arg.i);
+        }
+        else
+          n = snprintf(buffer, sizeof(buffer), "(?)");
+      }
+      else if (strchr("fFeEgGaA", conv)) {
+        spec[speclen++] = conv;
+        spec[speclen] = '\0';
+        double value = (type == MipLogRecord::DOUBLE ? arg.d
+                        : type == MipLogRecord::STRING ? 0 : (double) arg.i);
+        n = print(buffer, sizeof(buffer), spec, nstars, stars, value);
+      }
+      else if (conv == 's') {
+        spec[speclen++] = conv;
+        spec[speclen] = '\0';
+        const char* str = (type == MipLogRecord::STRING ? r.strings + arg.i : "(?)");
+        n = print(buffer, sizeof(buffer), spec, nstars, stars, str);
+      }
+      else if (conv == 'p') {
+        spec[speclen++] = conv;
+        spec[speclen] = '\0';
+        n = print(buffer, sizeof(buffer), spec, nstars, stars,
+                  (type == MipLogRecord::POINTER ? arg.p : (const void*) NULL));
+      }
+      if (n > 0)
+        out.append(buffer, (n < (int) sizeof(buffer) ? n : sizeof(buffer) - 1));
+    } // end for c
+  }
+
+  //! "0x12 0x34 ": a payload as a single argument, only built if the level is enabled
+  static std::string join(const uint8_t *values, unsigned int nvalues, const char* fmt) {
+    std::string out;
+    char buffer[16];
+    for (unsigned int i = 0; i < nvalues; ++i) {
+      snprintf(buffer, sizeof(buffer), fmt, values[i], values[i]);
+      out += buffer;
+    }
+    return out;
+  }
+
+protected:
+  MipLog() : _output(stdout), _stop(false), _stopped(false), _nmessages(0), _ndropped(0) {
+    _thread = std::thread(&MipLog::run, this);
+  }
+
+  static MipLog* create() {
+    MipLog* log = new MipLog();
+    atexit(&MipLog::stop_at_exit);
+    return log;
+  }
+
+  //! stop the background thread, the next messages will be written synchronously
+  static void stop_at_exit() {
+    MipLog & log = instance();
+    {
+      std::lock_guard<std::mutex> lock(log._stop_mutex);
+      log._stop = true;
+    }
+    log._stop_cv.notify_one();
+    log._thread.join();
+    log._stopped = true;
+    log.flush();
+  }
+
+  static inline void add_args(MipLogRecord &) {}
+  template<typename T, typename... Args>
+  static inline void add_args(MipLogRecord & r, const T & arg, const Args & ... args) {
+    r.add(arg);
+    add_args(r, args...);
+  }
+
+  template<class T>
+  static inline int print(char* buffer, size_t size, const char* spec,
+                          unsigned int nstars, const int* stars, T value) {
+    if (nstars == 0)
+      return snprintf(buffer, size, spec, value);
+    if (nstars == 1)
+      return snprintf(buffer, size, spec, stars[0], value);
+    return snprintf(buffer, size, spec, stars[0], stars[1], value);
+  }
+
+  //! the body of the background thread
+  inline void run() {
+    while (true) {
+      bool stop;
+      {
+        std::unique_lock<std::mutex> lock(_stop_mutex);
+        _stop_cv.wait_for(lock, std::chrono::milliseconds((unsigned int) WRITE_PERIOD_MS),
+                          [this] { return _stop; });
+        stop = _stop;
+      }
+      flush();
+      if (stop)
+        break;
+    } // end while (true)
+  }
+
+  //! pop and write all the records, with _drain_mutex locked
+  inline void drain() {
+    MipLogRecord r;
+    _line.clear(); // keeps its capacity: no allocation once warm
+    while (_queue.pop(r)) {
+      format(r, _line);
+      ++_nmessages;
+    }
+    if (_line.empty())
+      return;
+    fwrite(_line.data(), 1, _line.size(), _output);
+    fflush(_output);
+  }
+
+  MpscRing<MipLogRecord, QUEUE_SIZE> _queue;
+  //! the consumer of _queue, either the background thread or flush()
+  std::mutex _drain_mutex;
+  FILE* _output;
+  //! the messages formatted by drain()
+  std::string _line;
+  std::thread _thread;
+  std::mutex _stop_mutex;
+  std::condition_variable _stop_cv;
+  bool _stop;
+  std::atomic<bool> _stopped;
+  std::atomic<unsigned long> _nmessages, _ndropped;
+}; // end class MipLog
+
+#endif // MIPLOG_H
@@ -0,0 +1,121 @@
+/*!
+  \file        mipnotification.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+The decoded form of a notification sent by the WowWee MiP robot.
+
+The robot answers with an ASCII-hex payload, for instance "7950 02"
+without the space: the first pair of chars is the command number,
+each following pair is a value byte.
+The payload is parsed in place, with a lookup table,
+into a fixed-size structure: no heap allocation is involved.
+ */
+#ifndef MIPNOTIFICATION_H
+#define MIPNOTIFICATION_H
+
+#include <stdint.h>
+#include "mipcommands.h"
+
+struct MipNotification {
+  //! the longest known answer (chest LED) has 5 values, keep some margin
+  static const unsigned int MAX_VALUES = 32;
+
+  //! the command number, ERROR if the payload could not be decoded
+  MipCommand cmd;
+  //! the number of values in "values"
+  unsigned int nvalues;
+  //! the value bytes, in [0, 255]
+  uint8_t values[MAX_VALUES];
+
+  MipNotification() : cmd(ERROR), nvalues(0) {}
+
+  inline int operator[] (unsigned int i) const { return values[i]; }
+  inline unsigned int size() const { return nvalues; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! decode an ASCII-hex payload, for instance "0C02".
+   *  A trailing odd char is ignored, values after MAX_VALUES are dropped.
+   * \param payload
+   *    the chars of the notification, after the 3-byte ATT header
+   * \param len
+   *    the number of chars in payload
+   * \return true if success, false if the payload is too short
+   *    or contains a char that is not an hex digit.
+   */
+  inline bool decode(const uint8_t *payload, unsigned int len) {
+    cmd = ERROR;
+    nvalues = 0;
+    if (len < 2)
+      return false;
+    int c = hex_pair(payload);
+    if (c < 0)
+      return false;
+    unsigned int npairs = (len - 2) / 2;
+    if (npairs > MAX_VALUES)
+      npairs = MAX_VALUES;
+    const uint8_t *ptr = payload + 2;
+    for (unsigned int i = 0; i < npairs; ++i, ptr += 2) {
+      int v = hex_pair(ptr);
+      if (v < 0)
+        return false;
+      values[i] = v;
+    }
+    cmd = c;
+    nvalues = npairs;
+    return true;
+  } // end decode()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the value of two hex chars, for instance "7F" -> 127, or -1 if error
+  inline static int hex_pair(const uint8_t *chars) {
+    const signed char *table = hex_table();
+    int hi = table[chars[0]], lo = table[chars[1]];
+    if ((hi | lo) < 0)
+      return -1;
+    return (hi << 4) | lo;
+  }
+
+  //! a char -> hex digit value lookup table, -1 for non hex digits
+  inline static const signed char* hex_table() {
+    static const signed char table[256] = {
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x00
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x10
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x20
+       0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1, // 0x30 '0'-'9'
+      -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x40 'A'-'F'
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x50
+      -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x60 'a'-'f'
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x70
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x80
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0x90
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0xA0
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0xB0
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0xC0
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0xD0
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, // 0xE0
+      -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1  // 0xF0
+    };
+    return table;
+  }
+}; // end struct MipNotification
+
+#endif // MIPNOTIFICATION_H
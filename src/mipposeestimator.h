@@ -0,0 +1,182 @@
+/*!
+  \file        mipposeestimator.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A dead-reckoning estimator of the pose of the robot on the floor.
+
+The motion commands sent to the robot, converted into speeds through
+Mip::ticks2speeds(), are integrated along arcs of circle.
+Each odometer reading corrects the distance travelled since the previous one,
+along the current heading: the odometer does not give the direction of the robot.
+
+The state is published through a Seqlock: get_pose() never blocks
+the thread sending the commands nor the one handling the notifications,
+and extrapolates the pose to the current time with the current speeds.
+Mip owns an estimator, \see Mip::get_pose().
+ */
+#ifndef MIPPOSEESTIMATOR_H
+#define MIPPOSEESTIMATOR_H
+
+#include "seqlock.h"
+#include <glib.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+//! a pose on the floor, in meters and radians, theta > 0 for CCW
+struct MipPose {
+  double x, y, theta;
+  //! g_get_monotonic_time() of the pose, in microseconds
+  gint64 time_us;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+class MipPoseEstimator {
+public:
+  //! the robot stops if no new motion command comes within this delay, \see MipSimulator
+  static const unsigned int COMMAND_DURATION_MS = 100;
+
+  MipPoseEstimator() { reset(); }
+
+  //! set the pose, for instance (0, 0, 0) at the start, and forget the odometer
+  inline void reset(double x = 0, double y = 0, double theta = 0) {
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    _state.pose.x = x;
+    _state.pose.y = y;
+    _state.pose.theta = theta;
+    _state.pose.time_us = g_get_monotonic_time();
+    _state.v_ms = _state.w_rads = 0;
+    _state.command_end_us = _state.pose.time_us;
+    _distance_m = 0;
+    _odometer_m = -1;
+    _direction = 1;
+    _ncorrections = 0;
+    _last_correction_m = 0;
+    _published.store(_state);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! a new motion command, sent at time_us.
+   *  \arg v_ms, w_rads the speeds of the command, 0 to stop */
+  inline void set_command(double v_ms, double w_rads, gint64 time_us) {
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    advance(time_us);
+    _state.v_ms = v_ms;
+    _state.w_rads = w_rads;
+    _state.command_end_us = time_us + COMMAND_DURATION_MS * 1000;
+    if (v_ms != 0)
+      _direction = (v_ms > 0 ? 1 : -1);
+    _published.store(_state);
+  }
+
+  /*! an odometer reading, received at time_us: the distance travelled
+   *  since the previous reading replaces the estimated one */
+  inline void odometer_update(double odometer_m, gint64 time_us) {
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    advance(time_us);
+    // the first reading, or the odometer was reset: nothing to compare with
+    if (_odometer_m >= 0 && odometer_m >= _odometer_m) {
+      _last_correction_m = (odometer_m - _odometer_m) - _distance_m;
+      _state.pose.x += _direction * _last_correction_m * cos(_state.pose.theta);
+      _state.pose.y += _direction * _last_correction_m * sin(_state.pose.theta);
+      ++_ncorrections;
+    }
+    _odometer_m = odometer_m;
+    _distance_m = 0;
+    _published.store(_state);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the pose at this instant, lock-free, can be called by any thread at any rate
+  inline MipPose get_pose() const {
+    return get_pose(g_get_monotonic_time());
+  }
+
+  //! the pose at a given time, after the last command or reading
+  inline MipPose get_pose(gint64 time_us) const {
+    State state = _published.load();
+    double distance_m;
+    integrate(state, time_us, distance_m);
+    return state.pose;
+  }
+
+  //! the number of odometer readings used, and the last correction, in meters
+  inline unsigned long get_corrections_count() const { return _ncorrections; }
+  inline double get_last_correction_m() const {
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    return _last_correction_m;
+  }
+
+protected:
+  //! the published state: the pose at a time, and the speeds after it
+  struct State {
+    MipPose pose;
+    double v_ms, w_rads;
+    //! the speeds are 0 after this time
+    gint64 command_end_us;
+  };
+
+  //! move the state along its speeds until time_us. \arg distance_m the absolute distance travelled
+  static inline void integrate(State & state, gint64 time_us, double & distance_m) {
+    distance_m = 0;
+    gint64 end_us = std::min(time_us, state.command_end_us);
+    double dt = (end_us - state.pose.time_us) / 1E6;
+    if (time_us > state.pose.time_us)
+      state.pose.time_us = time_us;
+    if (dt <= 0)
+      return;
+    double v = state.v_ms, w = state.w_rads, theta = state.pose.theta, dtheta = w * dt;
+    if (fabs(w) < 1E-6) {
+      state.pose.x += v * dt * cos(theta);
+      state.pose.y += v * dt * sin(theta);
+    }
+    else { // arc of circle of radius v / w
+      state.pose.x += v / w * (sin(theta + dtheta) - sin(theta));
+      state.pose.y -= v / w * (cos(theta + dtheta) - cos(theta));
+    }
+    state.pose.theta = remainder(theta + dtheta, 2 * M_PI);
+    distance_m = fabs(v) * dt;
+  }
+
+  //! integrate the writer state until time_us, _write_mutex locked
+  inline void advance(gint64 time_us) {
+    double distance_m;
+    integrate(_state, time_us, distance_m);
+    _distance_m += distance_m;
+  }
+
+  //! serializes the writers, never taken by get_pose()
+  mutable std::mutex _write_mutex;
+  Seqlock<State> _published;
+  //! the writer copy of the published state
+  State _state;
+  //! the distance estimated since the last odometer reading, and this reading, < 0 if none
+  double _distance_m, _odometer_m;
+  //! the direction of the last linear motion, 1 forward, -1 backward
+  int _direction;
+  std::atomic<unsigned long> _ncorrections;
+  double _last_correction_m;
+}; // end class MipPoseEstimator
+
+#endif // MIPPOSEESTIMATOR_H
@@ -0,0 +1,260 @@
+/*!
+  \file        miprateloop.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A fixed-rate loop, for instance to send the drive commands at 40 Hz.
+
+The ticks come from a timerfd with absolute deadlines: the time spent
+in the callback does not delay the next tick, unlike a usleep()
+after the loop body, and the rate does not drift.
+The thread running the loop can be given a SCHED_FIFO priority
+and pinned on a core. The delays of the wakeups after their deadlines,
+the jitter of the periods and the missed deadlines are measured,
+\see get_stats().
+\code
+MipRateLoop loop(40);
+loop.run([&mip, &v, &w]() {
+  mip.continuous_drive(v, w);
+  return true; // false to stop the loop
+});
+\endcode
+ */
+#ifndef MIPRATELOOP_H
+#define MIPRATELOOP_H
+
+#include "miphistogram.h"
+#include "miplog.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+
+class MipRateLoop {
+public:
+  static constexpr double DEFAULT_RATE_HZ = 40;
+
+  //! called at each tick, \return false to stop the loop
+  typedef std::function<bool()> TickCallback;
+
+  //! the timing of the ticks, since the start of the loop
+  struct RateStats {
+    unsigned long ticks, missed;
+    //! the measured rate
+    double rate_hz;
+    //! the delay of the wakeups after their deadlines, in microseconds
+    uint64_t late_p50_us, late_p99_us, late_max_us;
+    //! the difference between two consecutive wakeups and the period, in microseconds
+    uint64_t jitter_p50_us, jitter_p99_us, jitter_max_us;
+
+    inline std::string to_string() const {
+      std::ostringstream out;
+      out << ticks << " ticks at " << rate_hz << " Hz, " << missed << " missed, "
+          << "late p50:" << late_p50_us << "us p99:" << late_p99_us
+          << "us max:" << late_max_us << "us, "
+          << "jitter p50:" << jitter_p50_us << "us p99:" << jitter_p99_us
+          << "us max:" << jitter_max_us << "us";
+      return out.str();
+    }
+  }; // end struct RateStats
+
+  MipRateLoop(double rate_hz = DEFAULT_RATE_HZ)
+    : _priority(0), _cpu(-1), _running(false), _stop(false),
+      _nticks(0), _nmissed(0), _start_ns(0), _last_ns(0) {
+    set_rate(rate_hz);
+  }
+
+  virtual ~MipRateLoop() { stop(); }
+
+  //! \return false if the rate is not positive. Applied at the next run()
+  inline bool set_rate(double rate_hz) {
+    if (rate_hz <= 0)
+      return false;
+    _period_ns = 1E9 / rate_hz;
+    return true;
+  }
+  inline double get_rate() const { return 1E9 / _period_ns; }
+
+  //! \arg priority the SCHED_FIFO priority of the loop, in 1~99, 0 to keep the policy of the thread
+  inline void set_realtime_priority(int priority) { _priority = priority; }
+  //! \arg cpu the core running the loop, -1 for any
+  inline void set_cpu_affinity(int cpu) { _cpu = cpu; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! run the loop in the calling thread, until the callback returns false
+   *  or stop() is called. The scheduling of the thread is restored at the end.
+   *  \return false if the timer could not be created */
+  inline bool run(const TickCallback & callback) {
+    _stop = false;
+    return loop(callback);
+  }
+
+  //! run the loop in a thread of its own. \return false if already running
+  inline bool start(const TickCallback & callback) {
+    if (_running)
+      return false;
+    if (_thread.joinable()) // the previous loop returned by itself
+      _thread.join();
+    // before the thread starts: a stop() meanwhile must not be lost
+    _stop = false;
+    _running = true; // for is_running()
+    _thread = std::thread([this, callback]() { loop(callback); });
+    return true;
+  }
+
+  //! stop the loop, from any thread including the callback, at the latest at the next tick
+  inline void stop() {
+    _stop = true;
+    if (_thread.joinable() && _thread.get_id() != std::this_thread::get_id())
+      _thread.join();
+  }
+
+  inline bool is_running() const { return _running; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! can be called by any thread, including during the loop
+  inline RateStats get_stats() const {
+    RateStats stats;
+    stats.ticks = _nticks;
+    stats.missed = _nmissed;
+    uint64_t elapsed_ns = _last_ns - _start_ns;
+    stats.rate_hz = (elapsed_ns ? (stats.ticks + stats.missed) * 1E9 / elapsed_ns : 0);
+    stats.late_p50_us = _late.percentile(50);
+    stats.late_p99_us = _late.percentile(99);
+    stats.late_max_us = _late.max();
+    stats.jitter_p50_us = _jitter.percentile(50);
+    stats.jitter_p99_us = _jitter.percentile(99);
+    stats.jitter_max_us = _jitter.max();
+    return stats;
+  }
+
+protected:
+  //! the loop of run() and start(), _stop is reset by them
+  bool loop(const TickCallback & callback) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (fd < 0) {
+      MIP_LOG_ERROR("MipRateLoop: timerfd_create() failed: '%s'\n", strerror(errno));
+      _running = false;
+      return false;
+    }
+    // the scheduling of the thread, to restore it at the end
+    int old_policy;
+    struct sched_param old_param;
+    cpu_set_t old_cpus;
+    pthread_getschedparam(pthread_self(), &old_policy, &old_param);
+    pthread_getaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus);
+    apply_scheduling();
+
+    reset_stats();
+    _running = true;
+    struct itimerspec spec;
+    _start_ns = _last_ns = now_ns();
+    uint64_t period_ns = _period_ns, deadline_ns = _start_ns + period_ns;
+    spec.it_value.tv_sec = deadline_ns / 1000000000ULL;
+    spec.it_value.tv_nsec = deadline_ns % 1000000000ULL;
+    spec.it_interval.tv_sec = period_ns / 1000000000ULL;
+    spec.it_interval.tv_nsec = period_ns % 1000000000ULL;
+    bool ok = (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0);
+    if (!ok)
+      MIP_LOG_ERROR("MipRateLoop: timerfd_settime() failed: '%s'\n", strerror(errno));
+    while (ok && !_stop) {
+      uint64_t nexpirations;
+      if (read(fd, &nexpirations, sizeof(nexpirations)) != sizeof(nexpirations)) {
+        if (errno == EINTR)
+          continue;
+        MIP_LOG_ERROR("MipRateLoop: could not read the timer: '%s'\n", strerror(errno));
+        ok = false;
+        break;
+      }
+      uint64_t wakeup_ns = now_ns();
+      // the ticks skipped because the previous callback was too long
+      _nmissed += nexpirations - 1;
+      deadline_ns += (nexpirations - 1) * period_ns;
+      _late.record(wakeup_ns > deadline_ns ? (wakeup_ns - deadline_ns) / 1000 : 0);
+      uint64_t interval_ns = wakeup_ns - _last_ns, expected_ns = nexpirations * period_ns;
+      _jitter.record((interval_ns > expected_ns ? interval_ns - expected_ns
+                                                : expected_ns - interval_ns) / 1000);
+      _last_ns = wakeup_ns;
+      deadline_ns += period_ns;
+      ++_nticks;
+      if (!callback())
+        break;
+    } // end while (ok && !_stop)
+    _running = false;
+    close(fd);
+    pthread_setschedparam(pthread_self(), old_policy, &old_param);
+    pthread_setaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus);
+    return ok;
+  }
+
+  static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+  inline void reset_stats() {
+    _nticks = _nmissed = 0;
+    _late.reset();
+    _jitter.reset();
+  }
+
+  //! SCHED_FIFO and affinity of the calling thread, if set. Not fatal if not permitted
+  inline void apply_scheduling() {
+    if (_priority > 0) {
+      struct sched_param param;
+      param.sched_priority = _priority;
+      int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      if (err)
+        MIP_LOG_WARN("MipRateLoop: could not set SCHED_FIFO priority %i: '%s'\n",
+                     _priority, strerror(err));
+    }
+    if (_cpu >= 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(_cpu, &cpus);
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      if (err)
+        MIP_LOG_WARN("MipRateLoop: could not pin the loop on CPU %i: '%s'\n",
+                     _cpu, strerror(err));
+    }
+  }
+
+  uint64_t _period_ns;
+  int _priority, _cpu;
+  std::atomic<bool> _running, _stop;
+  std::thread _thread;
+  //! the statistics, written by the loop only
+  std::atomic<unsigned long> _nticks, _nmissed;
+  std::atomic<uint64_t> _start_ns, _last_ns;
+  MipHistogram _late, _jitter;
+}; // end class MipRateLoop
+
+#endif // MIPRATELOOP_H
@@ -0,0 +1,363 @@
+/*!
+  \file        mipreconnect.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A manager reconnecting the known robots as soon as they advertise again.
+
+The robots are kept on the white list of the adapter, and while one of them
+is missing, an LE connection with the white list as initiator filter is pending:
+the controller itself connects the first robot that advertises,
+about one advertising interval after it comes back, without scanning from
+the host. The GATT connection of the Mip then reuses this link,
+and the Mip restores its LEDs, volume and game mode, \see Mip::reconnect().
+
+The links are followed with the HCI events of a raw socket of the adapter,
+dispatched by the thread of the manager.
+\code
+Mip mip;
+mip.start_io_thread();
+mip.connect(NULL, "hci0", "D0:39:72:B7:AF:66");
+MipReconnectManager manager;
+manager.start("hci0");
+manager.add_robot(mip);
+\endcode
+The white list is shared by the whole adapter: other LE connections
+should not be started on it meanwhile.
+Needs the CAP_NET_RAW and CAP_NET_ADMIN capabilities, like hcitool.
+ */
+#ifndef MIPRECONNECT_H
+#define MIPRECONNECT_H
+
+#include "gattmip.h"
+#include "mipworker.h"
+extern "C" {
+#include "libgatt/src/hci.h"
+#include "libgatt/src/hci_lib.h"
+}
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+class MipReconnectManager {
+public:
+  //! LE_LINK of the kernel, missing from the hci.h of libgatt
+  static const uint8_t LE_LINK_TYPE = 0x80;
+  //! how often the robots linked but not connected are retried, in milliseconds
+  static const unsigned int CHECK_PERIOD_MS = 500;
+
+  MipReconnectManager() : _cmd_dd(-1), _evt_dd(-1), _evt_source(NULL), _check_source(NULL),
+    _create_pending(false), _cancel_sent_us(0), _whitelist_dirty(false), _whitelist_size(0),
+    _nreconnections(0) {}
+
+  virtual ~MipReconnectManager() { stop(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! start following the links of an adapter.
+   * \param device_name
+   *  the Bluetooth device used by the robots, for instance "hci0"
+   * \return true if success */
+  inline bool start(const std::string & device_name = "hci0") {
+    if (is_running())
+      return true;
+    int dev_id = hci_devid(device_name.c_str());
+    if (dev_id < 0 || (_cmd_dd = hci_open_dev(dev_id)) < 0
+        || (_evt_dd = hci_open_dev(dev_id)) < 0) {
+      printf("MipReconnectManager: could not open device '%s'\n", device_name.c_str());
+      close_sockets();
+      return false;
+    }
+    // the commands socket only reads the answers of hci_send_req()
+    struct hci_filter filter;
+    hci_filter_clear(&filter);
+    setsockopt(_cmd_dd, SOL_HCI, HCI_FILTER, &filter, sizeof(filter));
+    hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
+    hci_filter_set_event(EVT_CMD_STATUS, &filter);
+    hci_filter_set_event(EVT_DISCONN_COMPLETE, &filter);
+    hci_filter_set_event(EVT_LE_META_EVENT, &filter);
+    setsockopt(_evt_dd, SOL_HCI, HCI_FILTER, &filter, sizeof(filter));
+    fcntl(_evt_dd, F_SETFL, fcntl(_evt_dd, F_GETFL) | O_NONBLOCK);
+    if (hci_le_read_white_list_size(_cmd_dd, &_whitelist_size, 1000) < 0)
+      printf("MipReconnectManager: could not read the white list size: %s\n", strerror(errno));
+    _worker.start();
+    _worker.invoke_sync([this]() {
+      GIOChannel *channel = g_io_channel_unix_new(_evt_dd);
+      _evt_source = g_io_create_watch(channel, G_IO_IN);
+      // cast through void(*)(void), as G_SOURCE_FUNC() does
+      g_source_set_callback(_evt_source,
+                            (GSourceFunc) (void (*)(void)) MipReconnectManager::events_cb,
+                            this, NULL);
+      g_source_attach(_evt_source, _worker.get_context());
+      g_io_channel_unref(channel);
+      _check_source = g_timeout_source_new(CHECK_PERIOD_MS);
+      g_source_set_callback(_check_source, MipReconnectManager::check_cb, this, NULL);
+      g_source_attach(_check_source, _worker.get_context());
+    });
+    return true;
+  }
+
+  //! stop reconnecting, and empty the white list
+  inline void stop() {
+    if (!is_running())
+      return;
+    _worker.invoke_sync([this]() {
+      if (_create_pending)
+        hci_send_cmd(_cmd_dd, OGF_LE_CTL, OCF_LE_CREATE_CONN_CANCEL, 0, NULL);
+      _create_pending = false;
+      _robots.clear();
+      hci_le_clear_white_list(_cmd_dd, 1000);
+      g_source_destroy(_evt_source);
+      g_source_destroy(_check_source);
+    });
+    _worker.stop();
+    g_source_unref(_evt_source);
+    g_source_unref(_check_source);
+    _evt_source = _check_source = NULL;
+    close_sockets();
+  }
+
+  inline bool is_running() const { return _worker.is_running(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! reconnect a robot whenever its link drops, until remove_robot().
+   *  The robot must use an I/O thread, and must have been connected once:
+   *  its MAC is the one given to Mip::connect().
+   * \return true if success */
+  inline bool add_robot(Mip & mip) {
+    bdaddr_t bdaddr;
+    if (!is_running() || !mip.is_io_thread_running()
+        || str2ba(mip.get_mac().c_str(), &bdaddr) < 0) {
+      printf("MipReconnectManager: the robot must use an I/O thread and be connected once!\n");
+      return false;
+    }
+    _worker.invoke_sync([this, &mip, &bdaddr]() {
+      Robot robot;
+      robot.mip = &mip;
+      bacpy(&robot.bdaddr, &bdaddr);
+      robot.handle = get_link_handle(bdaddr);
+      _robots.push_back(robot);
+      _whitelist_dirty = true;
+      update();
+    });
+    return true;
+  }
+
+  //! stop reconnecting a robot, to call before destroying it
+  inline void remove_robot(Mip & mip) {
+    if (!is_running())
+      return;
+    _worker.invoke_sync([this, &mip]() {
+      for (unsigned int i = 0; i < _robots.size(); ++i) {
+        if (_robots[i].mip != &mip)
+          continue;
+        _robots.erase(_robots.begin() + i);
+        _whitelist_dirty = true;
+        update();
+        return;
+      }
+    });
+  }
+
+  //! \return the number of links created by the controller from the white list
+  inline unsigned int get_reconnections_count() const { return _nreconnections; }
+
+protected:
+  struct Robot {
+    Mip *mip;
+    bdaddr_t bdaddr;
+    //! the handle of the LE link, -1 if down
+    int handle;
+  };
+
+  inline void close_sockets() {
+    if (_cmd_dd >= 0)
+      hci_close_dev(_cmd_dd);
+    if (_evt_dd >= 0)
+      hci_close_dev(_evt_dd);
+    _cmd_dd = _evt_dd = -1;
+  }
+
+  //! \return the handle of the LE link with this address, -1 if none
+  inline int get_link_handle(const bdaddr_t & bdaddr) {
+    struct hci_conn_info_req *cr = (struct hci_conn_info_req *)
+        malloc(sizeof(*cr) + sizeof(struct hci_conn_info));
+    bacpy(&cr->bdaddr, &bdaddr);
+    cr->type = LE_LINK_TYPE;
+    int handle = (ioctl(_cmd_dd, HCIGETCONNINFO, (unsigned long) cr) < 0 ?
+                    -1 : cr->conn_info->handle);
+    free(cr);
+    return handle;
+  }
+
+  inline Robot* find_robot(const bdaddr_t & bdaddr) {
+    for (unsigned int i = 0; i < _robots.size(); ++i)
+      if (!bacmp(&_robots[i].bdaddr, &bdaddr))
+        return &_robots[i];
+    return NULL;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! in the thread of the manager: connect the GATT of the linked robots,
+   *  and keep a white list connection pending while a robot has no link */
+  inline void update() {
+    bool missing_link = false;
+    for (unsigned int i = 0; i < _robots.size(); ++i) {
+      Robot & robot = _robots[i];
+      if (robot.handle < 0)
+        missing_link = true;
+      else if (!robot.mip->is_connected() && robot.mip->get_connect_state() != Mip::CONNECTING)
+        robot.mip->reconnect(); // reuses the link created by the controller
+    }
+    if (_create_pending) {
+      // the white list can not change while it is used, the cancel completes the connection
+      if ((_whitelist_dirty || !missing_link) && !_cancel_sent_us) {
+        hci_send_cmd(_cmd_dd, OGF_LE_CTL, OCF_LE_CREATE_CONN_CANCEL, 0, NULL);
+        _cancel_sent_us = g_get_monotonic_time();
+      }
+      return;
+    }
+    if (_whitelist_dirty)
+      fill_whitelist();
+    if (missing_link)
+      create_connection();
+  }
+
+  inline void fill_whitelist() {
+    _whitelist_dirty = false;
+    if (hci_le_clear_white_list(_cmd_dd, 1000) < 0)
+      printf("MipReconnectManager: could not clear the white list: %s\n", strerror(errno));
+    if (_robots.size() > _whitelist_size)
+      printf("MipReconnectManager: %i robots, but the white list only holds %i!\n",
+             (int) _robots.size(), _whitelist_size);
+    for (unsigned int i = 0; i < _robots.size(); ++i)
+      if (hci_le_add_white_list(_cmd_dd, &_robots[i].bdaddr, LE_PUBLIC_ADDRESS, 1000) < 0)
+        printf("MipReconnectManager: could not add '%s' to the white list: %s\n",
+               _robots[i].mip->get_mac().c_str(), strerror(errno));
+  }
+
+  /*! the parameters of hci_le_create_conn(), but without waiting for the link:
+   *  the LE connection complete event is handled by events_cb() */
+  inline void create_connection() {
+    le_create_connection_cp cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.interval = htobs(0x0010); // continuous scan, 10 ms interval and window
+    cp.window = htobs(0x0010);
+    cp.initiator_filter = 0x01; // the white list, peer_bdaddr is ignored
+    cp.peer_bdaddr_type = LE_PUBLIC_ADDRESS;
+    cp.own_bdaddr_type = LE_PUBLIC_ADDRESS;
+    cp.min_interval = htobs(0x000F); // 18.75 ms
+    cp.max_interval = htobs(0x000F);
+    cp.latency = htobs(0x0000);
+    cp.supervision_timeout = htobs(0x0064); // 1 s: a dropout is detected quickly
+    cp.min_ce_length = htobs(0x0001);
+    cp.max_ce_length = htobs(0x0001);
+    if (hci_send_cmd(_cmd_dd, OGF_LE_CTL, OCF_LE_CREATE_CONN, LE_CREATE_CONN_CP_SIZE, &cp) < 0) {
+      printf("MipReconnectManager: could not create the connection: %s\n", strerror(errno));
+      return;
+    }
+    _create_pending = true;
+    _cancel_sent_us = 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! an HCI event: packet type, event code, parameter length, parameters
+  inline void process_event(const uint8_t *buf, int len) {
+    if (len < 1 + HCI_EVENT_HDR_SIZE || buf[0] != HCI_EVENT_PKT)
+      return;
+    const uint8_t *ptr = buf + 1 + HCI_EVENT_HDR_SIZE;
+    int plen = len - 1 - HCI_EVENT_HDR_SIZE;
+    if (buf[1] == EVT_CMD_STATUS && plen >= EVT_CMD_STATUS_SIZE) {
+      const evt_cmd_status *evt = (const evt_cmd_status *) ptr;
+      if (evt->status && btohs(evt->opcode) == cmd_opcode_pack(OGF_LE_CTL, OCF_LE_CREATE_CONN)) {
+        printf("MipReconnectManager: the controller refused the connection, error 0x%02x\n",
+               evt->status);
+        _create_pending = false; // retried by check_cb()
+        _cancel_sent_us = 0;
+      }
+    }
+    else if (buf[1] == EVT_DISCONN_COMPLETE && plen >= EVT_DISCONN_COMPLETE_SIZE) {
+      const evt_disconn_complete *evt = (const evt_disconn_complete *) ptr;
+      for (unsigned int i = 0; i < _robots.size(); ++i)
+        if (!evt->status && _robots[i].handle == btohs(evt->handle))
+          _robots[i].handle = -1;
+    }
+    else if (buf[1] == EVT_LE_META_EVENT && plen >= 1 + EVT_LE_CONN_COMPLETE_SIZE
+             && ptr[0] == EVT_LE_CONN_COMPLETE) {
+      const evt_le_connection_complete *evt = (const evt_le_connection_complete *) (ptr + 1);
+      bool from_whitelist = _create_pending;
+      _create_pending = false; // the controller only creates one connection at a time
+      _cancel_sent_us = 0;
+      Robot *robot = (evt->status ? NULL : find_robot(evt->peer_bdaddr));
+      if (robot) {
+        robot->handle = btohs(evt->handle);
+        if (from_whitelist)
+          ++_nreconnections;
+      }
+    }
+    else
+      return;
+    update();
+  }
+
+  //! called by GLib when HCI events are pending
+  static gboolean events_cb(GIOChannel *, GIOCondition, gpointer user_data) {
+    MipReconnectManager* this_ = (MipReconnectManager*) user_data;
+    unsigned char buf[HCI_MAX_EVENT_SIZE];
+    int len;
+    while ((len = read(this_->_evt_dd, buf, sizeof(buf))) > 0)
+      this_->process_event(buf, len);
+    return TRUE;
+  }
+
+  //! retry what failed, for instance a GATT connection on a link that was not ready
+  static gboolean check_cb(gpointer user_data) {
+    MipReconnectManager* this_ = (MipReconnectManager*) user_data;
+    // a cancel without answer: the connection is not pending anymore
+    if (this_->_cancel_sent_us
+        && g_get_monotonic_time() - this_->_cancel_sent_us > 2 * CHECK_PERIOD_MS * 1000) {
+      this_->_create_pending = false;
+      this_->_cancel_sent_us = 0;
+    }
+    this_->update();
+    return TRUE;
+  }
+
+  //! the thread dispatching the HCI events
+  MipWorker _worker;
+  //! raw HCI sockets: one for the commands, one for the events
+  int _cmd_dd, _evt_dd;
+  GSource *_evt_source, *_check_source;
+  std::vector<Robot> _robots;
+  //! a white list connection is pending
+  bool _create_pending;
+  gint64 _cancel_sent_us;
+  bool _whitelist_dirty;
+  uint8_t _whitelist_size;
+  std::atomic<unsigned int> _nreconnections;
+}; // end class MipReconnectManager
+
+#endif // MIPRECONNECT_H
@@ -0,0 +1,63 @@
+/*!
+  \file        miprecord_dump.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+Print a log written by MipRecorder, one line per record:
+time since the start of the log, source, direction, command and values.
+With --stats, only decode the whole log and print its throughput.
+ */
+#include "miprecorder.h"
+#include "mipcommands.h"
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("Synopsis: %s LOG [--stats]\n", argv[0]);
+    return -1;
+  }
+  MipRecordReader reader;
+  if (!reader.open(argv[1]))
+    return -1;
+  bool stats_only = (argc >= 3 && std::string(argv[2]) == "--stats");
+  uint64_t start_ns = reader.get_start_monotonic_ns(), decode_start_ns = MipRecord::now_ns();
+  unsigned long nrecords = 0, nbytes = 0;
+  MipRecord r;
+  while (reader.next(r)) {
+    ++nrecords;
+    nbytes += r.len; // use the records, so that decoding is not optimized out
+    if (stats_only)
+      continue;
+    printf("%12.6f %4u %s %-30s", (r.time_ns - start_ns) / 1E9, r.source,
+           (r.direction == MipRecord::COMMAND ? "->" : "<-"),
+           (r.len ? cmd2str(r.data[0]) : "(empty)"));
+    for (unsigned int i = 1; i < r.len; ++i)
+      printf(" %i", r.data[i]);
+    printf("\n");
+  }
+  double decode_s = (MipRecord::now_ns() - decode_start_ns) / 1E9;
+  if (reader.get_position() != reader.get_size())
+    printf("Truncated log: %lu bytes ignored at the end\n",
+           (unsigned long) (reader.get_size() - reader.get_position()));
+  if (stats_only)
+    printf("%lu records, %lu payload bytes, %lu bytes on disk, %.3fs, %.1f MB/s, %.1f ns/record\n",
+           nrecords, nbytes, (unsigned long) reader.get_size(), decode_s,
+           reader.get_size() / 1E6 / decode_s, decode_s * 1E9 / (nrecords ? nrecords : 1));
+  return 0;
+}
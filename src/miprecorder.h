@@ -0,0 +1,410 @@
+/*!
+  \file        miprecorder.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A compact binary log of the traffic with the robots:
+every command sent and every notification received,
+with a CLOCK_MONOTONIC timestamp in nanoseconds.
+
+MipRecorder::record() only pushes the record onto a lock-free queue,
+a background thread encodes and writes them: recording never blocks
+the GLib callbacks. When the queue is full, records are dropped and counted.
+MipRecordReader memory-maps a log and decodes it sequentially,
+at the speed of the disk.
+
+The log is a 24-byte header ("MIPREC01", then the CLOCK_REALTIME and
+CLOCK_MONOTONIC times of the creation, little endian),
+followed by the records, each encoded as:
+- varint: zigzag delta of the timestamp with the previous record
+- varint: (source << 1) | direction
+- byte:   payload length
+- byte:   command number (first byte of the payload), if length > 0
+- varint: for each following byte, zigzag delta with the same byte
+          of the previous payload of the same direction and command
+Repeated commands and steady sensor values thus take one byte per field.
+ */
+#ifndef MIPRECORDER_H
+#define MIPRECORDER_H
+
+#include "mipnotification.h"
+#include "mpsc_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! a command or a notification
+struct MipRecord {
+  enum Direction {
+    COMMAND = 0,
+    NOTIFICATION = 1
+  };
+  //! a command number, then the values of a notification
+  static const unsigned int MAX_LEN = 1 + MipNotification::MAX_VALUES;
+
+  //! CLOCK_MONOTONIC, in nanoseconds
+  uint64_t time_ns;
+  //! the robot, \see Mip::set_recorder()
+  uint32_t source;
+  uint8_t direction;
+  uint8_t len;
+  //! data[0] is the command number
+  uint8_t data[MAX_LEN];
+
+  static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+}; // end struct MipRecord
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! the delta encoding of the records, with the state shared by writer and reader
+class MipRecordCodec {
+public:
+  static const char* magic() { return "MIPREC01"; }
+  static const unsigned int HEADER_SIZE = 24;
+  //! varints of the timestamp and source, length, command, 2 bytes per value at most
+  static const unsigned int MAX_ENCODED_SIZE = 10 + 5 + 2 + 2 * MipNotification::MAX_VALUES;
+
+  MipRecordCodec() { reset(0); }
+
+  //! forget the previous records, before the first one of a log
+  inline void reset(uint64_t start_ns) {
+    _last_time_ns = start_ns;
+    memset(_last_payloads, 0, sizeof(_last_payloads));
+  }
+
+  //! \return the number of bytes written in out, at most MAX_ENCODED_SIZE
+  inline unsigned int encode(const MipRecord & r, uint8_t *out) {
+    uint8_t *ptr = out;
+    ptr = put_varint(ptr, zigzag((int64_t) (r.time_ns - _last_time_ns)));
+    _last_time_ns = r.time_ns;
+    ptr = put_varint(ptr, ((uint64_t) r.source << 1) | (r.direction & 1));
+    *ptr++ = r.len;
+    if (r.len > 0) {
+      *ptr++ = r.data[0];
+      uint8_t *last = _last_payloads[r.direction & 1][r.data[0]];
+      for (unsigned int i = 1; i < r.len; ++i) {
+        ptr = put_varint(ptr, zigzag((int) r.data[i] - (int) last[i]));
+        last[i] = r.data[i];
+      }
+    }
+    return ptr - out;
+  }
+
+  /*! decode the record starting at ptr, and move ptr after it.
+   * \return false at the end of the data, or if the last record is truncated */
+  inline bool decode(const uint8_t *& ptr, const uint8_t *end, MipRecord & r) {
+    const uint8_t *p = ptr;
+    uint64_t time_delta, source;
+    if (!get_varint(p, end, time_delta) || !get_varint(p, end, source) || p >= end)
+      return false;
+    r.time_ns = _last_time_ns + unzigzag(time_delta);
+    r.source = source >> 1;
+    r.direction = source & 1;
+    r.len = *p++;
+    if (r.len > MipRecord::MAX_LEN)
+      return false;
+    if (r.len > 0) {
+      if (p >= end)
+        return false;
+      r.data[0] = *p++;
+      const uint8_t *last = _last_payloads[r.direction][r.data[0]];
+      for (unsigned int i = 1; i < r.len; ++i) {
+        uint64_t delta;
+        if (!get_varint(p, end, delta))
+          return false;
+        r.data[i] = last[i] + (int) unzigzag(delta);
+      }
+      memcpy(_last_payloads[r.direction][r.data[0]] + 1, r.data + 1, r.len - 1);
+    }
+    _last_time_ns = r.time_ns;
+    ptr = p;
+    return true;
+  }
+
+protected:
+  static inline uint64_t zigzag(int64_t v) { return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63); }
+  static inline int64_t unzigzag(uint64_t v) { return (int64_t) (v >> 1) ^ -(int64_t) (v & 1); }
+
+  static inline uint8_t* put_varint(uint8_t *ptr, uint64_t v) {
+    while (v >= 0x80) {
+      *ptr++ = (uint8_t) v | 0x80;
+      v >>= 7;
+    }
+    *ptr++ = (uint8_t) v;
+    return ptr;
+  }
+  static inline bool get_varint(const uint8_t *& ptr, const uint8_t *end, uint64_t & v) {
+    v = 0;
+    for (unsigned int shift = 0; shift < 64 && ptr < end; shift += 7) {
+      uint8_t byte = *ptr++;
+      v |= (uint64_t) (byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  uint64_t _last_time_ns;
+  //! the last payload for each direction and command
+  uint8_t _last_payloads[2][256][MipRecord::MAX_LEN];
+}; // end class MipRecordCodec
+
+////////////////////////////////////////////////////////////////////////////////
+
+class MipRecorder {
+public:
+  static const unsigned int QUEUE_SIZE = 4096;
+  //! how often the background thread drains the queue, in milliseconds
+  static const unsigned int WRITE_PERIOD_MS = 10;
+  static const unsigned int BUFFER_SIZE = 1 << 16;
+
+  MipRecorder() : _fd(-1), _stop(false), _nrecords(0), _ndropped(0), _nbytes(0) {}
+
+  virtual ~MipRecorder() { close(); }
+
+  //! create the log, overwriting it if it exists. \return true if success
+  inline bool open(const std::string & path) {
+    if (is_open())
+      return false;
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+      printf("MipRecorder: could not create '%s'\n", path.c_str());
+      return false;
+    }
+    struct timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    uint64_t start_ns = MipRecord::now_ns();
+    _buffer.clear();
+    for (unsigned int i = 0; i < 8; ++i)
+      _buffer.push_back(MipRecordCodec::magic()[i]);
+    put_u64(realtime.tv_sec * 1000000000ULL + realtime.tv_nsec);
+    put_u64(start_ns);
+    _codec.reset(start_ns);
+    _nbytes = 0;
+    _stop = false;
+    _thread = std::thread(&MipRecorder::run, this);
+    return true;
+  }
+
+  //! write the pending records and close the log
+  inline void close() {
+    if (!is_open())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(_stop_mutex);
+      _stop = true;
+    }
+    _stop_cv.notify_one();
+    _thread.join();
+    ::close(_fd);
+    _fd = -1;
+  }
+
+  inline bool is_open() const { return _fd >= 0; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! record a command or notification payload. Can be called by any thread, never blocks.
+   * \return false if the record was dropped, queue full */
+  inline bool record(MipRecord::Direction direction, uint32_t source,
+                     const uint8_t *data, unsigned int len) {
+    MipRecord r;
+    r.time_ns = MipRecord::now_ns();
+    r.source = source;
+    r.direction = direction;
+    r.len = (len < MipRecord::MAX_LEN ? len : MipRecord::MAX_LEN);
+    memcpy(r.data, data, r.len);
+    return push(r);
+  }
+  //! record a decoded notification
+  inline bool record(uint32_t source, const MipNotification & notif) {
+    MipRecord r;
+    r.time_ns = MipRecord::now_ns();
+    r.source = source;
+    r.direction = MipRecord::NOTIFICATION;
+    r.len = 1 + notif.nvalues;
+    r.data[0] = notif.cmd;
+    memcpy(r.data + 1, notif.values, notif.nvalues);
+    return push(r);
+  }
+
+  //! \return the number of records written, and dropped because the queue was full
+  inline unsigned long get_records_count() const { return _nrecords; }
+  inline unsigned long get_dropped_count() const { return _ndropped; }
+  //! \return the size of the log written so far, in bytes
+  inline unsigned long get_bytes_count() const { return _nbytes; }
+
+protected:
+  inline bool push(const MipRecord & r) {
+    if (_queue.push(r))
+      return true;
+    ++_ndropped;
+    return false;
+  }
+
+  inline void put_u64(uint64_t v) {
+    for (unsigned int i = 0; i < 8; ++i)
+      _buffer.push_back((v >> (8 * i)) & 0xFF);
+  }
+
+  //! the body of the background thread
+  inline void run() {
+    MipRecord r;
+    while (true) {
+      bool stop;
+      {
+        std::unique_lock<std::mutex> lock(_stop_mutex);
+        _stop_cv.wait_for(lock, std::chrono::milliseconds((unsigned int) WRITE_PERIOD_MS),
+                          [this] { return _stop; });
+        stop = _stop;
+      }
+      // encode all the records queued so far
+      while (_queue.pop(r)) {
+        size_t used = _buffer.size();
+        _buffer.resize(used + MipRecordCodec::MAX_ENCODED_SIZE);
+        _buffer.resize(used + _codec.encode(r, &_buffer[used]));
+        ++_nrecords;
+        if (_buffer.size() >= BUFFER_SIZE)
+          flush();
+      }
+      flush();
+      if (stop)
+        break;
+    } // end while (true)
+  }
+
+  inline void flush() {
+    size_t written = 0;
+    while (written < _buffer.size()) {
+      ssize_t n = write(_fd, &_buffer[written], _buffer.size() - written);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        printf("MipRecorder: write error, %i bytes lost\n", (int) (_buffer.size() - written));
+        break;
+      }
+      written += n;
+    }
+    _nbytes += written;
+    _buffer.clear();
+  }
+
+  int _fd;
+  MpscRing<MipRecord, QUEUE_SIZE> _queue;
+  //! only used by the background thread, after open()
+  MipRecordCodec _codec;
+  std::vector<uint8_t> _buffer;
+  std::thread _thread;
+  std::mutex _stop_mutex;
+  std::condition_variable _stop_cv;
+  bool _stop;
+  std::atomic<unsigned long> _nrecords, _ndropped, _nbytes;
+}; // end class MipRecorder
+
+////////////////////////////////////////////////////////////////////////////////
+
+class MipRecordReader {
+public:
+  MipRecordReader() : _data(NULL), _size(0), _ptr(NULL) {}
+
+  virtual ~MipRecordReader() { close(); }
+
+  //! map a log in memory. \return true if success
+  inline bool open(const std::string & path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t) MipRecordCodec::HEADER_SIZE) {
+      printf("MipRecordReader: could not read '%s'\n", path.c_str());
+      if (fd >= 0)
+        ::close(fd);
+      return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file
+    if (data == MAP_FAILED)
+      return false;
+    _data = (const uint8_t *) data;
+    _size = st.st_size;
+    madvise(data, _size, MADV_SEQUENTIAL);
+    if (memcmp(_data, MipRecordCodec::magic(), 8)) {
+      printf("MipRecordReader: '%s' is not a MiP log\n", path.c_str());
+      close();
+      return false;
+    }
+    rewind();
+    return true;
+  }
+
+  inline void close() {
+    if (_data)
+      munmap((void *) _data, _size);
+    _data = _ptr = NULL;
+    _size = 0;
+  }
+
+  //! go back to the first record
+  inline void rewind() {
+    _ptr = _data + MipRecordCodec::HEADER_SIZE;
+    _codec.reset(get_start_monotonic_ns());
+  }
+
+  //! decode the next record. \return false at the end of the log
+  inline bool next(MipRecord & r) {
+    return _data && _codec.decode(_ptr, _data + _size, r);
+  }
+
+  //! CLOCK_REALTIME and CLOCK_MONOTONIC at the creation of the log, in nanoseconds
+  inline uint64_t get_start_realtime_ns() const { return get_u64(8); }
+  inline uint64_t get_start_monotonic_ns() const { return get_u64(16); }
+  //! \return the size of the log, and the bytes decoded so far
+  inline size_t get_size() const { return _size; }
+  inline size_t get_position() const { return _ptr - _data; }
+
+protected:
+  inline uint64_t get_u64(unsigned int offset) const {
+    uint64_t v = 0;
+    for (unsigned int i = 0; i < 8; ++i)
+      v |= (uint64_t) _data[offset + i] << (8 * i);
+    return v;
+  }
+
+  const uint8_t *_data;
+  size_t _size;
+  const uint8_t *_ptr;
+  MipRecordCodec _codec;
+}; // end class MipRecordReader
+
+#endif // MIPRECORDER_H
@@ -0,0 +1,366 @@
+/*!
+  \file        mipscanner.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A Bluetooth Low Energy scanner finding the MiP robots around,
+instead of "sudo hcitool lescan".
+
+The advertising reports are read from a raw HCI socket of the adapter,
+in batches (recvmmsg()) and with a large receive buffer,
+so that thousands of adverts per second are processed without drops,
+the drops of the kernel being counted anyway, \see get_dropped_count().
+Each advertiser is stored once, in a hash map indexed by its address,
+with its latest RSSI and the time it was last seen.
+The robots are recognized by the services of the MiP BLE protocol,
+or by the filters added with add_name_filter() and add_manufacturer_filter().
+\code
+MipScanner scanner;
+if (scanner.scan(3000, "hci0"))
+  for (MipScanner::Device & robot : scanner.get_robots())
+    printf("%s '%s' %i dBm\n", robot.mac().c_str(), robot.name.c_str(), robot.rssi);
+\endcode
+Needs the CAP_NET_RAW and CAP_NET_ADMIN capabilities, like hcitool.
+ */
+#ifndef MIPSCANNER_H
+#define MIPSCANNER_H
+
+extern "C" {
+#include "libgatt/src/bluetooth.h"
+#include "libgatt/src/hci.h"
+#include "libgatt/src/hci_lib.h"
+}
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MipScanner {
+public:
+  //! the GATT services of the MiP BLE protocol, advertised by the robots
+  static const uint16_t MIP_RECEIVE_DATA_SERVICE = 0xFFE0;
+  static const uint16_t MIP_SEND_DATA_SERVICE = 0xFFE5;
+  //! the kernel receive buffer of the socket, in bytes
+  static const int RECEIVE_BUFFER_SIZE = 4 * 1024 * 1024;
+  //! the HCI events read per system call
+  static const unsigned int BATCH_SIZE = 32;
+
+  //! an advertiser
+  struct Device {
+    bdaddr_t bdaddr;
+    //! LE_PUBLIC_ADDRESS or LE_RANDOM_ADDRESS
+    uint8_t bdaddr_type;
+    //! the local name, if advertised
+    std::string name;
+    //! of the latest report, in dBm
+    int rssi;
+    //! CLOCK_MONOTONIC, in microseconds
+    uint64_t first_seen_us, last_seen_us;
+    unsigned int nreports;
+    //! true if one of its reports matched the filters
+    bool is_robot;
+
+    inline std::string mac() const {
+      char str[18];
+      ba2str(&bdaddr, str);
+      return str;
+    }
+  }; // end struct Device
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! ctor, recognizing the robots by their services
+  MipScanner() : _dd(-1), _nreports(0), _ndropped(0) {
+    add_service_filter(MIP_RECEIVE_DATA_SERVICE);
+    add_service_filter(MIP_SEND_DATA_SERVICE);
+    for (unsigned int i = 0; i < BATCH_SIZE; ++i) {
+      _iovecs[i].iov_base = _buffers[i];
+      _iovecs[i].iov_len = sizeof(_buffers[i]);
+    }
+  }
+
+  virtual ~MipScanner() { stop(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! recognize the robots whose local name contains name, for instance "Bubi"
+  inline void add_name_filter(const std::string & name) { _name_filters.push_back(name); }
+  //! recognize the robots whose manufacturer specific data start with this company identifier
+  inline void add_manufacturer_filter(uint16_t company_id) {
+    _manufacturer_filters.push_back(company_id);
+  }
+  //! recognize the robots advertising this 16-bit service UUID
+  inline void add_service_filter(uint16_t uuid) { _service_filters.push_back(uuid); }
+  //! without filters, all the advertisers are robots
+  inline void clear_filters() {
+    _name_filters.clear();
+    _manufacturer_filters.clear();
+    _service_filters.clear();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! start an active scan, the reports are then read by process_events().
+   * \param device_name
+   *  the Bluetooth device to use, for instance "hci0", \see bluetooth_mac2device()
+   * \return true if success */
+  inline bool start(const std::string & device_name = "hci0") {
+    if (is_scanning())
+      return true;
+    int dev_id = hci_devid(device_name.c_str());
+    if (dev_id < 0 || (_dd = hci_open_dev(dev_id)) < 0) {
+      printf("MipScanner: could not open device '%s'\n", device_name.c_str());
+      _dd = -1;
+      return false;
+    }
+    // a scan may still be running, for instance after a crash
+    hci_le_set_scan_enable(_dd, 0x00, 0x00, 1000);
+    // active scan, so that the scan responses give the names, 10 ms interval and window
+    if (hci_le_set_scan_parameters(_dd, 0x01, htobs(0x0010), htobs(0x0010),
+                                   LE_PUBLIC_ADDRESS, 0x00, 1000) < 0
+        // no duplicate filtering by the controller: we want the RSSI updates
+        || hci_le_set_scan_enable(_dd, 0x01, 0x00, 1000) < 0) {
+      printf("MipScanner: could not start the scan on '%s': %s\n",
+             device_name.c_str(), strerror(errno));
+      close(_dd);
+      _dd = -1;
+      return false;
+    }
+    struct hci_filter filter;
+    hci_filter_clear(&filter);
+    hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
+    hci_filter_set_event(EVT_LE_META_EVENT, &filter);
+    setsockopt(_dd, SOL_HCI, HCI_FILTER, &filter, sizeof(filter));
+    // SO_RCVBUFFORCE goes beyond rmem_max with CAP_NET_ADMIN
+    int size = RECEIVE_BUFFER_SIZE;
+    if (setsockopt(_dd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+      setsockopt(_dd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    // the count of the packets dropped by the kernel comes with each one
+    int one = 1;
+    setsockopt(_dd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+    return true;
+  }
+
+  //! stop the scan, the devices found are kept
+  inline void stop() {
+    if (!is_scanning())
+      return;
+    hci_le_set_scan_enable(_dd, 0x00, 0x00, 1000);
+    close(_dd);
+    _dd = -1;
+  }
+
+  inline bool is_scanning() const { return _dd >= 0; }
+  //! the socket to watch for POLLIN, for instance with GLib, before calling process_events()
+  inline int get_fd() const { return _dd; }
+
+  /*! wait for the reports, at most timeout_ms, and process all those received.
+   * \return the number of advertising reports processed */
+  inline unsigned int process_events(int timeout_ms = 0) {
+    if (!is_scanning())
+      return 0;
+    struct pollfd pfd;
+    pfd.fd = _dd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+      return 0;
+    unsigned int nreports = 0;
+    while (true) {
+      for (unsigned int i = 0; i < BATCH_SIZE; ++i) {
+        memset(&_msgs[i].msg_hdr, 0, sizeof(_msgs[i].msg_hdr));
+        _msgs[i].msg_hdr.msg_iov = &_iovecs[i];
+        _msgs[i].msg_hdr.msg_iovlen = 1;
+        _msgs[i].msg_hdr.msg_control = _controls[i];
+        _msgs[i].msg_hdr.msg_controllen = sizeof(_controls[i]);
+      }
+      int nmsgs = recvmmsg(_dd, _msgs, BATCH_SIZE, MSG_DONTWAIT, NULL);
+      if (nmsgs <= 0) // EAGAIN: drained
+        break;
+      uint64_t now_us = monotonic_us();
+      for (int i = 0; i < nmsgs; ++i) {
+        read_drops(_msgs[i].msg_hdr);
+        nreports += process_event(_buffers[i], _msgs[i].msg_len, now_us);
+      }
+      if (nmsgs < (int) BATCH_SIZE)
+        break;
+    } // end while (true)
+    return nreports;
+  }
+
+  /*! scan during a given time, then stop.
+   * \return true if the scan could be done */
+  inline bool scan(unsigned int duration_ms, const std::string & device_name = "hci0") {
+    if (!start(device_name))
+      return false;
+    uint64_t end_us = monotonic_us() + duration_ms * 1000ULL;
+    uint64_t now_us;
+    while ((now_us = monotonic_us()) < end_us)
+      process_events((end_us - now_us) / 1000 + 1);
+    stop();
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the robots found, the closest (highest RSSI) first
+  inline std::vector<Device> get_robots() const {
+    std::vector<Device> robots;
+    DeviceMap::const_iterator it = _devices.begin();
+    for (; it != _devices.end(); ++it)
+      if (it->second.is_robot)
+        robots.push_back(it->second);
+    std::sort(robots.begin(), robots.end(),
+              [](const Device & a, const Device & b) { return a.rssi > b.rssi; });
+    return robots;
+  }
+  //! \return the device with this MAC, for instance "D0:39:72:B7:AF:66", NULL if not found
+  inline const Device* find(const std::string & mac) const {
+    bdaddr_t bdaddr;
+    if (str2ba(mac.c_str(), &bdaddr) < 0)
+      return NULL;
+    DeviceMap::const_iterator it = _devices.find(key(bdaddr));
+    return (it == _devices.end() ? NULL : &it->second);
+  }
+  //! \return the number of advertisers found, robots or not
+  inline unsigned int get_devices_count() const { return _devices.size(); }
+  //! forget the devices found
+  inline void clear() { _devices.clear(); }
+
+  //! \return the number of advertising reports processed since the creation
+  inline unsigned long get_reports_count() const { return _nreports; }
+  //! \return the number of HCI events dropped by the kernel, receive buffer full
+  inline unsigned long get_dropped_count() const { return _ndropped; }
+
+protected:
+  typedef std::unordered_map<uint64_t, Device> DeviceMap;
+
+  static inline uint64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  }
+
+  //! the 48 bits of the address, as hash map key
+  static inline uint64_t key(const bdaddr_t & bdaddr) {
+    uint64_t k = 0;
+    for (unsigned int i = 0; i < 6; ++i)
+      k = (k << 8) | bdaddr.b[i];
+    return k;
+  }
+
+  //! the SO_RXQ_OVFL counter is the total of the drops of the socket
+  inline void read_drops(struct msghdr & hdr) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        uint32_t ndropped;
+        memcpy(&ndropped, CMSG_DATA(cmsg), sizeof(ndropped));
+        _ndropped = ndropped;
+      }
+  }
+
+  //! parse an HCI event, in place. \return the number of advertising reports
+  inline unsigned int process_event(const uint8_t *buf, unsigned int len, uint64_t now_us) {
+    // packet type, event code, parameter length, then the LE meta event
+    if (len < 1 + HCI_EVENT_HDR_SIZE + EVT_LE_META_EVENT_SIZE + 1
+        || buf[0] != HCI_EVENT_PKT || buf[1] != EVT_LE_META_EVENT)
+      return 0;
+    const uint8_t *ptr = buf + 1 + HCI_EVENT_HDR_SIZE, *end = buf + len;
+    if (ptr[0] != EVT_LE_ADVERTISING_REPORT)
+      return 0;
+    unsigned int nreports = ptr[1];
+    ptr += 2;
+    for (unsigned int i = 0; i < nreports; ++i) {
+      // evt_type, bdaddr_type, bdaddr, length, data, then RSSI
+      if (ptr + LE_ADVERTISING_INFO_SIZE > end)
+        return i;
+      const le_advertising_info *info = (const le_advertising_info *) ptr;
+      if (ptr + LE_ADVERTISING_INFO_SIZE + info->length + 1 > end)
+        return i;
+      process_report(*info, (int8_t) info->data[info->length], now_us);
+      ptr += LE_ADVERTISING_INFO_SIZE + info->length + 1;
+      ++_nreports;
+    }
+    return nreports;
+  }
+
+  //! store an advertising report, and check if it comes from a robot
+  inline void process_report(const le_advertising_info & info, int rssi, uint64_t now_us) {
+    Device & device = _devices[key(info.bdaddr)];
+    if (device.nreports == 0) { // new device
+      bacpy(&device.bdaddr, &info.bdaddr);
+      device.bdaddr_type = info.bdaddr_type;
+      device.first_seen_us = now_us;
+      device.is_robot = false;
+    }
+    ++device.nreports;
+    device.rssi = rssi;
+    device.last_seen_us = now_us;
+    bool matched = _name_filters.empty() && _manufacturer_filters.empty()
+        && _service_filters.empty();
+    // the advertising data is a list of {length, type, data}
+    const uint8_t *ptr = info.data, *end = info.data + info.length;
+    while (ptr < end && ptr[0] > 0 && ptr + 1 + ptr[0] <= end) {
+      uint8_t type = ptr[1];
+      const uint8_t *data = ptr + 2;
+      unsigned int data_len = ptr[0] - 1;
+      if (type == 0x08 || type == 0x09) { // shortened or complete local name
+        if (device.name.compare(0, std::string::npos, (const char*) data, data_len))
+          device.name.assign((const char*) data, data_len); // only allocates when it changes
+        for (unsigned int i = 0; i < _name_filters.size(); ++i)
+          matched = matched || device.name.find(_name_filters[i]) != std::string::npos;
+      }
+      else if (type == 0xFF && data_len >= 2) { // manufacturer specific data
+        uint16_t company_id = data[0] | (data[1] << 8);
+        matched = matched || std::find(_manufacturer_filters.begin(), _manufacturer_filters.end(),
+                                       company_id) != _manufacturer_filters.end();
+      }
+      else if (type == 0x02 || type == 0x03) { // incomplete or complete 16-bit service UUIDs
+        for (unsigned int i = 0; i + 1 < data_len; i += 2) {
+          uint16_t uuid = data[i] | (data[i + 1] << 8);
+          matched = matched || std::find(_service_filters.begin(), _service_filters.end(),
+                                         uuid) != _service_filters.end();
+        }
+      }
+      ptr += 1 + ptr[0];
+    } // end while (ptr)
+    device.is_robot = device.is_robot || matched;
+  }
+
+  //! the raw HCI socket, -1 if not scanning
+  int _dd;
+  //! the batches of recvmmsg()
+  uint8_t _buffers[BATCH_SIZE][HCI_MAX_EVENT_SIZE];
+  char _controls[BATCH_SIZE][CMSG_SPACE(sizeof(uint32_t))];
+  struct iovec _iovecs[BATCH_SIZE];
+  struct mmsghdr _msgs[BATCH_SIZE];
+  //! the devices found, indexed by address
+  DeviceMap _devices;
+  std::vector<std::string> _name_filters;
+  std::vector<uint16_t> _manufacturer_filters, _service_filters;
+  unsigned long _nreports, _ndropped;
+}; // end class MipScanner
+
+#endif // MIPSCANNER_H
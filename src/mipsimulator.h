@@ -0,0 +1,566 @@
+/*!
+  \file        mipsimulator.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A simulated MiP robot, for testing and benchmarking without Bluetooth.
+
+The robot is connected to a Mip through a socketpair(SOCK_SEQPACKET)
+that replaces the Bluetooth socket beneath GAttrib, \see Mip::set_channel_factory().
+It receives the ATT write commands sent by Mip::send_order(),
+and answers the requests with the same ASCII-hex notifications as a real robot.
+The motion commands move the robot on a plane, which updates its odometer.
+The latency, jitter and loss of the link can be configured.
+
+\code
+MipSimulator simulator;
+simulator.set_latency(5000, 2000); // 5 ms + [0, 2] ms
+Mip mip;
+simulator.connect(mip, main_loop);
+mip.continuous_drive(10, 0);
+\endcode
+
+The simulated robots run in the GLib context of a MipWorker,
+shared by several simulators or owned by each of them.
+ */
+#ifndef MIPSIMULATOR_H
+#define MIPSIMULATOR_H
+
+#include "gattmip.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <deque>
+#include <random>
+
+class MipSimulator {
+public:
+  //! the position of the robot, in meters and radians
+  struct Pose {
+    double x, y, theta;
+    Pose() : x(0), y(0), theta(0) {}
+  };
+
+  //! how long a continuous drive lasts if not sent again, as the real robot
+  static const unsigned int CONTINUOUS_DRIVE_DURATION_MS = 100;
+  //! the speeds of distance_drive() and angle_drive()
+  static constexpr double DRIVE_SPEED_MS = .3, TURN_SPEED_RADS = 3;
+  //! the period of the radar notifications, when the radar is on
+  static const unsigned int RADAR_PERIOD_MS = 100;
+
+  //! use a shared worker, or a worker of its own if NULL
+  MipSimulator(MipWorker* worker = NULL, const std::string & mac = "00:00:00:00:00:01")
+    : _worker(worker), _mac(mac), _fd(-1), _read_source(NULL), _delay_source(NULL),
+      _radar_source(NULL), _latency_us(0), _jitter_us(0),
+      _command_loss(0), _notification_loss(0), _random(0),
+      _ncommands(0), _nlost_commands(0), _nnotifications(0), _nlost_notifications(0) {
+    if (!_worker) {
+      _own_worker.reset(new MipWorker());
+      _worker = _own_worker.get();
+    }
+    _worker->start();
+    reset_state();
+  }
+
+  virtual ~MipSimulator() { stop(); }
+
+  //! close the connection, before stopping a shared worker
+  inline void stop() {
+    if (!_worker)
+      return;
+    _worker->invoke_sync([this]() { detach(); });
+    _own_worker.reset();
+    _worker = NULL;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! each command is handled after latency_us + a random delay in [0, jitter_us],
+   *  in order. With no latency nor jitter, the commands are handled at once. */
+  inline void set_latency(unsigned int latency_us, unsigned int jitter_us = 0) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _latency_us = latency_us;
+    _jitter_us = jitter_us;
+  }
+  //! the probabilities, in [0, 1], of losing a command or a notification
+  inline void set_loss(double command_loss, double notification_loss) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _command_loss = command_loss;
+    _notification_loss = notification_loss;
+  }
+  //! the seed of the jitter and losses, for reproducible runs
+  inline void set_seed(unsigned int seed) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _random.seed(seed);
+  }
+  //! \arg voltage between 4.0V and 6.4V
+  inline void set_battery_voltage(double voltage) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const MipCommandInfo & info = mip_command_info(CMD_MIP_STATUS);
+    _battery_raw = std::max(0, std::min((int) round((voltage - info.offset) / info.scale), 255));
+  }
+  //! \see Status enum
+  inline void set_status(Status status) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _status = status;
+  }
+  //! sent every RADAR_PERIOD_MS when the radar is on, \see RadarResponse enum
+  inline void set_radar_response(RadarResponse radar) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _radar_response = radar;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! open a new connection to the robot, closing the former one.
+   *  Can be called by any thread, for instance by a Mip::ChannelFactory.
+   * \return the channel of the robot side, NULL if error */
+  inline GIOChannel* open_channel() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+      printf("MipSimulator: could not create the socketpair: %s\n", strerror(errno));
+      return NULL;
+    }
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    _worker->invoke_sync([this, fds]() { attach(fds[1]); });
+    GIOChannel* channel = g_io_channel_unix_new(fds[0]);
+    g_io_channel_set_close_on_unref(channel, TRUE);
+    return channel;
+  }
+
+  //! connect a robot to this simulator, instead of Bluetooth. \see Mip::connect()
+  inline bool connect(Mip & mip, GMainLoop *main_loop,
+                      unsigned int timeout_ms = Mip::DEFAULT_CONNECT_TIMEOUT_MS) {
+    mip.set_channel_factory([this](Mip &) { return open_channel(); });
+    return mip.connect(main_loop, "simulator", _mac.c_str(), timeout_ms);
+  }
+
+  //! close the connection on the robot side, as a lost link. Mip gets CONNECTION_LOST
+  inline void drop_connection() {
+    _worker->invoke_sync([this]() { detach(); });
+  }
+
+  inline bool is_connected() const { return _fd >= 0; }
+  inline const std::string & get_mac() const { return _mac; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the pose at this instant, integrating the motion commands
+  inline Pose get_pose() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    update_motion(g_get_monotonic_time());
+    return _pose;
+  }
+  //! \return the distance travelled since the last reset, in meters
+  inline double get_odometer_m() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    update_motion(g_get_monotonic_time());
+    return _odometer_m;
+  }
+  //! \return true if the robot is executing a motion command
+  inline bool is_moving() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    update_motion(g_get_monotonic_time());
+    return !_motions.empty();
+  }
+  //! the state set by the commands, \see GameMode enum
+  inline GameMode get_game_mode() { std::lock_guard<std::mutex> lock(_mutex); return _game_mode; }
+  inline unsigned int get_volume() { std::lock_guard<std::mutex> lock(_mutex); return _volume; }
+
+  //! \return the number of commands received, including the lost ones
+  inline unsigned long get_commands_count() const { return _ncommands; }
+  //! \return the number of commands received with a given opcode, including the lost ones
+  inline unsigned long get_commands_count(MipCommand cmd) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ncommands_by_opcode[cmd & 0xFF];
+  }
+  inline unsigned long get_lost_commands_count() const { return _nlost_commands; }
+  //! \return the number of notifications sent, and lost
+  inline unsigned long get_notifications_count() const { return _nnotifications; }
+  inline unsigned long get_lost_notifications_count() const { return _nlost_notifications; }
+
+protected:
+  //! a motion command, the first one of the queue being executed
+  struct Motion {
+    double v_ms, w_rads;
+    gint64 duration_us;
+  };
+  //! a command waiting for the latency of the link
+  struct DelayedCommand {
+    gint64 due_us;
+    uint8_t len;
+    uint8_t pdu[ATT_DEFAULT_LE_MTU];
+  };
+
+  //! the state of a robot just switched on
+  inline void reset_state() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    memset(_ncommands_by_opcode, 0, sizeof(_ncommands_by_opcode));
+    memset(_eeprom, 0, sizeof(_eeprom));
+    _battery_raw = 0x70; // ~6V
+    _status = STATUS_UPRIGHT;
+    _game_mode = 0x01; // app mode
+    _volume = 7;
+    uint8_t chest[5] = {0, 0, 255, 0, 0};
+    memcpy(_chest_led, chest, sizeof(_chest_led));
+    memset(_head_led, 1, sizeof(_head_led));
+    _radar_mode = GESTUREOFF_RADAROFF;
+    _radar_response = RADAR_NO_OBJECT;
+    _detection_mode[0] = _detection_mode[1] = 0;
+    _ir_control = 1;
+    _clap_enabled = 0;
+    _clap_delay = 500;
+    _pose = Pose();
+    _odometer_m = 0;
+    _motions.clear();
+    _pose_us = g_get_monotonic_time();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! in the worker thread
+  inline void attach(int fd) {
+    detach();
+    _fd = fd;
+    GIOChannel *channel = g_io_channel_unix_new(_fd);
+    _read_source = g_io_create_watch(channel, (GIOCondition) (G_IO_IN | G_IO_HUP | G_IO_ERR));
+    // cast through void(*)(void), as G_SOURCE_FUNC() does
+    g_source_set_callback(_read_source, (GSourceFunc) (void (*)(void)) MipSimulator::read_cb,
+                          this, NULL);
+    g_source_attach(_read_source, _worker->get_context());
+    g_io_channel_unref(channel);
+  }
+
+  //! in the worker thread
+  inline void detach() {
+    destroy_source(_read_source);
+    destroy_source(_delay_source);
+    destroy_source(_radar_source);
+    _delayed.clear();
+    if (_fd >= 0)
+      close(_fd);
+    _fd = -1;
+  }
+
+  static inline void destroy_source(GSource* & source) {
+    if (!source)
+      return;
+    g_source_destroy(source);
+    g_source_unref(source);
+    source = NULL;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the commands sent by the Mip
+  static gboolean read_cb(GIOChannel *, GIOCondition, gpointer user_data) {
+    MipSimulator* this_ = (MipSimulator*) user_data;
+    DelayedCommand command;
+    while (this_->_fd >= 0) { // until disconnected by a command
+      ssize_t len = recv(this_->_fd, command.pdu, sizeof(command.pdu), MSG_DONTWAIT);
+      if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return TRUE;
+      if (len <= 0) { // closed by the Mip
+        this_->detach();
+        break;
+      }
+      command.len = len;
+      this_->receive(command);
+    } // end while (_fd >= 0)
+    return FALSE;
+  }
+
+  inline void receive(DelayedCommand & command) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (command.len < 4 || command.pdu[0] != ATT_OP_WRITE_CMD)
+      return;
+    ++_ncommands;
+    ++_ncommands_by_opcode[command.pdu[3]];
+    if (_command_loss > 0 && _uniform(_random) < _command_loss) {
+      ++_nlost_commands;
+      return;
+    }
+    gint64 now_us = g_get_monotonic_time();
+    if (_latency_us == 0 && _jitter_us == 0 && _delayed.empty()) {
+      handle(command.pdu + 3, command.len - 3, now_us);
+      return;
+    }
+    command.due_us = now_us + _latency_us;
+    if (_jitter_us)
+      command.due_us += (gint64) (_uniform(_random) * _jitter_us);
+    // the link keeps the order of the commands
+    if (!_delayed.empty() && command.due_us < _delayed.back().due_us)
+      command.due_us = _delayed.back().due_us;
+    _delayed.push_back(command);
+    if (!_delay_source)
+      arm_delay_source(now_us);
+  }
+
+  inline void arm_delay_source(gint64 now_us) {
+    gint64 delay_us = _delayed.front().due_us - now_us;
+    _delay_source = g_timeout_source_new(delay_us > 0 ? (delay_us + 999) / 1000 : 0);
+    g_source_set_callback(_delay_source, MipSimulator::delay_cb, this, NULL);
+    g_source_attach(_delay_source, _worker->get_context());
+  }
+
+  //! handle the commands whose latency elapsed
+  static gboolean delay_cb(gpointer user_data) {
+    MipSimulator* this_ = (MipSimulator*) user_data;
+    std::lock_guard<std::mutex> lock(this_->_mutex);
+    g_source_unref(this_->_delay_source);
+    this_->_delay_source = NULL;
+    gint64 now_us = g_get_monotonic_time();
+    while (!this_->_delayed.empty() && this_->_delayed.front().due_us <= now_us) {
+      DelayedCommand & command = this_->_delayed.front();
+      this_->handle(command.pdu + 3, command.len - 3, now_us);
+      if (this_->_fd < 0) // disconnected by the command
+        return FALSE;
+      this_->_delayed.pop_front();
+    }
+    if (!this_->_delayed.empty())
+      this_->arm_delay_source(now_us);
+    return FALSE;
+  }
+
+  //! the radar notifications
+  static gboolean radar_cb(gpointer user_data) {
+    MipSimulator* this_ = (MipSimulator*) user_data;
+    std::lock_guard<std::mutex> lock(this_->_mutex);
+    this_->notify(CMD_RADAR_RESPONSE, 1, this_->_radar_response);
+    return TRUE;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! send a notification, as the real robot: "%02X" of the command then of each value
+  inline void notify(MipCommand cmd, unsigned int nvalues,
+                     int v0 = 0, int v1 = 0, int v2 = 0, int v3 = 0, int v4 = 0) {
+    if (_fd < 0)
+      return;
+    ++_nnotifications;
+    if (_notification_loss > 0 && _uniform(_random) < _notification_loss) {
+      ++_nlost_notifications;
+      return;
+    }
+    static const char hex[] = "0123456789ABCDEF";
+    const int values[6] = {cmd, v0, v1, v2, v3, v4};
+    uint8_t pdu[ATT_DEFAULT_LE_MTU];
+    pdu[0] = ATT_OP_HANDLE_NOTIFY;
+    att_put_u16(NOTIFY_HANDLE, pdu + 1);
+    unsigned int len = 3;
+    for (unsigned int i = 0; i <= nvalues; ++i) {
+      pdu[len++] = hex[(values[i] >> 4) & 0xF];
+      pdu[len++] = hex[values[i] & 0xF];
+    }
+    if (send(_fd, pdu, len, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t) len)
+      ++_nlost_notifications; // the Mip does not read anymore
+  }
+
+  //! the handle of the notifications, Mip::_handle_read
+  static const uint16_t NOTIFY_HANDLE = 0x000e;
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! execute a command, _mutex locked. value[0] is the command number
+  inline void handle(const uint8_t *value, unsigned int len, gint64 now_us) {
+    MipCommand cmd = value[0];
+    const MipCommandInfo & info = mip_command_info(cmd);
+    if (info.opcode == ERROR
+        || (info.request_len >= 0 && (int) len - 1 < info.request_len))
+      return; // unknown or too short, ignored as the real robot
+    const uint8_t *p = value + 1;
+    update_motion(now_us);
+    switch (cmd) {
+      // motion
+      case CMD_CONTINUOUS_DRIVE: {
+        _motions.clear();
+        int v_ticks, w_ticks;
+        Mip::continuous_drive_ticks(p[0], p[1], v_ticks, w_ticks);
+        add_motion(ticks2speed(v_ticks, false), ticks2speed(w_ticks, true),
+                   CONTINUOUS_DRIVE_DURATION_MS * 1000, now_us);
+        break;
+      }
+      case CMD_DISTANCE_DRIVE: {
+        double distance_m = p[1] / 100.;
+        double angle_rad = ((p[3] << 8) | p[4]) * M_PI / 180;
+        add_motion(p[0] ? -DRIVE_SPEED_MS : DRIVE_SPEED_MS, 0,
+                   distance_m / DRIVE_SPEED_MS * 1E6, now_us);
+        add_motion(0, p[2] ? TURN_SPEED_RADS : -TURN_SPEED_RADS,
+                   angle_rad / TURN_SPEED_RADS * 1E6, now_us);
+        break;
+      }
+      case CMD_DRIVE_FORWARD_WITH_TIME:
+      case CMD_DRIVE_BACKWARD_WITH_TIME:
+        add_motion((cmd == CMD_DRIVE_FORWARD_WITH_TIME ? 1 : -1) * ticks2speed(p[0], false),
+                   0, p[1] * 7000, now_us);
+        break;
+      case CMD_TURN_LEFT_BY_ANGLE:
+      case CMD_TURN_RIGHT_BY_ANGLE: {
+        double w_rads = ticks2speed(std::max((int) p[1], 1), true);
+        add_motion(0, (cmd == CMD_TURN_LEFT_BY_ANGLE ? 1 : -1) * w_rads,
+                   p[0] * 5 * M_PI / 180 / w_rads * 1E6, now_us);
+        break;
+      }
+      case CMD_STOP:
+        _motions.clear();
+        break;
+      // settings
+      case CMD_SET_GAME_MODE:         _game_mode = p[0]; break;
+      case CMD_SET_MIP_VOLUME:        _volume = std::min((int) p[0], 7); break;
+      case CMD_SET_CHEST_LED:
+        memcpy(_chest_led, p, 3);
+        _chest_led[3] = _chest_led[4] = 0;
+        break;
+      case CMD_FLASH_CHEST_LED:       memcpy(_chest_led, p, 5); break;
+      case CMD_SET_HEAD_LED:          memcpy(_head_led, p, 4); break;
+      case CMD_REST_ODOMETER:         _odometer_m = 0; break;
+      case CMD_SET_GESTURE_OR_RADAR_MODE:
+        _radar_mode = p[0];
+        if (_radar_mode == GESTUREOFF_RADARON && !_radar_source) {
+          _radar_source = g_timeout_source_new(RADAR_PERIOD_MS);
+          g_source_set_callback(_radar_source, MipSimulator::radar_cb, this, NULL);
+          g_source_attach(_radar_source, _worker->get_context());
+        }
+        else if (_radar_mode != GESTUREOFF_RADARON)
+          destroy_source(_radar_source);
+        break;
+      case CMD_MIP_DETECTION_MODE:    memcpy(_detection_mode, p, 2); break;
+      case CMD_IR_REMOTE_CONTROL_ENABLED: _ir_control = p[0]; break;
+      case CMD_CLAP_ENABLED:          _clap_enabled = p[0]; break;
+      case CMD_DELAY_TIME_BETWEEN_TWO_CLAPS: _clap_delay = (p[0] << 8) | p[1]; break;
+      case CMD_SET_USER_DATA:         _eeprom[p[0]] = p[1]; break;
+      case CMD_SLEEP:
+      case CMD_DISCONNECT_APP:
+      case CMD_FORCE_BLE_DISCONNECT:
+        detach();
+        break;
+      // requests
+      case CMD_GET_CURRENT_MIP_GAME_MODE: notify(cmd, 1, _game_mode); break;
+      case CMD_REQUEST_MIP_STATUS:    notify(cmd, 2, _battery_raw, _status); break;
+      case CMD_REQUEST_WEIGHT_UPDATE: notify(cmd, 1, 0); break;
+      case CMD_REQUEST_CHEST_LED:
+        notify(cmd, 5, _chest_led[0], _chest_led[1], _chest_led[2], _chest_led[3], _chest_led[4]);
+        break;
+      case CMD_REQUEST_HEAD_LED:
+        notify(cmd, 4, _head_led[0], _head_led[1], _head_led[2], _head_led[3]);
+        break;
+      case CMD_READ_ODOMETER: {
+        // 48.5 units per cm, highest byte first
+        uint32_t raw = (uint32_t) (_odometer_m / mip_command_info(cmd).scale);
+        notify(cmd, 4, raw >> 24, (raw >> 16) & 0xFF, (raw >> 8) & 0xFF, raw & 0xFF);
+        break;
+      }
+      case CMD_GET_RADAR_MODE:        notify(cmd, 1, _radar_mode); break;
+      case CMD_REQUEST_MIP_DETECTION_MODE:
+        notify(cmd, 2, _detection_mode[0], _detection_mode[1]);
+        break;
+      case CMD_REQUEST_IR_CONTROL_ENABLED: notify(cmd, 1, _ir_control); break;
+      case CMD_GET_USER_OR_OTHER_EEPROM_DATA: notify(cmd, 2, p[0], _eeprom[p[0]]); break;
+      case CMD_GET_MIP_SOFTWARE_VERSION: notify(cmd, 4, 14, 6, 19, 1); break;
+      case CMD_GET_MIP_HARDWARE_INFO: notify(cmd, 2, 1, 1); break;
+      case CMD_GET_MIP_VOLUME:        notify(cmd, 1, _volume); break;
+      case CMD_REQUEST_CLAP_ENABLED:  notify(cmd, 2, _clap_enabled, _clap_delay >> 8); break;
+      default: // sounds, get up, position...: no effect on the simulated state
+        break;
+      } // end switch (cmd)
+  } // end handle()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! the speed of a number of ticks, \see Mip::ticks2speeds(),
+   *  without the offset of the regressions of w: 0 ticks do not turn */
+  static inline double ticks2speed(int ticks, bool angular) {
+    double v_ms, w_rads;
+    Mip::ticks2speeds(ticks, ticks, v_ms, w_rads);
+    if (!angular)
+      return v_ms;
+    return w_rads - (abs(ticks) <= 32 ? -.6876060987078 : .0191642762841);
+  }
+
+  //! queue a motion after the current ones
+  inline void add_motion(double v_ms, double w_rads, gint64 duration_us, gint64 now_us) {
+    if (duration_us <= 0)
+      return;
+    if (_motions.empty())
+      _motion_start_us = now_us;
+    Motion m = {v_ms, w_rads, duration_us};
+    _motions.push_back(m);
+  }
+
+  //! integrate the motions until now_us, _mutex locked
+  inline void update_motion(gint64 now_us) {
+    while (!_motions.empty()) {
+      const Motion & m = _motions.front();
+      gint64 end_us = std::min(now_us, _motion_start_us + m.duration_us);
+      integrate(m, (end_us - std::max(_pose_us, _motion_start_us)) / 1E6);
+      _pose_us = end_us;
+      if (end_us == now_us && now_us < _motion_start_us + m.duration_us)
+        return; // still moving
+      _motion_start_us += m.duration_us;
+      _motions.pop_front();
+    }
+    _pose_us = now_us;
+  }
+
+  //! move along an arc of circle
+  inline void integrate(const Motion & m, double dt) {
+    if (dt <= 0)
+      return;
+    double dtheta = m.w_rads * dt;
+    if (fabs(m.w_rads) < 1E-6) {
+      _pose.x += m.v_ms * dt * cos(_pose.theta);
+      _pose.y += m.v_ms * dt * sin(_pose.theta);
+    }
+    else {
+      double r = m.v_ms / m.w_rads;
+      _pose.x += r * (sin(_pose.theta + dtheta) - sin(_pose.theta));
+      _pose.y -= r * (cos(_pose.theta + dtheta) - cos(_pose.theta));
+    }
+    _pose.theta = atan2(sin(_pose.theta + dtheta), cos(_pose.theta + dtheta));
+    _odometer_m += fabs(m.v_ms) * dt;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  MipWorker* _worker;
+  std::unique_ptr<MipWorker> _own_worker;
+  std::string _mac;
+  //! the robot side of the socketpair, and its sources in the worker context
+  int _fd;
+  GSource *_read_source, *_delay_source, *_radar_source;
+  std::deque<DelayedCommand> _delayed;
+  //! the link
+  unsigned int _latency_us, _jitter_us;
+  double _command_loss, _notification_loss;
+  std::mt19937 _random;
+  std::uniform_real_distribution<double> _uniform;
+  //! the state of the robot, protected by _mutex
+  std::mutex _mutex;
+  int _battery_raw, _status, _game_mode, _volume, _radar_mode, _radar_response;
+  uint8_t _chest_led[5], _head_led[4], _detection_mode[2], _eeprom[256];
+  int _ir_control, _clap_enabled, _clap_delay;
+  Pose _pose;
+  double _odometer_m;
+  std::deque<Motion> _motions;
+  gint64 _motion_start_us, _pose_us;
+  //! the statistics
+  std::atomic<unsigned long> _ncommands, _nlost_commands, _nnotifications, _nlost_notifications;
+  unsigned long _ncommands_by_opcode[256];
+}; // end class MipSimulator
+
+#endif // MIPSIMULATOR_H
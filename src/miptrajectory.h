@@ -0,0 +1,377 @@
+/*!
+  \file        miptrajectory.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+Trajectories compiled offline into timed streams of commands.
+
+MipTrajectory turns a path of poses, or a profile of velocities,
+into the CMD_CONTINUOUS_DRIVE / CMD_DISTANCE_DRIVE PDUs to send,
+each one with its time since the start, through the calibration
+of Mip::speed2ticks(). The continuous drive is sent again every period,
+as the robot stops without it.
+MipTrajectoryPlayer then sends the PDUs at their times,
+with no computation between them: a long mission can be compiled once,
+saved, and replayed.
+\code
+std::vector<MipTrajectory::Pose> square;
+square.push_back(MipTrajectory::Pose(0, 0, 0));
+square.push_back(MipTrajectory::Pose(.5, 0, 0));
+square.push_back(MipTrajectory::Pose(.5, .5, 0));
+MipTrajectory trajectory;
+trajectory.add_path(square);
+trajectory.add_stop();
+MipTrajectoryPlayer player;
+player.play(mip, trajectory);
+\endcode
+ */
+#ifndef MIPTRAJECTORY_H
+#define MIPTRAJECTORY_H
+
+#include "gattmip.h"
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+//! a PDU of a trajectory: the command number then its parameters
+struct MipTimedPdu {
+  //! CMD_DISTANCE_DRIVE is the longest
+  static const unsigned int MAX_LEN = 6;
+  //! since the start of the trajectory
+  uint64_t time_us;
+  uint8_t len;
+  uint8_t value[MAX_LEN];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+class MipTrajectory {
+public:
+  //! the period of the continuous drive
+  static const unsigned int DEFAULT_PERIOD_MS = 50;
+  //! the default speeds of add_path()
+  static constexpr double DEFAULT_V_MS = .3;
+  static constexpr double DEFAULT_W_RADS = 3;
+
+  //! a pose on the floor, in meters and radians, yaw > 0 for CCW
+  struct Pose {
+    double x, y, yaw;
+    Pose(double x_ = 0, double y_ = 0, double yaw_ = 0) : x(x_), y(y_), yaw(yaw_) {}
+  };
+
+  MipTrajectory(unsigned int period_ms = DEFAULT_PERIOD_MS)
+    : _period_us(1000 * std::max(period_ms, 1U)) {
+    clear();
+  }
+
+  inline void clear() {
+    _pdus.clear();
+    _end_us = 0;
+    _last_v_ticks = _last_w_ticks = 0;
+  }
+
+  inline unsigned int get_period_ms() const { return _period_us / 1000; }
+  inline const std::vector<MipTimedPdu> & get_pdus() const { return _pdus; }
+  //! \return the time of the end of the trajectory, after its last PDU
+  inline uint64_t get_duration_us() const { return _end_us; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! drive at given ticks for a duration, rounded to a number of periods.
+   *  Slowing down is forced as by Mip::continuous_drive(): if |v_ticks| decreases,
+   *  a PDU with v_ticks reversed comes first, otherwise if |w_ticks| decreases,
+   *  a PDU with w_ticks reversed. It has the time of the first PDU of the new speed.
+   *  \arg v_ticks in 1~64 (-64~1 to go backwards)
+   *  \arg w_ticks in 0~64 to turn CCW (-64~0 to turn CW) */
+  inline bool add_ticks(int v_ticks, int w_ticks, double duration_s) {
+    if (duration_s < 0)
+      return false;
+    unsigned int nperiods = std::max(1, (int) (duration_s * 1E6 / _period_us + .5));
+    if (abs(v_ticks) < abs(_last_v_ticks)) // force decelerating
+      push_continuous_drive(-v_ticks, w_ticks);
+    else if (abs(w_ticks) < abs(_last_w_ticks)) // force decelerating
+      push_continuous_drive(v_ticks, -w_ticks);
+    _last_v_ticks = v_ticks;
+    _last_w_ticks = w_ticks;
+    for (unsigned int i = 0; i < nperiods; ++i) {
+      push_continuous_drive(v_ticks, w_ticks);
+      _end_us += _period_us;
+    }
+    return true;
+  }
+
+  //! drive at given speeds for a duration, \see Mip::continuous_drive_metric()
+  inline bool add_velocity(double v_ms, double w_rads, double duration_s) {
+    int v_ticks, w_ticks;
+    return Mip::speed2ticks(v_ms, w_rads, v_ticks, w_ticks)
+        && add_ticks(v_ticks, w_ticks, duration_s);
+  }
+
+  //! a profile of velocities, sampled at the period of the trajectory
+  inline bool add_velocities(const double *v_ms, const double *w_rads, unsigned int n) {
+    std::vector<int> v_ticks(n), w_ticks(n);
+    if (!Mip::speed2ticks(v_ms, w_rads, n, v_ticks.data(), w_ticks.data()))
+      return false;
+    for (unsigned int i = 0; i < n; ++i)
+      add_ticks(v_ticks[i], w_ticks[i], _period_us / 1E6);
+    return true;
+  }
+
+  /*! follow a path: from each pose, turn on the spot towards the next one,
+   *  then drive straight to it, and finally turn to the yaw of the last pose.
+   *  The robot is supposed to be at the first pose.
+   *  The durations come from the speeds the robot really reaches,
+   *  once the speeds are converted into ticks, \see Mip::ticks2speeds().
+   *  \arg v_ms, w_rads the speeds of the straight lines and of the turns */
+  inline bool add_path(const std::vector<Pose> & poses,
+                       double v_ms = DEFAULT_V_MS, double w_rads = DEFAULT_W_RADS) {
+    if (poses.empty())
+      return true;
+    double yaw = poses.front().yaw;
+    for (unsigned int i = 1; i < poses.size(); ++i) {
+      double dx = poses[i].x - poses[i-1].x, dy = poses[i].y - poses[i-1].y,
+          dist = hypot(dx, dy);
+      if (dist < MIN_DISTANCE_M)
+        continue;
+      double heading = atan2(dy, dx);
+      if (!add_rotation(heading - yaw, w_rads) || !add_straight(dist, v_ms))
+        return false;
+      yaw = heading;
+    }
+    return add_rotation(poses.back().yaw - yaw, w_rads);
+  }
+
+  /*! a single CMD_DISTANCE_DRIVE, then wait for the robot to complete it.
+   *  \arg duration_s the time given to the robot, rounded up to a number of periods
+   *  \see Mip::distance_drive() */
+  inline bool add_distance_drive(double distance_m, double angle_rad, double duration_s) {
+    if (duration_s < 0)
+      return false;
+    uint8_t params[5];
+    Mip::distance_drive_params(distance_m, angle_rad, params);
+    push(CMD_DISTANCE_DRIVE, params, 5);
+    _end_us += _period_us * (uint64_t) ceil(duration_s * 1E6 / _period_us);
+    return true;
+  }
+
+  //! stop the robot, then wait for a duration
+  inline bool add_stop(double duration_s = 0) {
+    if (duration_s < 0)
+      return false;
+    push(CMD_STOP, NULL, 0);
+    _last_v_ticks = _last_w_ticks = 0;
+    _end_us += (uint64_t) (duration_s * 1E6);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! save the compiled trajectory: "MIPTRJ01", the period and the duration
+   *  in microseconds, the number of PDUs, then the PDUs, in the byte order of the host */
+  bool save(const std::string & filename) const {
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+      printf("Could not open '%s' for writing!\n", filename.c_str());
+      return false;
+    }
+    uint64_t header[3] = { _period_us, _end_us, _pdus.size() };
+    bool ok = (fwrite(magic(), 1, 8, file) == 8)
+        && (fwrite(header, sizeof(header), 1, file) == 1);
+    for (unsigned int i = 0; i < _pdus.size() && ok; ++i) {
+      const MipTimedPdu & pdu = _pdus[i];
+      ok = (fwrite(&pdu.time_us, sizeof(pdu.time_us), 1, file) == 1)
+          && (fwrite(&pdu.len, 1, 1, file) == 1)
+          && (fwrite(pdu.value, 1, pdu.len, file) == pdu.len);
+    }
+    return (fclose(file) == 0) && ok;
+  }
+
+  //! load a trajectory written by save()
+  bool load(const std::string & filename) {
+    clear();
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) {
+      printf("Could not open '%s' for reading!\n", filename.c_str());
+      return false;
+    }
+    long size = (fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1);
+    rewind(file);
+    char file_magic[8];
+    uint64_t header[3];
+    bool ok = (fread(file_magic, 1, 8, file) == 8) && !memcmp(file_magic, magic(), 8)
+        && (fread(header, sizeof(header), 1, file) == 1) && header[0] > 0
+        // a PDU takes at least 10 bytes: check the count before allocating
+        && size >= HEADER_SIZE && header[2] <= (uint64_t) (size - HEADER_SIZE) / MIN_PDU_SIZE;
+    if (ok) {
+      _period_us = header[0];
+      _end_us = header[1];
+      _pdus.resize(header[2]);
+    }
+    for (unsigned int i = 0; i < _pdus.size() && ok; ++i) {
+      MipTimedPdu & pdu = _pdus[i];
+      ok = (fread(&pdu.time_us, sizeof(pdu.time_us), 1, file) == 1)
+          && (fread(&pdu.len, 1, 1, file) == 1)
+          && pdu.len > 0 && pdu.len <= MipTimedPdu::MAX_LEN
+          && (fread(pdu.value, 1, pdu.len, file) == pdu.len)
+          && pdu.time_us <= _end_us;
+    }
+    fclose(file);
+    if (!ok) {
+      printf("'%s' is not a valid trajectory!\n", filename.c_str());
+      clear();
+    }
+    return ok;
+  }
+
+protected:
+  static inline const char* magic() { return "MIPTRJ01"; }
+  //! the magic and the header of save()
+  static const long HEADER_SIZE = 8 + 3 * sizeof(uint64_t);
+  //! time_us, len and at least one byte of value
+  static const long MIN_PDU_SIZE = sizeof(uint64_t) + 1 + 1;
+  //! the moves shorter than this are skipped by add_path()
+  static constexpr double MIN_DISTANCE_M = .01;
+  static constexpr double MIN_ANGLE_RAD = .02;
+
+  //! turn on the spot, at the speed reached by the robot for w_rads
+  inline bool add_rotation(double angle_rad, double w_rads) {
+    angle_rad = remainder(angle_rad, 2 * M_PI); // in [-pi, pi]
+    if (fabs(angle_rad) < MIN_ANGLE_RAD)
+      return true;
+    int v_ticks, w_ticks;
+    double v_real, w_real;
+    Mip::speed2ticks(0, copysign(fabs(w_rads), angle_rad), v_ticks, w_ticks);
+    Mip::ticks2speeds(v_ticks, w_ticks, v_real, w_real);
+    if (w_ticks == 0 || w_real * angle_rad <= 0) {
+      printf("MipTrajectory: cannot turn at %g rad/s!\n", w_rads);
+      return false;
+    }
+    return add_ticks(0, w_ticks, angle_rad / w_real);
+  }
+
+  //! drive straight, at the speed reached by the robot for v_ms
+  inline bool add_straight(double dist_m, double v_ms) {
+    int v_ticks, w_ticks;
+    double v_real, w_real;
+    Mip::speed2ticks(fabs(v_ms), 0, v_ticks, w_ticks);
+    Mip::ticks2speeds(v_ticks, w_ticks, v_real, w_real);
+    if (v_ticks == 0 || v_real <= 0) {
+      printf("MipTrajectory: cannot drive at %g m/s!\n", v_ms);
+      return false;
+    }
+    return add_ticks(v_ticks, 0, dist_m / v_real);
+  }
+
+  inline void push_continuous_drive(int v_ticks, int w_ticks) {
+    uint8_t params[2];
+    Mip::continuous_drive_params(v_ticks, w_ticks, params[0], params[1]);
+    push(CMD_CONTINUOUS_DRIVE, params, 2);
+  }
+
+  //! a PDU at the current end of the trajectory
+  inline void push(MipCommand cmd, const uint8_t *params, unsigned int nparams) {
+    MipTimedPdu pdu;
+    pdu.time_us = _end_us;
+    pdu.len = 1 + nparams;
+    pdu.value[0] = cmd;
+    if (nparams)
+      memcpy(pdu.value + 1, params, nparams);
+    _pdus.push_back(pdu);
+  }
+
+  uint64_t _period_us;
+  uint64_t _end_us;
+  std::vector<MipTimedPdu> _pdus;
+  //! for the forced deceleration
+  int _last_v_ticks, _last_w_ticks;
+}; // end class MipTrajectory
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Streams a MipTrajectory to a robot.
+ *  Each PDU is sent at its absolute time since the start (clock_nanosleep()
+ *  with TIMER_ABSTIME), so that the delays do not accumulate along the mission.
+ */
+class MipTrajectoryPlayer {
+public:
+  //! the timing of the last play()
+  struct PlayStats {
+    unsigned int npdus, nfailed;
+    //! the delay of the PDUs after their times, in microseconds
+    double late_mean_us, late_max_us;
+    PlayStats() : npdus(0), nfailed(0), late_mean_us(0), late_max_us(0) {}
+  };
+
+  MipTrajectoryPlayer() : _abort(false) {}
+
+  /*! send the trajectory, blocking until its end.
+   *  \return false if a PDU could not be sent, or if aborted */
+  bool play(Mip & mip, const MipTrajectory & trajectory) {
+    _abort = false;
+    _stats = PlayStats();
+    const std::vector<MipTimedPdu> & pdus = trajectory.get_pdus();
+    uint64_t start_us = now_us();
+    double late_sum_us = 0;
+    for (unsigned int i = 0; i < pdus.size(); ++i) {
+      if (_abort) {
+        mip.stop();
+        return false;
+      }
+      uint64_t due_us = start_us + pdus[i].time_us;
+      sleep_until(due_us);
+      double late_us = (double) (now_us() - due_us);
+      late_sum_us += late_us;
+      _stats.late_max_us = std::max(_stats.late_max_us, late_us);
+      ++_stats.npdus;
+      if (!mip.send_pdu(pdus[i].value, pdus[i].len))
+        ++_stats.nfailed;
+    }
+    if (_stats.npdus)
+      _stats.late_mean_us = late_sum_us / _stats.npdus;
+    sleep_until(start_us + trajectory.get_duration_us());
+    return (_stats.nfailed == 0 && !_abort);
+  }
+
+  //! stop the current play(), from another thread, the robot is stopped
+  inline void abort() { _abort = true; }
+
+  inline PlayStats get_stats() const { return _stats; }
+
+protected:
+  static inline uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  }
+
+  static inline void sleep_until(uint64_t time_us) {
+    struct timespec ts;
+    ts.tv_sec = time_us / 1000000;
+    ts.tv_nsec = (time_us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+  }
+
+  std::atomic<bool> _abort;
+  PlayStats _stats;
+}; // end class MipTrajectoryPlayer
+
+#endif // MIPTRAJECTORY_H
@@ -0,0 +1,130 @@
+/*!
+  \file        mipworker.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A thread running a GLib main loop with its own GMainContext,
+that dispatches the events of one or several robots.
+
+Mip::start_io_thread() creates one worker per robot,
+Mip::use_worker() shares a worker between robots, \see MipFleet.
+ */
+#ifndef MIPWORKER_H
+#define MIPWORKER_H
+
+#include <glib.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <thread>
+
+class MipWorker {
+public:
+  MipWorker() : _context(NULL), _main_loop(NULL), _nrobots(0), _norders(0) {}
+
+  virtual ~MipWorker() { stop(); }
+
+  //! create the context and start the thread. \return true if success
+  inline bool start() {
+    if (is_running())
+      return true;
+    _context = g_main_context_new();
+    _main_loop = g_main_loop_new(_context, FALSE);
+    _thread = std::thread(&MipWorker::run, this);
+    return true;
+  }
+
+  //! stop the thread. The robots using this worker must be detached before.
+  inline void stop() {
+    if (!is_running())
+      return;
+    // g_main_loop_quit() would be lost if the loop is not running yet
+    g_main_context_invoke(_context, MipWorker::quit_cb, this);
+    _thread.join();
+    g_main_loop_unref(_main_loop);
+    g_main_context_unref(_context);
+    _main_loop = NULL;
+    _context = NULL;
+  }
+
+  inline bool is_running() const { return _thread.joinable(); }
+  //! \return true if called by the thread of this worker
+  inline bool is_current_thread() const {
+    return std::this_thread::get_id() == _thread.get_id();
+  }
+  inline GMainContext* get_context() const { return _context; }
+
+  //! run a function in the thread of the worker, and wait for it to return
+  inline void invoke_sync(const std::function<void()> & func) {
+    if (!is_running() || is_current_thread()) {
+      func();
+      return;
+    }
+    SyncCall call;
+    call.func = &func;
+    std::future<void> done = call.done.get_future();
+    g_main_context_invoke(_context, MipWorker::sync_call_cb, &call);
+    done.wait();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the load of the worker, maintained by the robots using it
+  inline void add_robot() { ++_nrobots; }
+  inline void remove_robot() { --_nrobots; }
+  inline void count_orders(unsigned int norders) { _norders += norders; }
+  //! \return the number of robots using this worker
+  inline unsigned int get_robots_count() const { return _nrobots; }
+  //! \return the number of orders sent from this thread since start()
+  inline unsigned long get_orders_count() const { return _norders; }
+
+protected:
+  struct SyncCall {
+    const std::function<void()> *func;
+    std::promise<void> done;
+  };
+
+  //! the body of the thread
+  inline void run() {
+    // the libgatt sources get attached to the thread default context
+    g_main_context_push_thread_default(_context);
+    g_main_loop_run(_main_loop);
+    g_main_context_pop_thread_default(_context);
+  }
+
+  static gboolean quit_cb(gpointer user_data) {
+    g_main_loop_quit(((MipWorker*) user_data)->_main_loop);
+    return FALSE;
+  }
+
+  static gboolean sync_call_cb(gpointer user_data) {
+    SyncCall *call = (SyncCall*) user_data;
+    (*call->func)();
+    call->done.set_value();
+    return FALSE;
+  }
+
+  GMainContext *_context;
+  GMainLoop *_main_loop;
+  std::thread _thread;
+  std::atomic<unsigned int> _nrobots;
+  std::atomic<unsigned long> _norders;
+}; // end class MipWorker
+
+#endif // MIPWORKER_H
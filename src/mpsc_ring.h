@@ -0,0 +1,108 @@
+/*!
+  \file        mpsc_ring.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A bounded lock-free queue with many producers and a single consumer.
+
+Each cell carries a sequence number telling whether it is free
+for the producer of a given position, or ready for the consumer:
+producers only contend on a compare-and-swap of the tail index,
+the consumer never blocks them. No allocation after construction.
+Cf Dmitry Vyukov's bounded MPMC queue.
+ */
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template<class T, unsigned int N>
+class MpscRing {
+public:
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "the capacity must be a power of 2");
+
+  MpscRing() : _tail(0), _head(0) {
+    for (unsigned int i = 0; i < N; ++i)
+      _cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! can be called concurrently by any number of threads.
+   * \return false if the queue is full */
+  inline bool push(const T & item) {
+    size_t pos = _tail.load(std::memory_order_relaxed);
+    while (true) {
+      Cell & cell = _cells[pos & (N - 1)];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+      if (diff == 0) { // the cell is free, try to claim it
+        if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.item = item;
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) // the consumer did not free this cell yet
+        return false;
+      else // another producer claimed it
+        pos = _tail.load(std::memory_order_relaxed);
+    } // end while (true)
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*! must only be called by the consumer thread.
+   * \return false if the queue is empty */
+  inline bool pop(T & item) {
+    Cell & cell = _cells[_head & (N - 1)];
+    size_t seq = cell.seq.load(std::memory_order_acquire);
+    if ((intptr_t) seq - (intptr_t) (_head + 1) < 0)
+      return false;
+    item = cell.item;
+    cell.seq.store(_head + N, std::memory_order_release);
+    ++_head;
+    return true;
+  }
+
+  //! must only be called by the consumer thread, the producers may be pushing concurrently
+  inline bool empty() const {
+    return _tail.load(std::memory_order_relaxed) == _head;
+  }
+
+  static inline unsigned int capacity() { return N; }
+
+protected:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T item;
+  };
+
+  //! producers and consumer indices on different cache lines.
+  //! Padding rather than alignas(), for heap allocation before C++17
+  std::atomic<size_t> _tail;
+  char _pad_tail[64 - sizeof(std::atomic<size_t>)];
+  size_t _head;
+  char _pad_head[64 - sizeof(size_t)];
+  Cell _cells[N];
+}; // end class MpscRing
+
+#endif // MPSC_RING_H
@@ -0,0 +1,56 @@
+/*!
+  \file        rfkill_unblock_all.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+Unblock all the radio devices, as "rfkill unblock all" does,
+by writing a single event in /dev/rfkill instead of spawning a shell.
+Cf linux/rfkill.h
+ */
+#ifndef RFKILL_UNBLOCK_ALL_H
+#define RFKILL_UNBLOCK_ALL_H
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/rfkill.h>
+
+/*! free possibly busy bluetooth devices, like "rfkill unblock all".
+ * \return true if success */
+inline bool rfkill_unblock_all() {
+  int fd = open("/dev/rfkill", O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct rfkill_event event;
+  memset(&event, 0, sizeof(event));
+  event.type = RFKILL_TYPE_ALL;
+  event.op = RFKILL_OP_CHANGE_ALL;
+  event.soft = 0; // unblock
+  bool ok = (write(fd, &event, sizeof(event)) == (ssize_t) sizeof(event));
+  close(fd);
+  return ok;
+}
+
+//! rfkill_unblock_all(), only the first time it is called in the process
+inline bool rfkill_unblock_all_once() {
+  static const bool ok = rfkill_unblock_all();
+  return ok;
+}
+
+#endif // RFKILL_UNBLOCK_ALL_H
@@ -0,0 +1,85 @@
+/*!
+  \file        coroutine_behaviours.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A simple demo for the libmip library:
+three behaviours running concurrently on a single thread, with C++20 coroutines:
+drawing a square, watching the battery and blinking when an obstacle is close.
+ */
+#include "src/bluetooth_mac2device.h"
+#include "src/mipcoroutines.h"
+
+//! draw a square, without blocking the other behaviours
+MipTask square(AwaitableMip & robot) {
+  for (int side = 0; side < 4; ++side) {
+    robot.mip().distance_drive(.5, 0);
+    co_await robot.sleep(2000);
+    robot.mip().distance_drive(0, M_PI_2);
+    co_await robot.sleep(2000);
+  }
+  printf("square done, odometer:%fm\n", co_await robot.odometer_reading());
+}
+
+//! print the battery level every few seconds while the square is drawn
+MipTask watch_battery(AwaitableMip & robot, const MipTask & square_task) {
+  while (!square_task.done()) {
+    double voltage = co_await robot.battery_voltage();
+    printf("battery:%fV\n", voltage);
+    co_await robot.sleep(3000);
+  }
+}
+
+//! turn the chest red when an obstacle is close
+MipTask watch_radar(AwaitableMip & robot, const MipTask & square_task) {
+  robot.mip().set_gesture_or_radar_mode(GESTUREOFF_RADARON);
+  while (!square_task.done()) {
+    try {
+      RadarResponse radar = co_await robot.radar_response(500);
+      if (radar == RADAR_OBJECT_0TO10CM)
+        robot.mip().set_chest_LED(255, 0, 0);
+      else
+        robot.mip().set_chest_LED(0, 255, 0);
+    } catch (const MipTimeoutError &) {
+      // no radar update, check if the square is done
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
+  Mip mip;
+  std::string device_mac = (argc >= 2 ? argv[1] : "00:1A:7D:DA:71:11"),
+      mip_mac = (argc >= 3 ? argv[2] : "D0:39:72:B7:AF:66");
+  if (!mip.connect(main_loop, bluetooth_mac2device(device_mac).c_str(), mip_mac.c_str())) {
+    printf("Could not connect with device MAC '%s' to MIP with MAC '%s'!\n",
+           device_mac.c_str(), mip_mac.c_str());
+    return -1;
+  }
+  // now the real stuff
+  AwaitableMip robot(mip);
+  MipTask square_task = square(robot);
+  MipTask battery_task = watch_battery(robot, square_task);
+  MipTask radar_task = watch_radar(robot, square_task);
+  std::vector<MipTask*> tasks;
+  tasks.push_back(&square_task);
+  tasks.push_back(&battery_task);
+  tasks.push_back(&radar_task);
+  return (AwaitableMip::run_tasks(mip.get_context(), tasks) ? 0 : -1);
+}
@@ -0,0 +1,67 @@
+/*!
+  \file        fleet_dance.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A simple demo for the libmip library:
+a fleet of robots dancing together, driven from a few worker threads.
+Synopsis: fleet_dance DEVICE_MAC MIP_MAC1 MIP_MAC2 ...
+ */
+#include "src/bluetooth_mac2device.h"
+#include "src/mipfleet.h"
+#include "src/mipreconnect.h"
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf("Synopsis: %s DEVICE_MAC MIP_MAC1 MIP_MAC2 ...\n", argv[0]);
+    return -1;
+  }
+  std::string device_name = bluetooth_mac2device(argv[1]);
+  MipFleet fleet;
+  for (int i = 2; i < argc; ++i)
+    fleet.add_robot(device_name, argv[i]);
+  if (!fleet.connect_all())
+    printf("Only %i robots connected out of %i!\n",
+           fleet.get_stats().nconnected, fleet.size());
+  for (unsigned int i = 0; i < fleet.get_connect_reports().size(); ++i)
+    printf("%s\n", fleet.get_connect_reports()[i].to_string().c_str());
+  // the controller brings back the robots lost during the dance
+  MipReconnectManager reconnect_manager;
+  if (reconnect_manager.start(device_name))
+    for (unsigned int i = 0; i < fleet.size(); ++i)
+      reconnect_manager.add_robot(fleet[i]);
+  for (unsigned int i = 0; i < fleet.size(); ++i)
+    fleet[i].set_coalescing(true);
+
+  // now the real stuff: 20 seconds turning left and right, at 20 Hz
+  for (unsigned int step = 0; step < 400; ++step) {
+    int w_ticks = (step / 40 % 2 ? 10 : -10);
+    for (unsigned int i = 0; i < fleet.size(); ++i) {
+      fleet[i].continuous_drive(0, w_ticks);
+      if (step % 20 == 0)
+        fleet[i].request_battery_voltage_async();
+    }
+    if (step % 20 == 19) {
+      printf("%s, %i reconnections\n", fleet.get_stats().to_string().c_str(),
+             reconnect_manager.get_reconnections_count());
+    }
+    usleep(50E3);
+  }
+  return 0;
+}
@@ -24,11 +24,19 @@ driving the robot with the joystick.
  */
 #include "src/bluetooth_mac2device.h"
 #include "src/gattmip.h"
+#include "src/miprateloop.h"
 #include "src/joystick/joystick.hh"
 
+//! the position the farthest from the center
+inline short strongest(short axis1, short axis2) {
+  return (abs(axis1) > abs(axis2) ? axis1 : axis2);
+}
+
 int main(int argc, char** argv) {
   GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
   Mip mip;
+  // send the commands and handle the notifications in the background
+  mip.start_io_thread();
   std::string device_mac = (argc >= 2 ? argv[1] : "00:1A:7D:DA:71:11"),
       mip_mac = (argc >= 3 ? argv[2] : "D0:39:72:B7:AF:66"),
       joystick_device = "/dev/input/js1";
@@ -37,6 +45,8 @@ int main(int argc, char** argv) {
            device_mac.c_str(), mip_mac.c_str());
     return -1;
   }
+  // never queue stale motion commands if the radio stalls
+  mip.set_coalescing(true);
   // Create an instance of Joystick
   Joystick joystick(joystick_device);
   // Ensure that it was found and that we can use it
@@ -47,29 +57,30 @@ int main(int argc, char** argv) {
 
   double speed_lin = 0, speed_ang = 0;
   static const double MAX_AXIS = 32767, MAX_SPEED_LIN = 32, MAX_SPEED_ANG = 32;
-  while (true) {
-    // Restrict rate
-    usleep(25E3);
-    mip.continuous_drive(MAX_SPEED_LIN * speed_lin, MAX_SPEED_ANG * speed_ang);
-    // Attempt to sample an event from the joystick
-    JoystickEvent event;
-    if (!joystick.sample(&event))
-      continue;
-    //if (event.isButton()) printf("Button %i\n", event.number);
-    if (event.isButton() && event.number == 7)
-      mip.stop();
-    if (!event.isAxis())
-      continue;
-    printf("Axis %u is at position %d\n", event.number, event.value);
-    if (event.number == 1 || event.number == 5) { // up=-32767, down=32767
-      speed_lin = -1. * event.value / MAX_AXIS;
+  JoystickState state;
+  // a command each 25 ms, whatever the time spent in the loop
+  MipRateLoop loop(40);
+  loop.run([&]() {
+    // all the events since the previous tick, only the latest position of the axes matters:
+    // a fast stick movement does not delay the next commands
+    if (joystick.readState(&state) > 0) {
+      if (state.takePresses(7))
+        mip.stop();
+      // each speed has two axes, the one pushed the farthest wins
+      short lin = strongest(state.axes[1], state.axes[5]), // up=-32767, down=32767
+          ang = strongest(state.axes[2], state.axes[4]); // left=-32767, right=32767
+      double new_lin = -1. * lin / MAX_AXIS, new_ang = -1. * ang / MAX_AXIS;
+      if (new_lin != speed_lin || new_ang != speed_ang)
+        printf("speed(v:%f, w:%f)\n", new_lin, new_ang);
+      speed_lin = new_lin;
+      speed_ang = new_ang;
     }
-    if (event.number == 2 || event.number == 4) { // left=-32767, right=32767
-      speed_ang = -1. * event.value / MAX_AXIS;
-    }
-    printf("speed(v:%f, w:%f)\n", speed_lin, speed_ang);
+    mip.continuous_drive(MAX_SPEED_LIN * speed_lin, MAX_SPEED_ANG * speed_ang);
+    if (loop.get_stats().ticks % 400 == 0) // every 10 seconds
+      printf("%s\n", loop.get_stats().to_string().c_str());
     //mip.angle_drive(10. * speed_ang, 24. * speed_lin);
     //mip.distance_drive(10. * speed_lin, 10. * speed_ang);
-  } // end while()
+    return true;
+  }); // end loop.run()
   return 0;
 } // end main()
@@ -41,10 +41,22 @@ int main(int argc, char** argv) {
   printf("gesture_or_radar_mode:%i = '%s'\n",
          mip.get_gesture_or_radar_mode(),
          mip.get_gesture_or_radar_mode2str());
+  // check the radar mode in the background, the robot forgets it when it falls
+  mip.set_polling(CMD_GET_RADAR_MODE, 2000);
 
-  int rotate_in_place_counter = 0;
+  int rotate_in_place_counter = 0, radar_mode_counter = 0;
 
   while(true) {
+    // the cached mode is only updated by the answer of the robot:
+    // ask for it after the change, and leave it 1 second to come
+    GestureOrRadarMode mode = mip.get_gesture_or_radar_mode();
+    if (radar_mode_counter > 0)
+      --radar_mode_counter;
+    else if (mode != ERROR && mode != GESTUREOFF_RADARON) {
+      mip.set_gesture_or_radar_mode(GESTUREOFF_RADARON);
+      mip.request_gesture_or_radar_mode();
+      radar_mode_counter = 20;
+    }
     if (rotate_in_place_counter < 20) // do nothing
       ++rotate_in_place_counter;
     else if (mip.get_radar_response() == RADAR_OBJECT_0TO10CM
@@ -58,7 +70,7 @@ int main(int argc, char** argv) {
       //mip.distance_drive(drand48(), angle_rad); - no radar update
       mip.time_drive(10 + rand()%10, 2);
     }
-    usleep(50E3);
+    mip.pump_up_callbacks(1); // radar notifications and polling, then 50 ms
   }
   return 0;
 }
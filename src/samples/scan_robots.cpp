@@ -0,0 +1,45 @@
+/*!
+  \file        scan_robots.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A simple demo for the libmip library:
+find the MiP robots around, instead of "sudo hcitool lescan".
+Synopsis: scan_robots [DEVICE_MAC] [DURATION_MS]
+ */
+#include "src/bluetooth_mac2device.h"
+#include "src/mipscanner.h"
+
+int main(int argc, char** argv) {
+  std::string device_mac = (argc >= 2 ? argv[1] : "00:1A:7D:DA:71:11");
+  unsigned int duration_ms = (argc >= 3 ? atoi(argv[2]) : 5000);
+  MipScanner scanner;
+  if (!scanner.scan(duration_ms, bluetooth_mac2device(device_mac))) {
+    printf("Could not scan with device MAC '%s'!\n", device_mac.c_str());
+    return -1;
+  }
+  std::vector<MipScanner::Device> robots = scanner.get_robots();
+  printf("%i robots found among %i devices, %li reports, %li dropped\n",
+         (int) robots.size(), scanner.get_devices_count(),
+         scanner.get_reports_count(), scanner.get_dropped_count());
+  for (unsigned int i = 0; i < robots.size(); ++i)
+    printf("%s '%s' %i dBm, %i reports\n", robots[i].mac().c_str(),
+           robots[i].name.c_str(), robots[i].rssi, robots[i].nreports);
+  return 0;
+}
@@ -24,13 +24,14 @@ random walking while avoiding obstacles.
  */
 #include "src/bluetooth_mac2device.h"
 #include "src/gattmip.h"
+#include "src/miprateloop.h"
 #include <curses.h>
 #include <sys/time.h>
 
 class Timer {
 public:
   typedef float Time;
-  const static Time NOTIME = -1;
+  static constexpr Time NOTIME = -1;
   Timer() { reset(); }
   virtual inline void reset() {
     gettimeofday(&start, NULL);
@@ -90,11 +91,14 @@ int main(int argc, char** argv) {
   printw("press any key when the %i loops are over...", nloops);
   timeout(0);
   cbreak();
-  while(getch() <= 0) {
+  // a command each 50 ms, a drifting rate would bias the measured speeds
+  MipRateLoop loop(20);
+  loop.run([&]() {
     mip.continuous_drive(lin_speedi, ang_speedi);
-    usleep(50 * 1000);
-  }
+    return (getch() <= 0);
+  });
   endwin();
+  printf("%s\n", loop.get_stats().to_string().c_str());
 
   double time = timer.getTimeMilliseconds() * 1E-3;
   double odom_end = get_odometry_safe(mip), dist = odom_end - odom_begin;
@@ -20,10 +20,10 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ________________________________________________________________________________
 A simple demo for the libmip library:
-drawing a square.
+drawing a square, compiled beforehand into a trajectory.
  */
 #include "src/bluetooth_mac2device.h"
-#include "src/gattmip.h"
+#include "src/miptrajectory.h"
 int main(int argc, char** argv) {
   GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
   Mip mip;
@@ -52,11 +52,21 @@ int main(int argc, char** argv) {
 #endif
 
 
-  for (int side = 0; side < 4; ++side) {
-    mip.distance_drive(.5, 0);
-    sleep(2);
-    mip.distance_drive(0, M_PI_2);
-    sleep(2);
-  }
-  return 0;
+  std::vector<MipTrajectory::Pose> square;
+  square.push_back(MipTrajectory::Pose(0, 0, 0));
+  square.push_back(MipTrajectory::Pose(.5, 0, 0));
+  square.push_back(MipTrajectory::Pose(.5, .5, 0));
+  square.push_back(MipTrajectory::Pose(0, .5, 0));
+  square.push_back(MipTrajectory::Pose(0, 0, 0));
+  MipTrajectory trajectory;
+  trajectory.add_path(square);
+  trajectory.add_stop();
+  printf("square: %li commands, %g s\n",
+         (long) trajectory.get_pdus().size(), trajectory.get_duration_us() / 1E6);
+  MipTrajectoryPlayer player;
+  bool ok = player.play(mip, trajectory);
+  MipTrajectoryPlayer::PlayStats stats = player.get_stats();
+  printf("%u commands sent, %u failed, late by %g us on average, %g us at most\n",
+         stats.npdus, stats.nfailed, stats.late_mean_us, stats.late_max_us);
+  return (ok ? 0 : -1);
 }
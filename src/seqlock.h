@@ -0,0 +1,85 @@
+/*!
+  \file        seqlock.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2026/10/17
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+A sequence lock: a value written by one thread at a time,
+read by any number of threads without blocking the writer.
+
+The writer makes the sequence number odd while it copies the value,
+then even again: a reader retries if the number was odd or changed
+during its copy. Readers never write to shared memory,
+so any number of them can poll the value at a high rate.
+The value is stored as relaxed atomic words, so that the concurrent copies
+are not data races. T must be trivially copyable, and small.
+ */
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+template<class T>
+class Seqlock {
+public:
+  static_assert(std::is_trivially_copyable<T>::value, "the value must be trivially copyable");
+
+  Seqlock() : _seq(0) {
+    for (unsigned int i = 0; i < NWORDS; ++i)
+      _words[i].store(0, std::memory_order_relaxed);
+  }
+
+  //! the writers must be serialized by the caller
+  inline void store(const T & value) {
+    uint64_t words[NWORDS] = {};
+    memcpy(words, &value, sizeof(T));
+    unsigned int seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (unsigned int i = 0; i < NWORDS; ++i)
+      _words[i].store(words[i], std::memory_order_relaxed);
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  //! can be called concurrently by any number of threads, spins while a store() is running
+  inline T load() const {
+    uint64_t words[NWORDS];
+    unsigned int seq_before, seq_after;
+    do {
+      seq_before = _seq.load(std::memory_order_acquire);
+      for (unsigned int i = 0; i < NWORDS; ++i)
+        words[i] = _words[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      seq_after = _seq.load(std::memory_order_relaxed);
+    } while ((seq_before & 1) || seq_before != seq_after);
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+protected:
+  static const unsigned int NWORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<unsigned int> _seq;
+  std::atomic<uint64_t> _words[NWORDS];
+}; // end class Seqlock
+
+#endif // SEQLOCK_H